@@ -14,56 +14,165 @@
 
 #include "./analyze_corpora.h"
 
-#include "absl/container/flat_hash_set.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
 #include "./feature.h"
 #include "./logging.h"
 
 namespace centipede {
-void AnalyzeCorpora(const Coverage::PCTable &pc_table,
-                    const SymbolTable &symbols,
-                    const std::vector<CorpusRecord> &a,
-                    const std::vector<CorpusRecord> &b) {
-  // TODO(kcc): compute the CoverageFrontier of `a`. We are only interested in
-  // elements of `b` that break though that CoverageFrontier.
-
-  // `a_pcs` will contain all PCs covered by `a`.
-  absl::flat_hash_set<size_t> a_pcs;
-  for (const auto &record : a) {
-    for (const auto &feature : record.features) {
-      if (!feature_domains::k8bitCounters.Contains(feature)) continue;
-      auto pc = Convert8bitCounterFeatureToPcIndex(feature);
-      a_pcs.insert(pc);
+
+namespace {
+
+// Returns word `i` of `words`, 0 past the end.
+uint64_t WordAt(const std::vector<uint64_t> &words, size_t i) {
+  return i < words.size() ? words[i] : 0;
+}
+
+size_t MaxNumWords(const std::vector<CorpusCoverage> &corpora) {
+  size_t num_words = 0;
+  for (const auto &corpus : corpora) {
+    num_words = std::max(num_words, corpus.pcs.words().size());
+  }
+  return num_words;
+}
+
+// Returns, word by word, the PCs covered by at least two of `corpora`.
+std::vector<uint64_t> PcsCoveredMoreThanOnce(
+    const std::vector<CorpusCoverage> &corpora) {
+  const size_t num_words = MaxNumWords(corpora);
+  std::vector<uint64_t> once(num_words), more_than_once(num_words);
+  for (const auto &corpus : corpora) {
+    const auto &words = corpus.pcs.words();
+    for (size_t i = 0; i < words.size(); ++i) {
+      more_than_once[i] |= once[i] & words[i];
+      once[i] |= words[i];
+    }
+  }
+  return more_than_once;
+}
+
+// Appends `str` to `out` as a JSON string.
+void AppendJsonString(std::string &out, const std::string &str) {
+  out += '"';
+  for (const char c : str) {
+    if (c == '"' || c == '\\') out += '\\';
+    out += c;
+  }
+  out += '"';
+}
+
+}  // namespace
+
+void PcBitmap::Merge(const PcBitmap &other) {
+  if (other.words_.size() > words_.size()) words_.resize(other.words_.size());
+  for (size_t i = 0; i < other.words_.size(); ++i) words_[i] |= other.words_[i];
+}
+
+size_t PcBitmap::Count() const {
+  size_t count = 0;
+  for (const uint64_t word : words_) count += __builtin_popcountll(word);
+  return count;
+}
+
+size_t PcBitmap::CountNotIn(const PcBitmap &other) const {
+  size_t count = 0;
+  for (size_t i = 0; i < words_.size(); ++i) {
+    count += __builtin_popcountll(words_[i] & ~WordAt(other.words_, i));
+  }
+  return count;
+}
+
+void CorpusCoverage::AddInput(const FeatureVec &features) {
+  ++num_inputs;
+  for (const auto feature : features) {
+    if (!feature_domains::k8bitCounters.Contains(feature)) continue;
+    pcs.Set(Convert8bitCounterFeatureToPcIndex(feature));
+  }
+}
+
+void CorpusCoverage::Merge(const CorpusCoverage &other) {
+  num_inputs += other.num_inputs;
+  pcs.Merge(other.pcs);
+}
+
+CorporaAnalysis AnalyzeCorpora(const std::vector<CorpusCoverage> &corpora,
+                               size_t total_pcs) {
+  CorporaAnalysis analysis;
+  analysis.total_pcs = total_pcs;
+  const auto more_than_once = PcsCoveredMoreThanOnce(corpora);
+  for (const auto &corpus : corpora) {
+    analysis.names.push_back(corpus.name);
+    analysis.num_inputs.push_back(corpus.num_inputs);
+    analysis.covered_pcs.push_back(corpus.pcs.Count());
+    size_t unique_pcs = 0;
+    const auto &words = corpus.pcs.words();
+    for (size_t i = 0; i < words.size(); ++i) {
+      unique_pcs += __builtin_popcountll(words[i] & ~more_than_once[i]);
+    }
+    analysis.unique_pcs.push_back(unique_pcs);
+    auto &pcs_not_in = analysis.pcs_not_in.emplace_back();
+    for (const auto &other : corpora) {
+      pcs_not_in.push_back(corpus.pcs.CountNotIn(other.pcs));
     }
   }
+  return analysis;
+}
 
-  // `b_only_pcs` will contain PCs covered by `b` but not by `a`.
-  // `b_unique_indices` are indices of inputs that have PCs from `b_only_pcs`.
-  // `b_shared_indices` are indices of all other inputs from `b`.
-  absl::flat_hash_set<size_t> b_only_pcs;
-  std::vector<size_t> b_shared_indices, b_unique_indices;
-  for (size_t i = 0; i < b.size(); ++i) {
-    const auto &record = b[i];
-    bool has_b_only = false;
-    for (const auto &feature : record.features) {
-      if (!feature_domains::k8bitCounters.Contains(feature)) continue;
-      auto pc = Convert8bitCounterFeatureToPcIndex(feature);
-      if (a_pcs.contains(pc)) continue;
-      b_only_pcs.insert(pc);
-      has_b_only = true;
+PcBitmap UniquePcs(const std::vector<CorpusCoverage> &corpora, size_t index) {
+  CHECK_LT(index, corpora.size());
+  const auto more_than_once = PcsCoveredMoreThanOnce(corpora);
+  const auto &words = corpora[index].pcs.words();
+  PcBitmap unique_pcs;
+  for (size_t i = 0; i < words.size(); ++i) {
+    uint64_t word = words[i] & ~more_than_once[i];
+    for (; word != 0; word &= word - 1) {
+      unique_pcs.Set(i * 64 + __builtin_ctzll(word));
     }
-    if (has_b_only)
-      b_unique_indices.push_back(i);
-    else
-      b_shared_indices.push_back(i);
+  }
+  return unique_pcs;
+}
+
+std::string CorporaAnalysisToJson(const CorporaAnalysis &analysis) {
+  std::string out = absl::StrCat("{\"total_pcs\":", analysis.total_pcs,
+                                 ",\"corpora\":[");
+  for (size_t i = 0; i < analysis.names.size(); ++i) {
+    absl::StrAppend(&out, i ? "," : "", "{\"workdir\":");
+    AppendJsonString(out, analysis.names[i]);
+    absl::StrAppend(&out, ",\"num_inputs\":", analysis.num_inputs[i],
+                    ",\"covered_pcs\":", analysis.covered_pcs[i],
+                    ",\"unique_pcs\":", analysis.unique_pcs[i], "}");
+  }
+  absl::StrAppend(&out, "],\"pcs_not_in\":[");
+  for (size_t i = 0; i < analysis.pcs_not_in.size(); ++i) {
+    absl::StrAppend(&out, i ? "," : "", "[");
+    for (size_t j = 0; j < analysis.pcs_not_in[i].size(); ++j) {
+      absl::StrAppend(&out, j ? "," : "", analysis.pcs_not_in[i][j]);
+    }
+    absl::StrAppend(&out, "]");
+  }
+  absl::StrAppend(&out, "]}\n");
+  return out;
+}
+
+void LogUniquePcs(const Coverage::PCTable &pc_table,
+                  const SymbolTable &symbols,
+                  const std::vector<CorpusCoverage> &corpora, size_t index) {
+  const PcBitmap unique_pcs = UniquePcs(corpora, index);
+  LOG(INFO) << "symbolized PCs covered only by " << corpora[index].name << ": "
+            << unique_pcs.Count();
+  CoverageLogger coverage_logger(pc_table, symbols);
+  const auto &words = unique_pcs.words();
+  for (size_t i = 0; i < words.size(); ++i) {
+    for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+      auto str = coverage_logger.ObserveAndDescribeIfNew(
+          i * 64 + __builtin_ctzll(word));
+      if (!str.empty()) LOG(INFO) << str;
     }
-    LOG(INFO) << VV(a.size()) << VV(b.size()) << VV(a_pcs.size())
-              << VV(b_only_pcs.size()) << VV(b_shared_indices.size())
-              << VV(b_unique_indices.size());
-    CoverageLogger coverage_logger(pc_table, symbols);
-    LOG(INFO) << "symbolized b-only PCs:";
-    for (const auto pc : b_only_pcs) {
-    auto str = coverage_logger.ObserveAndDescribeIfNew(pc);
-    if (!str.empty()) LOG(INFO) << str;
   }
 }
 
@@ -15,18 +15,87 @@
 #ifndef THIRD_PARTY_CENTIPEDE_ANALYZE_CORPORA_H
 #define THIRD_PARTY_CENTIPEDE_ANALYZE_CORPORA_H
 
-#include "./corpus.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "./coverage.h"
+#include "./feature.h"
 #include "./symbol_table.h"
 
 namespace centipede {
 
-// Analyzes two corpora, `a` and `b`, reports the differences.
-// TODO(kcc): unimplemented.
-void AnalyzeCorpora(const Coverage::PCTable &pc_table,
-                    const SymbolTable &symbols,
-                    const std::vector<CorpusRecord> &a,
-                    const std::vector<CorpusRecord> &b);
+// A set of PC indices, one bit per PC. Grows as needed.
+class PcBitmap {
+ public:
+  PcBitmap() = default;
+  // Reserves space for PC indices in [0, num_pcs).
+  explicit PcBitmap(size_t num_pcs) : words_((num_pcs + 63) / 64) {}
+
+  void Set(size_t pc_index) {
+    const size_t word = pc_index / 64;
+    if (word >= words_.size()) words_.resize(word + 1);
+    words_[word] |= 1ULL << (pc_index % 64);
+  }
+  bool Get(size_t pc_index) const {
+    const size_t word = pc_index / 64;
+    return word < words_.size() && (words_[word] >> (pc_index % 64)) & 1;
+  }
+  // Adds all PCs of `other` to this.
+  void Merge(const PcBitmap &other);
+  // Returns the number of PCs in this.
+  size_t Count() const;
+  // Returns the number of PCs in this that are not in `other`.
+  size_t CountNotIn(const PcBitmap &other) const;
+
+  const std::vector<uint64_t> &words() const { return words_; }
+
+ private:
+  std::vector<uint64_t> words_;
+};
+
+// The PC coverage of one corpus.
+struct CorpusCoverage {
+  std::string name;
+  size_t num_inputs = 0;
+  PcBitmap pcs;
+
+  // Adds one input with `features`. Only the k8bitCounters features are used.
+  void AddInput(const FeatureVec &features);
+  // Adds the inputs of `other`, which is a part of the same corpus.
+  void Merge(const CorpusCoverage &other);
+};
+
+// The differences between N corpora, see AnalyzeCorpora().
+struct CorporaAnalysis {
+  // The size of the PC table, 0 if unknown.
+  size_t total_pcs = 0;
+  // Per corpus, in the order of the corpora.
+  std::vector<std::string> names;
+  std::vector<size_t> num_inputs;
+  std::vector<size_t> covered_pcs;
+  // The contribution of a corpus: the PCs covered by it and by no other one.
+  std::vector<size_t> unique_pcs;
+  // pcs_not_in[i][j]: the number of PCs covered by corpus i and not by j.
+  std::vector<std::vector<size_t>> pcs_not_in;
+};
+
+// Computes the per-corpus and the pairwise coverage differences of `corpora`.
+// `total_pcs` is only copied to the result.
+CorporaAnalysis AnalyzeCorpora(const std::vector<CorpusCoverage> &corpora,
+                               size_t total_pcs);
+
+// Returns the PCs covered by `corpora[index]` and by no other corpus.
+PcBitmap UniquePcs(const std::vector<CorpusCoverage> &corpora, size_t index);
+
+// Returns `analysis` as one JSON object, followed by a newline.
+std::string CorporaAnalysisToJson(const CorporaAnalysis &analysis);
+
+// Logs the symbolized PCs that only `corpora[index]` covers.
+void LogUniquePcs(const Coverage::PCTable &pc_table,
+                  const SymbolTable &symbols,
+                  const std::vector<CorpusCoverage> &corpora, size_t index);
 
 }  // namespace centipede
 
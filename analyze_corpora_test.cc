@@ -14,11 +14,106 @@
 
 #include "./analyze_corpora.h"
 
+#include <cstddef>
+#include <string>
+#include <vector>
+
 #include "googletest/include/gtest/gtest.h"
-#include "./logging.h"
+#include "./feature.h"
 
 namespace centipede {
 namespace {
-TEST(AnalyzeCorpora, AnalyzeCorpora) { LOG(INFO) << "Unimplemented"; }
+
+// Returns the 8-bit counter features of `pc_indices`.
+FeatureVec PcFeatures(const std::vector<size_t> &pc_indices) {
+  FeatureVec features;
+  for (const size_t pc_index : pc_indices) {
+    features.push_back(feature_domains::k8bitCounters.ConvertToMe(
+        Convert8bitCounterToNumber(pc_index, /*counter_value*/ 1)));
+  }
+  return features;
+}
+
+TEST(AnalyzeCorpora, PcBitmap) {
+  PcBitmap a(10);
+  EXPECT_EQ(a.Count(), 0);
+  a.Set(3);
+  a.Set(200);  // Grows.
+  EXPECT_TRUE(a.Get(3));
+  EXPECT_TRUE(a.Get(200));
+  EXPECT_FALSE(a.Get(4));
+  EXPECT_FALSE(a.Get(100000));
+  EXPECT_EQ(a.Count(), 2);
+
+  PcBitmap b;
+  b.Set(3);
+  b.Set(64);
+  EXPECT_EQ(a.CountNotIn(b), 1);
+  EXPECT_EQ(b.CountNotIn(a), 1);
+  b.Merge(a);
+  EXPECT_EQ(b.Count(), 3);
+  EXPECT_EQ(a.CountNotIn(b), 0);
+  EXPECT_EQ(b.CountNotIn(a), 1);
+}
+
+TEST(AnalyzeCorpora, CorpusCoverage) {
+  CorpusCoverage coverage;
+  // Features from other domains are ignored.
+  coverage.AddInput({feature_domains::kCMP.ConvertToMe(5)});
+  coverage.AddInput(PcFeatures({1, 2}));
+  CorpusCoverage other;
+  other.AddInput(PcFeatures({2, 70}));
+  coverage.Merge(other);
+  EXPECT_EQ(coverage.num_inputs, 3);
+  EXPECT_EQ(coverage.pcs.Count(), 3);
+  EXPECT_TRUE(coverage.pcs.Get(1));
+  EXPECT_TRUE(coverage.pcs.Get(2));
+  EXPECT_TRUE(coverage.pcs.Get(70));
+}
+
+TEST(AnalyzeCorpora, AnalyzeCorpora) {
+  std::vector<CorpusCoverage> corpora(3);
+  corpora[0].name = "a";
+  corpora[0].AddInput(PcFeatures({0, 1, 2, 100}));
+  corpora[1].name = "b";
+  corpora[1].AddInput(PcFeatures({1, 2}));
+  corpora[1].AddInput(PcFeatures({3, 200}));
+  corpora[2].name = "c";
+  corpora[2].AddInput(PcFeatures({2, 3}));
+
+  const CorporaAnalysis analysis = AnalyzeCorpora(corpora, 1000);
+  EXPECT_EQ(analysis.total_pcs, 1000);
+  EXPECT_EQ(analysis.names, std::vector<std::string>({"a", "b", "c"}));
+  EXPECT_EQ(analysis.num_inputs, std::vector<size_t>({1, 2, 1}));
+  EXPECT_EQ(analysis.covered_pcs, std::vector<size_t>({4, 4, 2}));
+  EXPECT_EQ(analysis.unique_pcs, std::vector<size_t>({2, 1, 0}));
+  EXPECT_EQ(analysis.pcs_not_in, std::vector<std::vector<size_t>>({
+                                     {0, 2, 3},
+                                     {2, 0, 2},
+                                     {1, 0, 0},
+                                 }));
+
+  const PcBitmap unique_pcs = UniquePcs(corpora, 0);
+  EXPECT_EQ(unique_pcs.Count(), 2);
+  EXPECT_TRUE(unique_pcs.Get(0));
+  EXPECT_TRUE(unique_pcs.Get(100));
+  EXPECT_EQ(UniquePcs(corpora, 2).Count(), 0);
+}
+
+TEST(AnalyzeCorpora, CorporaAnalysisToJson) {
+  std::vector<CorpusCoverage> corpora(2);
+  corpora[0].name = "/tmp/wd\"1";
+  corpora[0].AddInput(PcFeatures({1, 2}));
+  corpora[1].name = "wd2";
+  corpora[1].AddInput(PcFeatures({2}));
+  EXPECT_EQ(CorporaAnalysisToJson(AnalyzeCorpora(corpora, 10)),
+            "{\"total_pcs\":10,\"corpora\":["
+            "{\"workdir\":\"/tmp/wd\\\"1\",\"num_inputs\":1,"
+            "\"covered_pcs\":2,\"unique_pcs\":1},"
+            "{\"workdir\":\"wd2\",\"num_inputs\":1,"
+            "\"covered_pcs\":1,\"unique_pcs\":0}],"
+            "\"pcs_not_in\":[[0,1],[0,0]]}\n");
+}
+
 }  // namespace
 }  // namespace centipede
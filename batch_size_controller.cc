@@ -0,0 +1,102 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./batch_size_controller.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "./logging.h"
+
+namespace centipede {
+
+namespace {
+// Weight of the newest measurement in the moving averages.
+constexpr double kSmoothing = 0.25;
+// While the fraction of crashing batches is above this, don't grow.
+constexpr double kMaxCrashRateToGrow = 0.1;
+// Don't change the batch size by less than 1/kMinChangeFraction of it,
+// to avoid flip-flopping (and log spam) due to measurement noise.
+constexpr size_t kMinChangeFraction = 8;
+
+double Smooth(double average, double value) {
+  if (average < 0) return value;
+  return average * (1 - kSmoothing) + value * kSmoothing;
+}
+}  // namespace
+
+BatchSizeController::BatchSizeController(size_t initial_batch_size,
+                                         size_t min_batch_size,
+                                         size_t max_batch_size,
+                                         size_t target_overhead_percent)
+    : min_batch_size_(min_batch_size),
+      max_batch_size_(max_batch_size),
+      target_overhead_(target_overhead_percent / 100.),
+      batch_size_(
+          std::clamp(initial_batch_size, min_batch_size, max_batch_size)) {
+  CHECK_GE(min_batch_size_, 1);
+  CHECK_LE(min_batch_size_, max_batch_size_);
+  CHECK_GT(target_overhead_percent, 0);
+  CHECK_LT(target_overhead_percent, 100);
+}
+
+bool BatchSizeController::SetBatchSize(size_t new_batch_size,
+                                       const char *reason) {
+  new_batch_size = std::clamp(new_batch_size, min_batch_size_, max_batch_size_);
+  if (new_batch_size == batch_size_) return false;
+  last_decision_ = absl::StrCat(
+      "batch_size: ", batch_size_, " -> ", new_batch_size, " (", reason,
+      "; overhead/batch: ", static_cast<uint64_t>(overhead_usec_),
+      "us per-input: ", static_cast<uint64_t>(per_input_usec_),
+      "us crash-rate: ", static_cast<int>(crash_rate_ * 100), "%)");
+  batch_size_ = new_batch_size;
+  return true;
+}
+
+bool BatchSizeController::Update(size_t num_inputs, uint64_t wall_time_usec,
+                                 uint64_t inputs_time_usec, bool crashed) {
+  crash_rate_ = crash_rate_ * (1 - kSmoothing) + (crashed ? kSmoothing : 0);
+  // The timing of a crashed batch includes the crash reporting, ignore it.
+  if (crashed) return SetBatchSize(batch_size_ / 2, "crash");
+  if (num_inputs == 0) return false;
+
+  const uint64_t overhead_usec =
+      wall_time_usec > inputs_time_usec ? wall_time_usec - inputs_time_usec : 0;
+  overhead_usec_ = Smooth(overhead_usec_, overhead_usec);
+  per_input_usec_ =
+      Smooth(per_input_usec_, static_cast<double>(inputs_time_usec) /
+                                  static_cast<double>(num_inputs));
+
+  // Solve Overhead / (Overhead + N * PerInput) == target_overhead_ for N.
+  // Treat per-input times below 1us as 1us to avoid dividing by zero.
+  const double desired = overhead_usec_ * (1 - target_overhead_) /
+                         (target_overhead_ * std::max(per_input_usec_, 1.));
+  // Change at most 2x at a time.
+  size_t new_batch_size = std::clamp(static_cast<size_t>(desired),
+                                     batch_size_ / 2, batch_size_ * 2);
+  if (new_batch_size > batch_size_) {
+    if (crash_rate_ > kMaxCrashRateToGrow) return false;
+    if (new_batch_size - batch_size_ < batch_size_ / kMinChangeFraction)
+      return false;
+    return SetBatchSize(new_batch_size, "overhead too high");
+  }
+  if (batch_size_ - new_batch_size < batch_size_ / kMinChangeFraction)
+    return false;
+  return SetBatchSize(new_batch_size, "overhead too low");
+}
+
+}  // namespace centipede
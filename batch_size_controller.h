@@ -0,0 +1,86 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CENTIPEDE_BATCH_SIZE_CONTROLLER_H_
+#define THIRD_PARTY_CENTIPEDE_BATCH_SIZE_CONTROLLER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace centipede {
+
+// Adaptively chooses the number of inputs to execute in one batch,
+// see --auto_batch_size_overhead.
+//
+// The wall time of executing a batch of N inputs is modeled as
+//   T(N) = Overhead + N * PerInput,
+// where Overhead is the fixed per-batch cost (fork/exec of the target,
+// setting up shared memory, etc) and PerInput is the cost of executing one
+// input, as reported by the runner in ExecutionResult::Stats.
+// The controller picks N such that Overhead / T(N) is close to the target
+// overhead fraction: large batches amortize the overhead, small batches are
+// cheaper to lose on a crash and keep the corpus fresher.
+//
+// A crash halves the batch size (the batch is lost and the crash reproducer
+// search costs more for larger batches); while crashes are frequent, the
+// batch size is not increased.
+//
+// This class is thread-compatible.
+class BatchSizeController {
+ public:
+  // `initial_batch_size` is used until the first measurement.
+  // The batch size always stays within [`min_batch_size`, `max_batch_size`].
+  // `target_overhead_percent` must be in (0, 100).
+  BatchSizeController(size_t initial_batch_size, size_t min_batch_size,
+                      size_t max_batch_size, size_t target_overhead_percent);
+
+  // Returns the current batch size.
+  size_t batch_size() const { return batch_size_; }
+
+  // Records the result of executing a batch of `num_inputs` inputs:
+  // `wall_time_usec` is the wall time of executing the whole batch,
+  // `inputs_time_usec` is the sum of the per-input times reported by the
+  // runner, `crashed` is true if the batch crashed.
+  // Returns true if batch_size() has changed;
+  // in that case, last_decision() explains why.
+  bool Update(size_t num_inputs, uint64_t wall_time_usec,
+              uint64_t inputs_time_usec, bool crashed);
+
+  // Returns a human-readable description of the last batch size change.
+  const std::string &last_decision() const { return last_decision_; }
+
+ private:
+  // Sets batch_size_ to `new_batch_size` clamped to the bounds, and
+  // records the `reason` in last_decision_. Returns true if changed.
+  bool SetBatchSize(size_t new_batch_size, const char *reason);
+
+  const size_t min_batch_size_;
+  const size_t max_batch_size_;
+  const double target_overhead_;  // Fraction in (0, 1).
+  size_t batch_size_;
+
+  // Exponential moving averages of the measurements.
+  // Negative means "no measurements yet".
+  double overhead_usec_ = -1;
+  double per_input_usec_ = -1;
+  // Fraction of recent batches that crashed.
+  double crash_rate_ = 0;
+
+  std::string last_decision_;
+};
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_BATCH_SIZE_CONTROLLER_H_
@@ -0,0 +1,73 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./batch_size_controller.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace centipede {
+namespace {
+
+// Simulates executing batches on a target with the given costs,
+// returns the final batch size.
+size_t Simulate(BatchSizeController &controller, uint64_t overhead_usec,
+                uint64_t per_input_usec, size_t num_batches) {
+  for (size_t i = 0; i < num_batches; ++i) {
+    size_t n = controller.batch_size();
+    controller.Update(n, overhead_usec + n * per_input_usec, n * per_input_usec,
+                      /*crashed=*/false);
+  }
+  return controller.batch_size();
+}
+
+TEST(BatchSizeController, ConvergesToTargetOverhead) {
+  // 10% overhead with 100ms overhead and 1ms per input => 900 inputs.
+  BatchSizeController controller(100, 1, 100000, 10);
+  size_t batch_size = Simulate(controller, 100000, 1000, 100);
+  EXPECT_GE(batch_size, 800);
+  EXPECT_LE(batch_size, 1000);
+  EXPECT_FALSE(controller.last_decision().empty());
+
+  // The target becomes much slower => smaller batches.
+  batch_size = Simulate(controller, 100000, 100000, 100);
+  EXPECT_LE(batch_size, 10);
+}
+
+TEST(BatchSizeController, StaysWithinBounds) {
+  BatchSizeController controller(100, 50, 200, 10);
+  EXPECT_EQ(Simulate(controller, 1000000, 1, 100), 200);
+  EXPECT_EQ(Simulate(controller, 1, 1000000, 100), 50);
+
+  BatchSizeController clamped(1000, 1, 10, 50);
+  EXPECT_EQ(clamped.batch_size(), 10);
+}
+
+TEST(BatchSizeController, ReactsToCrashes) {
+  BatchSizeController controller(1000, 1, 100000, 10);
+  EXPECT_TRUE(controller.Update(1000, 0, 0, /*crashed=*/true));
+  EXPECT_EQ(controller.batch_size(), 500);
+  EXPECT_TRUE(controller.Update(500, 0, 0, /*crashed=*/true));
+  EXPECT_EQ(controller.batch_size(), 250);
+  // Crashes are frequent => don't grow even if the overhead is high.
+  EXPECT_FALSE(controller.Update(250, 1000000, 250, /*crashed=*/false));
+  EXPECT_EQ(controller.batch_size(), 250);
+  // After enough crash-free batches, grow again.
+  EXPECT_GT(Simulate(controller, 1000000, 1, 20), 250);
+}
+
+}  // namespace
+}  // namespace centipede
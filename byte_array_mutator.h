@@ -182,6 +182,9 @@ class ByteArrayMutator {
     return true;
   }
 
+  // Returns the size alignment, see set_size_alignment().
+  size_t size_alignment() const { return size_alignment_; }
+
   // Set max length in bytes for mutants with modified sizes.
   //
   // Returns true if new max length was accepted. Returns false if specified max
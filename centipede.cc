@@ -53,14 +53,19 @@
 #include <numeric>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "./blob_file.h"
 #include "./coverage.h"
+#include "./coverage_journal.h"
 #include "./defs.h"
 #include "./environment.h"
 #include "./execution_result.h"
@@ -70,6 +75,7 @@
 #include "./rusage_profiler.h"
 #include "./rusage_stats.h"
 #include "./shard_reader.h"
+#include "./tracing.h"
 #include "./util.h"
 
 namespace centipede {
@@ -79,7 +85,9 @@ using perf::RUsageProfiler;
 Centipede::Centipede(const Environment &env, CentipedeCallbacks &user_callbacks,
                      const Coverage::PCTable &pc_table,
                      const SymbolTable &symbols,
-                     CoverageLogger &coverage_logger, Stats &stats)
+                     CoverageLogger &coverage_logger, Stats &stats,
+                     ExecutorPool *executor_pool, ShardLeaser *shard_leaser,
+                     TargetScheduler *target_scheduler)
     : env_(env),
       user_callbacks_(user_callbacks),
       rng_(env_.seed),
@@ -95,6 +103,10 @@ Centipede::Centipede(const Environment &env, CentipedeCallbacks &user_callbacks,
                              .append("filter-input")),
       input_filter_cmd_(env_.input_filter, {input_filter_path_}, {/*env*/},
                         "/dev/null", "/dev/null"),
+      executor_pool_(executor_pool),
+      shard_leaser_(shard_leaser),
+      target_scheduler_(target_scheduler),
+      phase_timer_(&stats_.metrics),
       rusage_profiler_(
           /*scope=*/perf::RUsageScope::ThisProcess(),
           /*metrics=*/env.DumpRUsageTelemetryInThisShard()
@@ -104,8 +116,24 @@ Centipede::Centipede(const Environment &env, CentipedeCallbacks &user_callbacks,
           /*location=*/{__FILE__, __LINE__},
           /*description=*/"Engine") {
   CHECK(env_.seed) << "env_.seed must not be zero";
+  if (env_.auto_batch_size_overhead) {
+    batch_size_controller_.emplace(
+        env_.batch_size, /*min_batch_size=*/1,
+        std::max(env_.batch_size, env_.auto_batch_size_max),
+        env_.auto_batch_size_overhead);
+  }
   if (!env_.input_filter.empty() && env_.fork_server)
     input_filter_cmd_.StartForkServer(TemporaryLocalDirPath(), "input_filter");
+  if (!env_.corpus_exchange.empty()) {
+    // Features are only comparable for the same binary.
+    corpus_exchange_ = std::make_unique<CorpusExchangeClient>(
+        env_.corpus_exchange, env_.binary_hash);
+    if (!corpus_exchange_->connected()) {
+      LOG(INFO) << "Failed to connect to the corpus exchange at "
+                << env_.corpus_exchange << "; continuing without it";
+      corpus_exchange_.reset();
+    }
+  }
 }
 
 int Centipede::SaveCorpusToLocalDir(const Environment &env,
@@ -189,6 +217,9 @@ void Centipede::Log(std::string_view log_type, size_t min_log_level) {
   auto [max, avg] = corpus_.MaxAndAvgSize();
   stats_.corpus_size = corpus_.NumActive();
   stats_.num_covered_pcs = fs_.ToCoveragePCs().size();
+  stats_.metrics.Set(Gauge::kCorpusSize, stats_.corpus_size);
+  stats_.metrics.Set(Gauge::kNumFeatures, fs_.size());
+  stats_.metrics.Set(Gauge::kCoveredPcs, stats_.num_covered_pcs);
   static const auto rusage_scope = perf::RUsageScope::ThisProcess();
   LOG(INFO) << env_.experiment_name << "[" << num_runs_ << "]"
             << " " << log_type << ":"
@@ -203,7 +234,11 @@ void Centipede::Log(std::string_view log_type, size_t min_log_level) {
             << " max/avg " << max << " " << avg << " "
             << corpus_.MemoryUsageString() << " exec/s: " << exec_speed
             << " mb: "
-            << (perf::RUsageMemory::Snapshot(rusage_scope).mem_rss >> 20);
+            << (perf::RUsageMemory::Snapshot(rusage_scope).mem_rss >> 20)
+            << (env_.len_control
+                    ? absl::StrCat(" len: ", len_control_max_len_)
+                    : "")
+            << " " << phase_timer_.IntervalString();
 }
 
 void Centipede::LogFeaturesAsSymbols(const FeatureVec &fv) {
@@ -229,8 +264,15 @@ bool Centipede::InputPassesFilter(const ByteArray &input) {
 bool Centipede::ExecuteAndReportCrash(std::string_view binary,
                                       const std::vector<ByteArray> &input_vec,
                                       BatchResult &batch_result) {
-  bool success = user_callbacks_.Execute(binary, input_vec, batch_result);
-  if (!success) ReportCrash(binary, input_vec, batch_result);
+  bool success =
+      executor_pool_ ? executor_pool_->Execute(binary, input_vec, batch_result)
+                     : user_callbacks_.Execute(binary, input_vec, batch_result);
+  if (!success) {
+    stats_.metrics.Increment(Counter::kCrashes);
+    if (batch_result.failure_description() == "timeout-exceeded")
+      stats_.metrics.Increment(Counter::kTimeouts);
+    ReportCrash(binary, input_vec, batch_result);
+  }
   return success;
 }
 
@@ -280,10 +322,78 @@ bool Centipede::RunBatch(const std::vector<ByteArray> &input_vec,
                          BlobFileAppender *features_file,
                          BlobFileAppender *unconditional_features_file) {
   BatchResult batch_result;
-  bool success = ExecuteAndReportCrash(env_.binary, input_vec, batch_result);
+  const auto execution_start_time = absl::Now();
+  bool success = false;
+  {
+    PhaseTimer::Scope phase_scope(phase_timer_, Phase::kExecute);
+    success = ExecuteAndReportCrash(env_.binary, input_vec, batch_result);
+  }
   CHECK_EQ(input_vec.size(), batch_result.results().size());
+  stats_.metrics.Record(Histogram::kBatchLatency,
+                        absl::ToInt64Microseconds(absl::Now() -
+                                                  execution_start_time));
+  stats_.metrics.Increment(Counter::kBatches);
+  stats_.metrics.Increment(Counter::kExecutions, input_vec.size());
+  size_t shmem_bytes = 0;
+  for (size_t i = 0; i < input_vec.size(); ++i) {
+    const auto &result = batch_result.results()[i];
+    phase_timer_.AddRunnerStats(result.stats());
+    if (env_.slow_input_ms != 0 &&
+        result.stats().exec_time_nsec > env_.slow_input_ms * 1000000) {
+      stats_.metrics.Increment(Counter::kSlowInputs);
+      // Log only the first ones, a slow target may have many.
+      constexpr uint64_t kMaxNumSlowInputsToLog = 10;
+      if (stats_.metrics.Get(Counter::kSlowInputs) <= kMaxNumSlowInputsToLog) {
+        LOG(INFO) << env_.experiment_name << "[" << num_runs_ << "]"
+                  << " slow input: " << Hash(input_vec[i]) << " exec time: "
+                  << result.stats().exec_time_nsec / 1000000 << "ms";
+      }
+    }
+    shmem_bytes += input_vec[i].size() +
+                   result.features().size() * sizeof(feature_t) +
+                   result.cmp_args().size();
+  }
+  stats_.metrics.Increment(Counter::kShmemBytes, shmem_bytes);
+  phase_timer_.AddRunnerRUsage(batch_result.runner_rusage());
+  if (batch_result.runner_rusage().known) {
+    stats_.metrics.Set(Gauge::kRunnerPeakRssMb,
+                       batch_result.runner_rusage().max_rss_kb >> 10);
+  }
+  if (TracingEnabled()) {
+    // The runner reports only durations: lay the inputs out one after another
+    // from the start of the batch.
+    int64_t start_usec = absl::ToUnixMicros(execution_start_time);
+    for (const auto &result : batch_result.results()) {
+      const auto &stats = result.stats();
+      for (const auto &[name, duration_usec] :
+           {std::pair{"prep", stats.prep_time_usec},
+            {"exec", stats.exec_time_usec},
+            {"post", stats.post_time_usec}}) {
+        const auto duration = static_cast<int64_t>(duration_usec);
+        AddTraceEvent(name, TraceTrack::kRunner, start_usec, duration);
+        start_usec += duration;
+      }
+    }
+  }
+  if (batch_size_controller_) {
+    const auto wall_time_usec = absl::ToInt64Microseconds(
+        absl::Now() - execution_start_time);
+    uint64_t inputs_time_usec = 0;
+    for (const auto &result : batch_result.results()) {
+      const auto &stats = result.stats();
+      inputs_time_usec +=
+          stats.prep_time_usec + stats.exec_time_usec + stats.post_time_usec;
+    }
+    if (batch_size_controller_->Update(input_vec.size(), wall_time_usec,
+                                       inputs_time_usec, !success)) {
+      LOG(INFO) << env_.experiment_name << "[" << num_runs_ << "]"
+                << " auto-batch-size: "
+                << batch_size_controller_->last_decision();
+    }
+  }
 
   for (const auto &extra_binary : env_.extra_binaries) {
+    PhaseTimer::Scope phase_scope(phase_timer_, Phase::kExecute);
     BatchResult extra_batch_result;
     success =
         ExecuteAndReportCrash(extra_binary, input_vec, extra_batch_result) &&
@@ -296,6 +406,7 @@ bool Centipede::RunBatch(const std::vector<ByteArray> &input_vec,
   }
   CHECK_EQ(batch_result.results().size(), input_vec.size());
   num_runs_ += input_vec.size();
+  PhaseTimer::Scope phase_scope(phase_timer_, Phase::kTriage);
   bool batch_gained_new_coverage = false;
   for (size_t i = 0; i < input_vec.size(); i++) {
     if (EarlyExitRequested()) break;
@@ -317,8 +428,12 @@ bool Centipede::RunBatch(const std::vector<ByteArray> &input_vec,
       batch_gained_new_coverage = true;
       CHECK_GT(fv.size(), 0UL);
       if (function_filter_passed) {
-        const auto &cmp_args = batch_result.results()[i].cmp_args();
-        corpus_.Add(input_vec[i], fv, cmp_args, fs_, coverage_frontier_);
+        const auto &result = batch_result.results()[i];
+        corpus_.Add(input_vec[i], fv, result.cmp_args(), fs_,
+                    coverage_frontier_, result.stats().peak_heap_bytes);
+      }
+      if (corpus_exchange_) {
+        corpus_exchange_outbox_.push_back({input_vec[i], fv});
       }
       if (corpus_file) {
         CHECK_OK(corpus_file->Append(input_vec[i]));
@@ -337,6 +452,8 @@ bool Centipede::RunBatch(const std::vector<ByteArray> &input_vec,
 // TODO(kcc): [impl] don't reread the same corpus twice.
 void Centipede::LoadShard(const Environment &load_env, size_t shard_index,
                           bool rerun) {
+  PhaseTimer::Scope phase_scope(phase_timer_, Phase::kSync);
+  const absl::Time start_time = absl::Now();
   size_t added_to_corpus = 0;
   std::vector<ByteArray> to_rerun;
   auto input_features_callback = [&](const ByteArray &input,
@@ -359,6 +476,39 @@ void Centipede::LoadShard(const Environment &load_env, size_t shard_index,
             load_env.MakeFeaturesPath(shard_index), input_features_callback);
   if (added_to_corpus) Log("load-shard", 1);
   Rerun(to_rerun);
+  stats_.metrics.Increment(Counter::kShardSyncs);
+  stats_.metrics.Record(Histogram::kShardSyncDuration,
+                        absl::ToInt64Microseconds(absl::Now() - start_time));
+}
+
+void Centipede::ExchangeCorpus() {
+  if (!corpus_exchange_) return;
+  PhaseTimer::Scope phase_scope(phase_timer_, Phase::kSync);
+  const absl::Time start_time = absl::Now();
+  std::vector<ExchangedInput> received;
+  size_t num_novel = 0;
+  if (!corpus_exchange_->Publish(corpus_exchange_outbox_, num_novel) ||
+      !corpus_exchange_->Poll(received)) {
+    LOG(INFO) << "Lost connection to the corpus exchange; continuing without it";
+    corpus_exchange_.reset();
+    return;
+  }
+  corpus_exchange_outbox_.clear();
+  size_t added_to_corpus = 0;
+  for (auto &input : received) {
+    // Same as in LoadShard(): the inputs found by others are not written to
+    // this shard's files, they are already stored in the other shards.
+    LogFeaturesAsSymbols(input.features);
+    if (fs_.CountUnseenAndPruneFrequentFeatures(input.features)) {
+      fs_.IncrementFrequencies(input.features);
+      corpus_.Add(input.data, input.features, {}, fs_, coverage_frontier_);
+      added_to_corpus++;
+    }
+  }
+  if (added_to_corpus) Log("exchange", 1);
+  stats_.metrics.Increment(Counter::kShardSyncs);
+  stats_.metrics.Record(Histogram::kShardSyncDuration,
+                        absl::ToInt64Microseconds(absl::Now() - start_time));
 }
 
 void Centipede::Rerun(std::vector<ByteArray> &to_rerun) {
@@ -489,12 +639,14 @@ void Centipede::GenerateRUsageReport(std::string_view annotation,
               << VV(batch_index) << VV(path);
     ReportDumper dumper{path};
     rusage_profiler_.GenerateReport(&dumper);
+    dumper << "\n" << phase_timer_.ReportString();
   }
 }
 
 void Centipede::MaybeGenerateTelemetry(std::string_view annotation,
                                        size_t batch_index) {
   if (env_.DumpTelemetryForThisBatch(batch_index)) {
+    PhaseTimer::Scope phase_scope(phase_timer_, Phase::kTelemetry);
     if (env_.DumpCorpusTelemetryInThisShard()) {
       GenerateCoverageReport(annotation, batch_index);
       GenerateCorpusStats(annotation, batch_index);
@@ -506,6 +658,66 @@ void Centipede::MaybeGenerateTelemetry(std::string_view annotation,
   }
 }
 
+void Centipede::MaybeAppendToCoverageJournal(bool force) {
+  if (env_.coverage_journal_interval == 0) return;
+  const absl::Time now = absl::Now();
+  if (!force && now - last_coverage_journal_time_ <
+                    absl::Seconds(env_.coverage_journal_interval)) {
+    return;
+  }
+  last_coverage_journal_time_ = now;
+  PhaseTimer::Scope phase_scope(phase_timer_, Phase::kTelemetry);
+  const std::string path = env_.MakeCoverageJournalPath();
+  bool write_header = false;
+  if (!coverage_journal_started_) {
+    // The shard may have been fuzzed before, e.g. by the previous holder of
+    // its lease: continue its journal from the last line.
+    CoverageJournalEntry last;
+    ByteArray journal;
+    if (RemoteFile *file = RemoteFileOpen(path, "r")) {
+      RemoteFileRead(file, journal);
+      RemoteFileClose(file);
+    }
+    const auto entries = ParseCoverageJournal(
+        std::string_view(reinterpret_cast<const char *>(journal.data()),
+                         journal.size()));
+    if (!entries.empty()) last = entries.back();
+    write_header = journal.empty();
+    coverage_journal_start_time_ = now - absl::Seconds(last.seconds);
+    coverage_journal_start_num_execs_ = last.num_execs;
+    coverage_journal_start_engine_cpu_time_ =
+        phase_timer_.EngineCpuTime() - absl::Seconds(last.engine_cpu_seconds);
+    coverage_journal_start_runner_cpu_time_ =
+        phase_timer_.RunnerCpuTime() - absl::Seconds(last.runner_cpu_seconds);
+    coverage_journal_started_ = true;
+  }
+  CoverageJournalEntry entry;
+  entry.experiment = env_.experiment_name;
+  entry.seconds = absl::ToDoubleSeconds(now - coverage_journal_start_time_);
+  entry.num_execs = coverage_journal_start_num_execs_ + num_runs_;
+  entry.num_features = fs_.size();
+  entry.counters = fs_.CountFeatures(feature_domains::k8bitCounters);
+  entry.data_flow = fs_.CountFeatures(feature_domains::kDataFlow);
+  entry.cmp = fs_.CountFeatures(feature_domains::kCMP);
+  entry.bounded_path = fs_.CountFeatures(feature_domains::kBoundedPath);
+  entry.pc_pair = fs_.CountFeatures(feature_domains::kPCPair);
+  entry.covered_pcs = fs_.ToCoveragePCs().size();
+  entry.corpus_size = corpus_.NumActive();
+  entry.engine_cpu_seconds = absl::ToDoubleSeconds(
+      phase_timer_.EngineCpuTime() - coverage_journal_start_engine_cpu_time_);
+  entry.runner_cpu_seconds = absl::ToDoubleSeconds(
+      phase_timer_.RunnerCpuTime() - coverage_journal_start_runner_cpu_time_);
+  std::string contents = CoverageJournalLine(entry);
+  if (write_header) contents = CoverageJournalHeader() + contents;
+  RemoteFile *file = RemoteFileOpen(path, "a");
+  if (file == nullptr) {
+    LOG(INFO) << "Failed to open " << path;
+    return;
+  }
+  RemoteFileAppend(file, ByteArray(contents.begin(), contents.end()));
+  RemoteFileClose(file);
+}
+
 void Centipede::MergeFromOtherCorpus(std::string_view merge_from_dir,
                                      size_t shard_index_to_merge) {
   LOG(INFO) << __func__ << ": " << merge_from_dir;
@@ -526,7 +738,51 @@ void Centipede::MergeFromOtherCorpus(std::string_view merge_from_dir,
   }
 }
 
+void Centipede::ApplyLengthControlMaxLen() {
+  if (!user_callbacks_.SetMaxLen(len_control_max_len_)) {
+    LOG(WARNING) << "Failed to set the max mutant length, keeping the old one: "
+                 << VV(len_control_max_len_);
+  }
+}
+
+void Centipede::InitLengthControl() {
+  // Both with and without length control, mutants are capped by --max_len,
+  // so that --experiment=len_control=0,N compares only the ramp.
+  len_control_max_len_ = env_.max_len;
+  num_batches_without_new_features_ = 0;
+  if (env_.len_control) {
+    // Start from a small cap, but don't go below the size of the largest
+    // input already in the corpus: otherwise all of its mutants would be
+    // truncated.
+    constexpr size_t kInitialMaxLen = 4;
+    len_control_max_len_ = std::min(
+        env_.max_len, std::max(kInitialMaxLen, corpus_.MaxAndAvgSize().first));
+  }
+  ApplyLengthControlMaxLen();
+}
+
+void Centipede::UpdateLengthControl(bool batch_gained_new_coverage) {
+  if (!env_.len_control) return;
+  if (batch_gained_new_coverage) {
+    num_batches_without_new_features_ = 0;
+    return;
+  }
+  if (++num_batches_without_new_features_ < env_.len_control) return;
+  num_batches_without_new_features_ = 0;
+  if (len_control_max_len_ >= env_.max_len) return;
+  // Double the cap: each step takes env_.len_control batches, so a linear
+  // ramp would take too long to reach a typical --max_len.
+  len_control_max_len_ = std::min(env_.max_len, len_control_max_len_ * 2);
+  ApplyLengthControlMaxLen();
+  Log("len-control", 1);
+}
+
 void Centipede::FuzzingLoop() {
+  // The time to crash counts the loading of the corpus too: the crash may be
+  // in it.
+  fuzzing_start_time_ = absl::Now();
+  num_runs_ = 0;
+
   LOG(INFO) << "Shard: " << env_.my_shard_index << "/" << env_.total_shards
             << " " << TemporaryLocalDirPath() << " "
             << "seed: " << env_.seed << "\n\n\n";
@@ -573,7 +829,9 @@ void Centipede::FuzzingLoop() {
   Log("init-done", 0);
   // Clear timer_ and num_runs_, so that the pre-init work doesn't affect them.
   timer_ = Timer();
+  num_runs_before_init_done_ = num_runs_;
   num_runs_ = 0;
+  MaybeAppendToCoverageJournal(/*force=*/true);
 
   if (env_.DistillingInThisShard()) {
     auto distill_to_path = env_.MakeDistilledPath();
@@ -597,32 +855,83 @@ void Centipede::FuzzingLoop() {
   // shards, for example).
   MaybeGenerateTelemetry("initial", /*batch_index=*/0);
 
-  // num_runs / batch_size, rounded up.
-  size_t number_of_batches = env_.num_runs / env_.batch_size;
-  if (env_.num_runs % env_.batch_size != 0) ++number_of_batches;
-  size_t new_runs = 0;
+  InitLengthControl();
+
+  // The number of mutants requested from Mutate() so far
+  // (custom mutators may produce fewer).
+  size_t scheduled_runs = 0;
   size_t corpus_size_at_last_prune = corpus_.NumActive();
-  for (size_t batch_index = 0; batch_index < number_of_batches; batch_index++) {
+  // Shard lease state, see --shard_lease_seconds.
+  absl::Time last_coverage_gain_time = absl::Now();
+  absl::Time last_lease_renewal_time = absl::InfinitePast();
+  size_t batch_index = 0;
+  for (; scheduled_runs < env_.num_runs; batch_index++) {
     if (EarlyExitRequested()) break;
-    CHECK_LT(new_runs, env_.num_runs);
-    auto remaining_runs = env_.num_runs - new_runs;
-    auto batch_size = std::min(env_.batch_size, remaining_runs);
+    auto remaining_runs = env_.num_runs - scheduled_runs;
+    size_t batch_size = env_.batch_size;
+    size_t mutate_batch_size = env_.mutate_batch_size;
+    if (batch_size_controller_) {
+      batch_size = batch_size_controller_->batch_size();
+      // Keep the ratio of mutants to inputs.
+      mutate_batch_size = std::max(
+          size_t{1}, env_.mutate_batch_size * batch_size / env_.batch_size);
+    }
+    batch_size = std::min(batch_size, remaining_runs);
+    scheduled_runs += batch_size;
     std::vector<ByteArray> inputs, mutants;
-    inputs.resize(env_.mutate_batch_size);
-    for (size_t i = 0; i < env_.mutate_batch_size; i++) {
-      const auto &corpus_record = env_.use_corpus_weights
-                                      ? corpus_.WeightedRandom(rng_())
-                                      : corpus_.UniformRandom(rng_());
-      inputs[i] = corpus_record.data;
+    inputs.resize(mutate_batch_size);
+    // Indices of the corpus elements in `inputs`, used by the energy schedule.
+    std::vector<size_t> input_indices(mutate_batch_size);
+    for (size_t i = 0; i < mutate_batch_size; i++) {
+      const size_t corpus_index = env_.use_corpus_weights
+                                      ? corpus_.WeightedRandomIndex(rng_())
+                                      : corpus_.UniformRandomIndex(rng_());
+      input_indices[i] = corpus_index;
+      inputs[i] = corpus_.Get(corpus_index);
       // Use the cmp_args of the first input.
       // See the related TODO around SetCmpDictionary.
-      if (i == 0) user_callbacks_.SetCmpDictionary(corpus_record.cmp_args);
+      if (i == 0)
+        user_callbacks_.SetCmpDictionary(corpus_.GetCmpArgs(corpus_index));
     }
 
-    user_callbacks_.Mutate(inputs, batch_size, mutants);
+    // With --targets, mutating and executing the batch requires a slot.
+    if (target_scheduler_ != nullptr)
+      target_scheduler_->AcquireSlot(env_.target_index);
+    const absl::Time slot_start_time = absl::Now();
+    const absl::Duration slot_start_engine_cpu_time =
+        phase_timer_.EngineCpuTime();
+    const absl::Duration slot_start_runner_cpu_time =
+        phase_timer_.RunnerCpuTime();
+    {
+      PhaseTimer::Scope phase_scope(phase_timer_, Phase::kMutate);
+      user_callbacks_.Mutate(inputs, batch_size, mutants);
+    }
+    const size_t num_features_before_batch = fs_.size();
     bool gained_new_coverage =
         RunBatch(mutants, corpus_file.get(), features_file.get(), nullptr);
-    new_runs += mutants.size();
+    if (target_scheduler_ != nullptr) {
+      const absl::Duration slot_time = absl::Now() - slot_start_time;
+      const absl::Duration runner_cpu_time =
+          phase_timer_.RunnerCpuTime() - slot_start_runner_cpu_time;
+      // The CPU time of the runner is unknown if the executor does not report
+      // it: then only the slot time is comparable across the targets.
+      const absl::Duration cpu_time =
+          runner_cpu_time > absl::ZeroDuration()
+              ? phase_timer_.EngineCpuTime() - slot_start_engine_cpu_time +
+                    runner_cpu_time
+              : slot_time;
+      target_scheduler_->ReleaseSlot(env_.target_index, slot_time, cpu_time,
+                                     fs_.size() - num_features_before_batch);
+    }
+    if (env_.use_energy_schedule) {
+      // Mutants can not be attributed to individual inputs (Mutate() takes
+      // all of them at once), so every input gets an equal share.
+      // RunBatch() only appends to the corpus, so `input_indices` are valid.
+      corpus_.UpdateEnergy(input_indices,
+                           mutants.size() / input_indices.size(),
+                           fs_.size() - num_features_before_batch);
+    }
+    UpdateLengthControl(gained_new_coverage);
 
     if (gained_new_coverage) {
       Log("new-feature", 1);
@@ -630,8 +939,33 @@ void Centipede::FuzzingLoop() {
       Log("pulse", 1);  // log if batch_index is a power of two.
     }
 
+    if (shard_leaser_ != nullptr) {
+      const absl::Time now = absl::Now();
+      if (gained_new_coverage) last_coverage_gain_time = now;
+      if (now - last_coverage_gain_time >=
+          absl::Seconds(env_.shard_stall_seconds)) {
+        LOG(INFO) << "Shard " << env_.my_shard_index << " stalled: no new "
+                  << "coverage in " << env_.shard_stall_seconds << " seconds";
+        shard_stalled_ = true;
+        break;
+      }
+      // Renew several times per lease period, so that a slow batch does not
+      // let the lease expire.
+      if (now - last_lease_renewal_time >=
+          absl::Seconds(env_.shard_lease_seconds) / 4) {
+        if (!shard_leaser_->Renew(env_.my_shard_index)) {
+          LOG(INFO) << "Lost the lease of shard " << env_.my_shard_index;
+          break;
+        }
+        last_lease_renewal_time = now;
+      }
+    }
+
+    ExchangeCorpus();
+
     // Dump the intermediate telemetry files.
     MaybeGenerateTelemetry("latest", batch_index);
+    MaybeAppendToCoverageJournal(/*force=*/false);
 
     if (env_.load_other_shard_frequency != 0 &&
         (batch_index % env_.load_other_shard_frequency) == 0 &&
@@ -647,16 +981,27 @@ void Centipede::FuzzingLoop() {
     if (env_.prune_frequency &&
         corpus_.NumActive() >
             corpus_size_at_last_prune + env_.prune_frequency) {
+      PhaseTimer::Scope phase_scope(phase_timer_, Phase::kPrune);
+      const absl::Time prune_start_time = absl::Now();
       if (env_.use_coverage_frontier) coverage_frontier_.Compute(corpus_);
       corpus_.Prune(fs_, coverage_frontier_, env_.max_corpus_size, rng_);
+      stats_.metrics.Increment(Counter::kPrunes);
+      stats_.metrics.Record(
+          Histogram::kPruneDuration,
+          absl::ToInt64Microseconds(absl::Now() - prune_start_time));
       corpus_size_at_last_prune = corpus_.NumActive();
     }
   }
 
   // Dump the final telemetry files, possibly overwriting the last intermediate
   // version dumped inside the loop.
-  MaybeGenerateTelemetry("latest", number_of_batches);
+  MaybeGenerateTelemetry("latest", batch_index);
+  MaybeAppendToCoverageJournal(/*force=*/true);
 
+  if (env_.log_level > 0) {
+    LOG(INFO) << env_.experiment_name << "[" << num_runs_ << "] "
+              << phase_timer_.ReportString();
+  }
   Log("end-fuzz", 0);  // Tests rely on this line being present at the end.
 }
 
@@ -664,6 +1009,7 @@ void Centipede::ReportCrash(std::string_view binary,
                             const std::vector<ByteArray> &input_vec,
                             const BatchResult &batch_result) {
   if (num_crash_reports_ >= env_.max_num_crash_reports) return;
+  TraceSpan trace_span("crash_repro");
 
   LOG(INFO) << "Batch execution failed; exit code: "
             << batch_result.exit_code();
@@ -676,6 +1022,16 @@ void Centipede::ReportCrash(std::string_view binary,
 
   LOG(INFO) << log_prefix << "The crash occurred when running " << binary
             << " on " << input_vec.size() << " inputs";
+  // The executions and the time since the start of FuzzingLoop() until the
+  // crash, counting the inputs of this batch up to the first one that did not
+  // report its outputs. puzzles/scoreboard.sh relies on this line.
+  LOG(INFO) << log_prefix << "Time to crash: execs: "
+            << num_runs_before_init_done_ + num_runs_ +
+                   std::min(batch_result.num_outputs_read() + 1,
+                            input_vec.size())
+            << " seconds: "
+            << absl::StrFormat("%.3f", absl::ToDoubleSeconds(
+                                           absl::Now() - fuzzing_start_time_));
   num_crash_reports_++;
   if (num_crash_reports_ == env_.max_num_crash_reports) {
     LOG(INFO)
@@ -18,34 +18,60 @@
 #include <time.h>
 
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "absl/time/time.h"
+#include "./batch_size_controller.h"
 #include "./blob_file.h"
 #include "./centipede_callbacks.h"
 #include "./command.h"
 #include "./corpus.h"
+#include "./corpus_exchange.h"
 #include "./coverage.h"
 #include "./defs.h"
 #include "./environment.h"
 #include "./execution_result.h"
+#include "./executor_pool.h"
+#include "./phase_timer.h"
 #include "./remote_file.h"
 #include "./rusage_profiler.h"
+#include "./shard_lease.h"
 #include "./stats.h"
 #include "./symbol_table.h"
+#include "./target_scheduler.h"
 
 namespace centipede {
 
 // The main fuzzing class.
 class Centipede {
  public:
+  // If `executor_pool` is not null, the inputs are executed on it,
+  // otherwise they are executed via `user_callbacks`. In either case,
+  // the crash reproducers are searched for via `user_callbacks`.
+  // If `shard_leaser` is not null, env.my_shard_index must be leased by it;
+  // FuzzingLoop() then renews the lease and stops early if the lease is lost
+  // or the coverage growth has stalled, see --shard_lease_seconds.
+  // If `target_scheduler` is not null, every batch waits for a slot of
+  // env.target_index, see --targets.
   Centipede(const Environment &env, CentipedeCallbacks &user_callbacks,
             const Coverage::PCTable &pc_table, const SymbolTable &symbols,
-            CoverageLogger &coverage_logger, Stats &stats);
+            CoverageLogger &coverage_logger, Stats &stats,
+            ExecutorPool *executor_pool = nullptr,
+            ShardLeaser *shard_leaser = nullptr,
+            TargetScheduler *target_scheduler = nullptr);
   virtual ~Centipede() {}
   // Main loop.
   void FuzzingLoop();
+  // The number of inputs executed by FuzzingLoop().
+  size_t num_runs() const { return num_runs_; }
+  // Returns true if FuzzingLoop() stopped because the coverage growth of the
+  // leased shard has stalled.
+  bool shard_stalled() const { return shard_stalled_; }
   // Saves the sharded corpus into `dir`, one file per input.
   // Returns 0.
   static int SaveCorpusToLocalDir(const Environment &env, std::string_view dir);
@@ -86,6 +112,10 @@ class Centipede {
   // If `rerun` is true, then also re-runs any inputs
   // for which the features are not found in `load_env.workdir`.
   void LoadShard(const Environment &load_env, size_t shard_index, bool rerun);
+  // Sends the inputs recently added to the corpus to the corpus exchange
+  // coordinator, receives the inputs found by others, adds the interesting
+  // ones to the corpus. See --corpus_exchange.
+  void ExchangeCorpus();
   // Runs all inputs from `to_rerun`, adds their features to the features file
   // of env_.my_shard_index, adds interesting inputs to the corpus.
   void Rerun(std::vector<ByteArray> &to_rerun);
@@ -112,6 +142,10 @@ class Centipede {
   // assigned to do that and if `batch_index` == 0 or satisfies the criteria set
   // via the flags.
   void MaybeGenerateTelemetry(std::string_view annotation, size_t batch_index);
+  // Appends a line to the coverage journal if env_.coverage_journal_interval
+  // seconds have passed since the previous line, or if `force`. Continues the
+  // journal left by a previous run of the shard. No-op if the interval is 0.
+  void MaybeAppendToCoverageJournal(bool force);
 
   // Returns true if `input` passes env_.input_filter.
   bool InputPassesFilter(const ByteArray &input);
@@ -137,6 +171,18 @@ class Centipede {
   void MergeFromOtherCorpus(std::string_view merge_from_dir,
                             size_t shard_index_to_merge);
 
+  // Length control, see --len_control.
+  // Sets the initial cap on the mutant length, based on the current corpus.
+  // Without length control, the cap is --max_len.
+  void InitLengthControl();
+  // Raises the cap on the mutant length if enough batches have been executed
+  // without new features. `batch_gained_new_coverage` is the result of the
+  // most recent RunBatch().
+  void UpdateLengthControl(bool batch_gained_new_coverage);
+  // Passes `len_control_max_len_` to the callbacks. Logs a warning if they
+  // don't accept it.
+  void ApplyLengthControlMaxLen();
+
   // Collects all PCs from `fv`, then adds PC-pair features to `fv`.
   // Returns the number of added features.
   // See more comments in centipede.cc.
@@ -144,10 +190,25 @@ class Centipede {
 
   FeatureSet fs_;
   Timer timer_;  // counts time for coverage collection rate computation
+  // The start of FuzzingLoop() and the number of inputs executed from then
+  // until num_runs_ is reset at "init-done", for the time to crash, see
+  // ReportCrash().
+  absl::Time fuzzing_start_time_ = absl::InfinitePast();
+  size_t num_runs_before_init_done_ = 0;
   Corpus corpus_;
   CoverageFrontier coverage_frontier_;
   size_t num_runs_ = 0;  // counts executed inputs
 
+  // Length control state, see --len_control.
+  // The current cap on the mutant length, <= env_.max_len.
+  size_t len_control_max_len_ = 0;
+  // The number of consecutive batches that didn't gain new features.
+  size_t num_batches_without_new_features_ = 0;
+
+  // Chooses the batch size, see --auto_batch_size_overhead.
+  // Set iff that flag is non-zero.
+  std::optional<BatchSizeController> batch_size_controller_;
+
   // Coverage-related data, initialized at startup, once per process,
   // by calling the PopulateSymbolAndPcTables callback.
   const Coverage::PCTable &pc_table_;
@@ -174,6 +235,35 @@ class Centipede {
   std::string input_filter_path_;
   Command input_filter_cmd_;
 
+  // Connection to the corpus exchange coordinator, see --corpus_exchange.
+  // Null if not used or if the connection has failed.
+  std::unique_ptr<CorpusExchangeClient> corpus_exchange_;
+  // The inputs to be sent by the next ExchangeCorpus().
+  std::vector<ExchangedInput> corpus_exchange_outbox_;
+
+  // Shared by all threads, may be null. See --num_executors.
+  ExecutorPool *executor_pool_;
+
+  // Leases env_.my_shard_index, may be null. See --shard_lease_seconds.
+  ShardLeaser *shard_leaser_;
+  bool shard_stalled_ = false;
+
+  // Shared by all targets, may be null. See --targets.
+  TargetScheduler *target_scheduler_;
+
+  // Time spent in every phase of the fuzzing loop, see Log().
+  PhaseTimer phase_timer_;
+
+  // Coverage journal state, see --coverage_journal_interval.
+  absl::Time coverage_journal_start_time_;
+  absl::Time last_coverage_journal_time_ = absl::InfinitePast();
+  // The executions and the CPU time of the engine thread and of the runners
+  // at the start of the journal. A continued journal starts before this run.
+  uint64_t coverage_journal_start_num_execs_ = 0;
+  absl::Duration coverage_journal_start_engine_cpu_time_;
+  absl::Duration coverage_journal_start_runner_cpu_time_;
+  bool coverage_journal_started_ = false;
+
   // Resource usage stats collection & reporting.
   perf::RUsageProfiler rusage_profiler_;
 };
@@ -15,6 +15,7 @@
 #include "./centipede_callbacks.h"
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <filesystem>
 #include <string>
@@ -23,6 +24,7 @@
 
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_split.h"
+#include "absl/time/time.h"
 #include "./command.h"
 #include "./coverage.h"
 #include "./defs.h"
@@ -69,9 +71,11 @@ std::string CentipedeCallbacks::ConstructRunnerFlags(
   if (!disable_coverage)
     path_level = absl::StrCat(":path_level=", env_.path_level, ":");
   return absl::StrCat(
-      "CENTIPEDE_RUNNER_FLAGS=", ":timeout_in_seconds=", env_.timeout, ":",
+      "CENTIPEDE_RUNNER_FLAGS=", ":timeout_ms=", env_.TimeoutMs(), ":",
       ":address_space_limit_mb=", env_.address_space_limit_mb, ":",
       ":rss_limit_mb=", env_.rss_limit_mb, ":",
+      ":malloc_limit_mb=", env_.malloc_limit_mb, ":",
+      env_.perf_counters ? ":perf_counters:" : "",
       env_.use_pc_features && !disable_coverage ? ":use_pc_features:" : "",
       env_.use_counter_features && !disable_coverage ? ":use_counter_features:"
                                                      : "",
@@ -82,7 +86,13 @@ std::string CentipedeCallbacks::ConstructRunnerFlags(
       env_.use_dataflow_features && !disable_coverage
           ? ":use_dataflow_features:"
           : "",
-      ":crossover_level=", env_.crossover_level, ":", extra_flags);
+      env_.snapshot_reset ? ":snapshot_reset:" : "", ":crossover_level=",
+      env_.crossover_level, ":", extra_flags);
+}
+
+absl::Duration CentipedeCallbacks::BatchTimeout(size_t num_inputs) const {
+  if (env_.TimeoutMs() == 0) return absl::InfiniteDuration();
+  return absl::Milliseconds(env_.TimeoutMs()) * num_inputs + absl::Seconds(5);
 }
 
 Command &CentipedeCallbacks::GetOrCreateCommandForBinary(
@@ -105,8 +115,9 @@ Command &CentipedeCallbacks::GetOrCreateCommandForBinary(
     env.emplace_back(absl::StrCat(
         "LLVM_PROFILE_FILE=", env_.MakeSourceBasedCoverageRawProfilePath()));
 
-  // Allow for the time it takes to fork a subprocess etc.
-  const auto amortized_timeout = absl::Seconds(env_.timeout) + absl::Seconds(5);
+  // The default timeout, e.g. for mutation requests, allows for one input.
+  // Batches of inputs are executed with BatchTimeout() of their size.
+  const auto amortized_timeout = BatchTimeout(/*num_inputs=*/1);
   Command &cmd = commands_.emplace_back(Command(
       /*path=*/binary, /*args=*/{shmem_name1_, shmem_name2_},
       /*env=*/env,
@@ -114,7 +125,10 @@ Command &CentipedeCallbacks::GetOrCreateCommandForBinary(
       /*err=*/execute_log_path_,
       /*timeout=*/amortized_timeout,
       /*temp_file_path=*/temp_input_file_path_));
-  if (env_.fork_server) cmd.StartForkServer(temp_dir_, Hash(binary));
+  if (env_.fork_server) {
+    cmd.StartForkServer(temp_dir_, Hash(binary),
+                        /*output_capacity=*/env_.max_runner_output_kb * 1024);
+  }
 
   return cmd;
 }
@@ -148,11 +162,21 @@ int CentipedeCallbacks::ExecuteCentipedeSancovBinaryWithShmem(
 
   // Run.
   Command &cmd = GetOrCreateCommandForBinary(binary);
-  int retval = cmd.Execute();
+  int retval = cmd.Execute(BatchTimeout(num_inputs_written));
   inputs_blobseq_.ReleaseSharedMemory();  // Inputs are already consumed.
 
   // Get results.
   batch_result.exit_code() = retval;
+  if (const auto &rusage = cmd.last_child_rusage()) {
+    batch_result.runner_rusage() = {
+        .known = true,
+        .user_time_usec = static_cast<uint64_t>(
+            absl::ToInt64Microseconds(rusage->user_time)),
+        .sys_time_usec = static_cast<uint64_t>(
+            absl::ToInt64Microseconds(rusage->sys_time)),
+        .max_rss_kb = static_cast<uint64_t>(rusage->max_rss_kb),
+    };
+  }
   CHECK(batch_result.Read(outputs_blobseq_));
   outputs_blobseq_.ReleaseSharedMemory();  // Outputs are already consumed.
 
@@ -170,7 +194,11 @@ int CentipedeCallbacks::ExecuteCentipedeSancovBinaryWithShmem(
               << env_.shmem_size_mb;
   }
   if (retval != EXIT_SUCCESS) {
-    ReadFromLocalFile(execute_log_path_, batch_result.log());
+    if (cmd.captures_output()) {
+      batch_result.log() = cmd.captured_output();
+    } else {
+      ReadFromLocalFile(execute_log_path_, batch_result.log());
+    }
     ReadFromLocalFile(failure_description_path_,
                       batch_result.failure_description());
     // Remove failure_description_ here so that it doesn't stay until another
@@ -15,12 +15,14 @@
 #ifndef THIRD_PARTY_CENTIPEDE_CENTIPEDE_CALLBACKS_H_
 #define THIRD_PARTY_CENTIPEDE_CENTIPEDE_CALLBACKS_H_
 
+#include <algorithm>
 #include <cstddef>
 #include <filesystem>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "absl/time/time.h"
 #include "./byte_array_mutator.h"
 #include "./command.h"
 #include "./coverage.h"
@@ -83,6 +85,18 @@ class CentipedeCallbacks {
     return byte_array_mutator_.SetCmpDictionary(cmp_data);
   }
 
+  // Sets the max length of mutants produced by the internal ByteArrayMutator,
+  // rounded down to its size alignment, so that the mutants never exceed
+  // `max_len`; but to at least one alignment unit.
+  // Used by the engine to implement length control (see --len_control).
+  // Returns false if `max_len` was not accepted, see
+  // ByteArrayMutator::set_max_len().
+  bool SetMaxLen(size_t max_len) {
+    const size_t alignment = byte_array_mutator_.size_alignment();
+    max_len = std::max(max_len / alignment * alignment, alignment);
+    return byte_array_mutator_.set_max_len(max_len);
+  }
+
  protected:
   // Helpers that the user-defined class may use if needed.
 
@@ -124,6 +138,9 @@ class CentipedeCallbacks {
   // Returns a Command object with matching `binary` from commands_,
   // creates one if needed.
   Command &GetOrCreateCommandForBinary(std::string_view binary);
+  // Returns the time a batch of `num_inputs` inputs may take: the per-input
+  // timeout for every input, plus the time it takes to fork a subprocess etc.
+  absl::Duration BatchTimeout(size_t num_inputs) const;
 
   // Variables required for ExecuteCentipedeSancovBinaryWithShmem.
   // They are computed in CTOR, to avoid extra computation in the hot loop.
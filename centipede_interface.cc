@@ -14,48 +14,76 @@
 
 #include "./centipede_interface.h"
 
+#include <limits.h>
 #include <signal.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <deque>
 #include <filesystem>
+#include <iostream>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <system_error>
 #include <thread>  // NOLINT(build/c++11)
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/str_replace.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "./analyze_corpora.h"
 #include "./blob_file.h"
 #include "./centipede.h"
 #include "./command.h"
+#include "./corpus_exchange.h"
+#include "./cpu_affinity.h"
 #include "./coverage.h"
+#include "./coverage_journal.h"
 #include "./defs.h"
 #include "./environment.h"
+#include "./executor_pool.h"
 #include "./logging.h"
+#include "./metrics.h"
 #include "./remote_file.h"
+#include "./shard_lease.h"
 #include "./shard_reader.h"
 #include "./stats.h"
 #include "./symbol_table.h"
+#include "./target_scheduler.h"
+#include "./tracing.h"
 #include "./util.h"
 
 namespace centipede {
 
 namespace {
 
-// Sets signal handler for SIGINT.
-void SetSignalHandlers() {
+// Set by SIGUSR1, see --trace_path.
+std::atomic<bool> trace_dump_requested = false;
+
+// Sets signal handler for SIGINT and, with --trace_path, SIGUSR1.
+void SetSignalHandlers(const Environment &env) {
   struct sigaction sigact = {};
   sigact.sa_handler = [](int) {
     ABSL_RAW_LOG(INFO, "SIGINT caught; cleaning up\n");
     RequestEarlyExit(EXIT_FAILURE);
   };
   sigaction(SIGINT, &sigact, nullptr);
+  if (!env.trace_path.empty()) {
+    struct sigaction trace_sigact = {};
+    trace_sigact.sa_handler = [](int) { trace_dump_requested = true; };
+    sigaction(SIGUSR1, &trace_sigact, nullptr);
+  }
 }
 
 // Runs env.for_each_blob on every blob extracted from env.args.
@@ -114,50 +142,282 @@ void PrintExperimentStatsThread(const std::atomic<bool> &continue_running,
   }
 }
 
-// Loads corpora from work dirs provided in `env.args`, analyzes differences.
+// Exports the metrics of the threads in `stats_vec` to the files of `env`
+// every env.metrics_export_interval seconds, and once more when
+// `continue_running` becomes false. No-op if env.metrics_export_interval is 0.
+void ExportMetricsThread(const std::atomic<bool> &continue_running,
+                         absl::Span<const Stats> stats_vec,
+                         const Environment &env) {
+  if (env.metrics_export_interval == 0) return;
+  std::vector<const ThreadMetrics *> metrics;
+  for (const auto &stats : stats_vec) metrics.push_back(&stats.metrics);
+  while (true) {
+    // Sleep(1) in a loop so that we check continue_running once a second.
+    for (size_t i = 0; i < env.metrics_export_interval && continue_running;
+         ++i) {
+      sleep(1);
+    }
+    ExportMetrics(metrics, env.MakePrometheusMetricsPath(),
+                  env.MakeJsonLinesMetricsPath());
+    if (!continue_running) break;
+  }
+}
+
+// Writes the trace to env.trace_path when requested by SIGUSR1, and once more
+// when `continue_running` becomes false. No-op if env.trace_path is empty.
+void WriteTraceThread(const std::atomic<bool> &continue_running,
+                      const Environment &env) {
+  if (env.trace_path.empty()) return;
+  while (continue_running) {
+    sleep(1);
+    if (trace_dump_requested.exchange(false)) WriteTrace(env.trace_path);
+  }
+  WriteTrace(env.trace_path);
+}
+
+// Loads the coverage of the corpora from the work dirs provided in
+// `env.args`, using `env.num_threads` threads to read the shards, and prints
+// the differences between the corpora as JSON to stdout, see
+// CorporaAnalysisToJson(). Also logs the symbolized PCs that only the last
+// corpus covers.
 // Returns EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
 int Analyze(const Environment &env, const Coverage::PCTable &pc_table,
             const SymbolTable &symbols) {
   LOG(INFO) << "Analyze " << absl::StrJoin(env.args, ",");
-  CHECK_EQ(env.args.size(), 2) << "for now, Analyze supports only 2 work dirs";
+  CHECK_GE(env.args.size(), 2) << "Analyze needs at least 2 work dirs";
   CHECK(!env.binary.empty()) << "--binary must be used";
-  std::vector<std::vector<CorpusRecord>> corpora;
-  for (const auto &workdir : env.args) {
-    LOG(INFO) << "Reading " << workdir;
+  const size_t num_corpora = env.args.size();
+  std::vector<CorpusCoverage> corpora(num_corpora);
+  for (size_t i = 0; i < num_corpora; ++i) {
+    corpora[i].name = env.args[i];
+    corpora[i].pcs = PcBitmap(pc_table.size());
+  }
+
+  // Every (workdir, shard) pair is one task. Every thread accumulates the
+  // coverage of its tasks, which is merged into `corpora` in the end.
+  const size_t num_tasks = num_corpora * env.total_shards;
+  const size_t num_threads = std::max<size_t>(
+      1, std::min<size_t>(env.num_threads, num_tasks));
+  std::atomic<size_t> next_task = 0;
+  absl::Mutex corpora_mu;
+  auto load_shards = [&]() {
+    std::vector<CorpusCoverage> partial(num_corpora);
     Environment workdir_env = env;
-    workdir_env.workdir = workdir;
-    corpora.emplace_back();
-    auto &corpus = corpora.back();
-    for (size_t shard_index = 0; shard_index < env.total_shards;
-         ++shard_index) {
-      auto corpus_path = workdir_env.MakeCorpusPath(shard_index);
-      auto features_path = workdir_env.MakeFeaturesPath(shard_index);
+    for (size_t task; (task = next_task++) < num_tasks;) {
+      const size_t corpus_index = task / env.total_shards;
+      const size_t shard_index = task % env.total_shards;
+      workdir_env.workdir = env.args[corpus_index];
+      const auto corpus_path = workdir_env.MakeCorpusPath(shard_index);
+      const auto features_path = workdir_env.MakeFeaturesPath(shard_index);
       LOG(INFO) << "Loading corpus shard: " << corpus_path << " "
                 << features_path;
       ReadShard(corpus_path, features_path,
-                [&corpus](const ByteArray &input, FeatureVec &features) {
-                  corpus.push_back({input, features});
+                [&](const ByteArray & /*input*/, FeatureVec &features) {
+                  partial[corpus_index].AddInput(features);
                 });
     }
-    CHECK(!corpus.empty()) << "the corpus is empty, nothing to analyze";
-    LOG(INFO) << "corpus size " << corpus.size();
+    absl::MutexLock lock(&corpora_mu);
+    for (size_t i = 0; i < num_corpora; ++i) corpora[i].Merge(partial[i]);
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; ++i) threads.emplace_back(load_shards);
+  for (auto &thread : threads) thread.join();
+
+  for (const auto &corpus : corpora) {
+    CHECK_NE(corpus.num_inputs, 0)
+        << corpus.name << ": the corpus is empty, nothing to analyze";
+    LOG(INFO) << corpus.name << ": corpus size " << corpus.num_inputs;
   }
-  CHECK_EQ(corpora.size(), 2);
-  AnalyzeCorpora(pc_table, symbols, corpora[0], corpora[1]);
+  std::cout << CorporaAnalysisToJson(AnalyzeCorpora(corpora, pc_table.size()));
+  LogUniquePcs(pc_table, symbols, corpora, num_corpora - 1);
   return EXIT_SUCCESS;
 }
 
+// Reads the coverage journals in the workdirs provided in `env.args` (or in
+// `env.workdir` if there are none), prints the summary of every arm.
+// Returns EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+int PrintCoverageJournalSummary(const Environment &env) {
+  const std::vector<std::string> workdirs =
+      env.args.empty() ? std::vector<std::string>{env.workdir} : env.args;
+  std::vector<std::vector<CoverageJournalEntry>> journals;
+  // Outside of experiments, every workdir is an arm.
+  std::vector<std::string> default_arms;
+  for (const auto &workdir : workdirs) {
+    std::error_code error;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(workdir, error)) {
+      if (!entry.is_regular_file() ||
+          !absl::StartsWith(entry.path().filename().string(),
+                            "coverage-journal-")) {
+        continue;
+      }
+      LOG(INFO) << "Reading " << entry.path();
+      std::string contents;
+      ReadFromLocalFile(entry.path().string(), contents);
+      journals.push_back(ParseCoverageJournal(contents));
+      default_arms.push_back(workdir);
+    }
+    if (error) {
+      LOG(ERROR) << "Failed to access workdir '" << workdir
+                 << "': " << error.message();
+      return EXIT_FAILURE;
+    }
+  }
+  const auto summaries = SummarizeCoverageJournals(journals, default_arms);
+  if (summaries.empty()) {
+    LOG(ERROR) << "No coverage journals found, see --coverage_journal_interval";
+    return EXIT_FAILURE;
+  }
+  std::cout << CoverageCurveSummariesToString(summaries);
+  return EXIT_SUCCESS;
+}
+
+// Runs the fuzzing loop of one thread with --shard_lease_seconds: leases a
+// shard, fuzzes it until it stalls or the lease is lost, releases it, leases
+// another one, and so on, until `env.num_runs` inputs are executed.
+void FuzzLeasedShards(Environment &env, CentipedeCallbacks &user_callbacks,
+                      const Coverage::PCTable &pc_table,
+                      const SymbolTable &symbols,
+                      CoverageLogger &coverage_logger, Stats &stats,
+                      ExecutorPool *executor_pool, size_t thread_idx) {
+  char hostname[HOST_NAME_MAX + 1] = {};
+  gethostname(hostname, sizeof(hostname) - 1);
+  ShardLeaser leaser(env.MakeShardLeaseDirPath(), env.total_shards,
+                     absl::StrCat(hostname, ":", getpid(), ":", thread_idx),
+                     absl::Seconds(env.shard_lease_seconds));
+  size_t num_runs_left = env.num_runs;
+  bool waiting_logged = false;
+  while (num_runs_left > 0 && !EarlyExitRequested()) {
+    const auto shard = leaser.Acquire();
+    if (!shard.has_value()) {
+      // All shards are leased by other threads; one will become available
+      // when its lease is released or expires.
+      LOG_IF(INFO, !waiting_logged) << leaser.owner() << " waits for a shard";
+      waiting_logged = true;
+      absl::SleepFor(absl::Seconds(1));
+      continue;
+    }
+    waiting_logged = false;
+    LOG(INFO) << leaser.owner() << " leased shard " << *shard;
+    env.my_shard_index = *shard;
+    env.num_runs = num_runs_left;
+    Centipede centipede(env, user_callbacks, pc_table, symbols,
+                        coverage_logger, stats, executor_pool, &leaser);
+    centipede.FuzzingLoop();
+    num_runs_left -= std::min(num_runs_left, centipede.num_runs());
+    leaser.Release(*shard, centipede.shard_stalled());
+  }
+}
+
+// Fuzzes all --targets in this process, see TargetScheduler.
+// Returns the exit code.
+int FuzzMultipleTargets(const Environment &env,
+                        CentipedeCallbacksFactory &callbacks_factory) {
+  const size_t num_targets = env.targets.size();
+  // Per-target state. std::deque keeps the elements in place.
+  std::deque<Environment> target_envs;
+  std::deque<Coverage::PCTable> pc_tables(num_targets);
+  std::deque<SymbolTable> symbol_tables(num_targets);
+  std::deque<CoverageLogger> coverage_loggers;
+  for (size_t target = 0; target < num_targets; ++target) {
+    auto &target_env = target_envs.emplace_back(env);
+    target_env.UpdateForTarget(target);
+    LOG(INFO) << target_env.experiment_name << ": " << target_env.binary
+              << " workdir: " << target_env.workdir;
+    RemoteMkdir(target_env.MakeCoverageDirPath());
+    auto one_time_callbacks = callbacks_factory.create(target_env);
+    one_time_callbacks->PopulateSymbolAndPcTables(symbol_tables[target],
+                                                  pc_tables[target]);
+    callbacks_factory.destroy(one_time_callbacks);
+    if (env.use_pcpair_features) {
+      CHECK(!pc_tables[target].empty())
+          << "use_pcpair_features requires non-empty pc_table";
+    }
+    coverage_loggers.emplace_back(pc_tables[target], symbol_tables[target]);
+  }
+
+  TargetScheduler scheduler(num_targets, /*num_slots=*/env.num_threads,
+                            absl::Seconds(env.target_growth_half_life));
+
+  auto thread_callback = [&](Environment &my_env, Stats &stats) {
+    SetTraceThreadName(
+        absl::StrCat(my_env.experiment_name, " shard ", my_env.my_shard_index));
+    CreateLocalDirRemovedAtExit(TemporaryLocalDirPath());  // creates temp dir.
+    my_env.seed = GetRandomSeed(env.seed);  // uses TID, call in this thread.
+    const size_t target = my_env.target_index;
+    auto user_callbacks = callbacks_factory.create(my_env);
+    Centipede centipede(my_env, *user_callbacks, pc_tables[target],
+                        symbol_tables[target], coverage_loggers[target], stats,
+                        /*executor_pool=*/nullptr, /*shard_leaser=*/nullptr,
+                        &scheduler);
+    centipede.FuzzingLoop();
+    callbacks_factory.destroy(user_callbacks);
+  };
+
+  // Every target has env.num_threads threads.
+  const size_t num_threads = num_targets * env.num_threads;
+  std::vector<Environment> envs;
+  envs.reserve(num_threads);
+  std::vector<Stats> stats_vec(num_threads);
+  std::vector<std::thread> threads(num_threads);
+  for (size_t thread_idx = 0; thread_idx < num_threads; thread_idx++) {
+    Environment &my_env =
+        envs.emplace_back(target_envs[thread_idx / env.num_threads]);
+    my_env.my_shard_index = env.my_shard_index + thread_idx % env.num_threads;
+    threads[thread_idx] = std::thread(thread_callback, std::ref(my_env),
+                                      std::ref(stats_vec[thread_idx]));
+  }
+
+  // Every target exports its own metrics.
+  std::atomic<bool> logging_thread_continue_running(true);
+  std::vector<std::thread> metrics_threads;
+  for (size_t target = 0; target < num_targets; ++target) {
+    metrics_threads.emplace_back(
+        ExportMetricsThread, std::cref(logging_thread_continue_running),
+        absl::MakeConstSpan(stats_vec).subspan(target * env.num_threads,
+                                                env.num_threads),
+        std::cref(target_envs[target]));
+  }
+
+  std::thread trace_thread(WriteTraceThread,
+                           std::cref(logging_thread_continue_running),
+                           std::cref(env));
+
+  // Log the scheduler stats every minute.
+  std::thread logging_thread([&]() {
+    for (size_t seconds = 1; logging_thread_continue_running; ++seconds) {
+      sleep(1);
+      if (seconds % 60 == 0) LOG(INFO) << scheduler.StatsString();
+    }
+  });
+
+  for (auto &thread : threads) thread.join();
+  logging_thread_continue_running = false;
+  logging_thread.join();
+  for (auto &thread : metrics_threads) thread.join();
+  trace_thread.join();
+  LOG(INFO) << scheduler.StatsString();
+
+  return ExitCode();
+}
+
 }  // namespace
 
 int CentipedeMain(const Environment &env,
                   CentipedeCallbacksFactory &callbacks_factory) {
-  SetSignalHandlers();
+  SetSignalHandlers(env);
+  if (!env.trace_path.empty()) EnableTracing(env.trace_events_per_thread);
 
   if (!env.save_corpus_to_local_dir.empty())
     return Centipede::SaveCorpusToLocalDir(env, env.save_corpus_to_local_dir);
 
   if (!env.for_each_blob.empty()) return ForEachBlob(env);
 
+  if (env.summarize_coverage_journals) return PrintCoverageJournalSummary(env);
+
+  if (env.corpus_exchange_server)
+    return RunCorpusExchangeServer(env.corpus_exchange);
+
   // Just export the corpus from a local dir and exit.
   if (!env.export_corpus_from_local_dir.empty())
     return Centipede::ExportCorpusFromLocalDir(
@@ -170,6 +430,8 @@ int CentipedeMain(const Environment &env,
     }
   }
 
+  if (!env.targets.empty()) return FuzzMultipleTargets(env, callbacks_factory);
+
   // Create the coverage dir once, before creating any threads.
   LOG(INFO) << "Coverage dir " << env.MakeCoverageDirPath();
   RemoteMkdir(env.MakeCoverageDirPath());
@@ -188,13 +450,50 @@ int CentipedeMain(const Environment &env,
   }
   CoverageLogger coverage_logger(pc_table, symbols);
 
-  auto thread_callback = [&](Environment &my_env, Stats &stats) {
+  // Shared by all threads, if --num_executors is set.
+  std::unique_ptr<ExecutorPool> executor_pool;
+  if (env.num_executors) {
+    executor_pool = std::make_unique<ExecutorPool>(env, callbacks_factory,
+                                                   env.num_executors);
+  }
+
+  // Compute the CPU placement of the threads, see --cpu_affinity.
+  std::vector<CpuPlacement> cpu_placements;
+  const auto cpu_affinity_mode = ParseCpuAffinityMode(env.cpu_affinity);
+  if (cpu_affinity_mode != CpuAffinityMode::kNone) {
+    const auto available_cpus = GetAvailableCpus();
+    CHECK(!available_cpus.empty()) << "Failed to get the available CPUs";
+    cpu_placements = ComputeCpuPlacement(available_cpus, env.num_threads,
+                                         cpu_affinity_mode);
+    for (size_t thread_idx = 0; thread_idx < env.num_threads; thread_idx++) {
+      LOG(INFO) << "CPU placement: thread " << thread_idx << " shard "
+                << env.my_shard_index + thread_idx << " "
+                << CpuPlacementToString(cpu_placements[thread_idx]);
+    }
+  }
+
+  auto thread_callback = [&](Environment &my_env, Stats &stats,
+                             size_t thread_idx) {
+    // Pin the thread before creating the callbacks, so that their shared
+    // memory and runners are local to the thread's CPUs.
+    if (!cpu_placements.empty() &&
+        !PinThisThread(cpu_placements[thread_idx])) {
+      LOG(INFO) << "Failed to pin thread " << thread_idx << " to "
+                << CpuPlacementToString(cpu_placements[thread_idx]);
+    }
+    SetTraceThreadName(absl::StrCat("thread ", thread_idx));
     CreateLocalDirRemovedAtExit(TemporaryLocalDirPath());  // creates temp dir.
     my_env.seed = GetRandomSeed(env.seed);  // uses TID, call in this thread.
     auto user_callbacks = callbacks_factory.create(my_env);
-    Centipede centipede(my_env, *user_callbacks, pc_table, symbols,
-                        coverage_logger, stats);
-    centipede.FuzzingLoop();
+    if (env.shard_lease_seconds == 0) {
+      Centipede centipede(my_env, *user_callbacks, pc_table, symbols,
+                          coverage_logger, stats, executor_pool.get());
+      centipede.FuzzingLoop();
+    } else {
+      FuzzLeasedShards(my_env, *user_callbacks, pc_table, symbols,
+                       coverage_logger, stats, executor_pool.get(),
+                       thread_idx);
+    }
     callbacks_factory.destroy(user_callbacks);
   };
 
@@ -208,13 +507,20 @@ int CentipedeMain(const Environment &env,
     Environment &my_env = envs[thread_idx];
     my_env.my_shard_index = env.my_shard_index + thread_idx;
     my_env.UpdateForExperiment();
-    threads[thread_idx] = std::thread(thread_callback, std::ref(my_env),
-                                      std::ref(stats_vec[thread_idx]));
+    threads[thread_idx] =
+        std::thread(thread_callback, std::ref(my_env),
+                    std::ref(stats_vec[thread_idx]), thread_idx);
   }
 
   std::thread stats_thread(PrintExperimentStatsThread,
                            std::ref(stats_thread_continue_running),
                            std::ref(stats_vec), std::ref(envs));
+  std::thread metrics_thread(
+      ExportMetricsThread, std::cref(stats_thread_continue_running),
+      absl::MakeConstSpan(stats_vec), std::cref(env));
+  std::thread trace_thread(WriteTraceThread,
+                           std::cref(stats_thread_continue_running),
+                           std::cref(env));
 
   // Join threads.
   for (size_t thread_idx = 0; thread_idx < env.num_threads; thread_idx++) {
@@ -222,6 +528,10 @@ int CentipedeMain(const Environment &env,
   }
   stats_thread_continue_running = false;
   stats_thread.join();
+  metrics_thread.join();
+  trace_thread.join();
+
+  if (executor_pool) LOG(INFO) << executor_pool->UtilizationString();
 
   return ExitCode();
 }
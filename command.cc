@@ -15,26 +15,159 @@
 #include "./command.h"
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <spawn.h>
 #include <sys/poll.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <string>
 #include <string_view>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/log/check.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/str_replace.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "./logging.h"
 #include "./util.h"
 
+extern char **environ;
+
 namespace centipede {
 
+namespace {
+
+absl::Duration TimevalToDuration(const struct timeval &tv) {
+  return absl::Seconds(tv.tv_sec) + absl::Microseconds(tv.tv_usec);
+}
+
+Command::ChildRUsage ToChildRUsage(const struct rusage &rusage) {
+  return {
+      .user_time = TimevalToDuration(rusage.ru_utime),
+      .sys_time = TimevalToDuration(rusage.ru_stime),
+      .max_rss_kb = rusage.ru_maxrss,  // Kilobytes on Linux.
+  };
+}
+
+// The number of shells currently run by SpawnShellAndWait(), and the
+// SIGINT and SIGQUIT actions to restore when the last one is done.
+ABSL_CONST_INIT absl::Mutex num_running_shells_mu(absl::kConstInit);
+size_t num_running_shells ABSL_GUARDED_BY(num_running_shells_mu) = 0;
+struct sigaction saved_sigint_action ABSL_GUARDED_BY(num_running_shells_mu);
+struct sigaction saved_sigquit_action ABSL_GUARDED_BY(num_running_shells_mu);
+
+// Runs `sh -c command_line` and waits for it with the signal handling of
+// system(): while the shell runs, SIGINT and SIGQUIT are ignored by this
+// process (the terminal sends them to the shell too, which decides what to
+// do) and SIGCHLD is blocked in this thread; the shell starts with their
+// default actions and the original signal mask. Unlike system(),
+// posix_spawn() doesn't copy the page tables of the (large) engine.
+// `file_actions` may be null. Returns the wait status and the resource usage
+// of the shell (and hence of the command, which the shell waits for) in
+// `rusage`, or -1 if the shell could not be spawned.
+int SpawnShellAndWait(const std::string &command_line,
+                      const posix_spawn_file_actions_t *file_actions,
+                      struct rusage &rusage) {
+  const char *argv[] = {"sh", "-c", command_line.c_str(), nullptr};
+  sigset_t sigchld_mask, original_mask;
+  sigemptyset(&sigchld_mask);
+  sigaddset(&sigchld_mask, SIGCHLD);
+  CHECK_EQ(pthread_sigmask(SIG_BLOCK, &sigchld_mask, &original_mask), 0);
+  {
+    // Concurrent callers ignore the signals once and restore them once.
+    absl::MutexLock lock(&num_running_shells_mu);
+    if (num_running_shells++ == 0) {
+      struct sigaction ignore = {};
+      ignore.sa_handler = SIG_IGN;
+      sigemptyset(&ignore.sa_mask);
+      PCHECK(sigaction(SIGINT, &ignore, &saved_sigint_action) == 0);
+      PCHECK(sigaction(SIGQUIT, &ignore, &saved_sigquit_action) == 0);
+    }
+  }
+  posix_spawnattr_t attr;
+  CHECK_EQ(posix_spawnattr_init(&attr), 0);
+  sigset_t default_signals;
+  sigemptyset(&default_signals);
+  sigaddset(&default_signals, SIGINT);
+  sigaddset(&default_signals, SIGQUIT);
+  CHECK_EQ(posix_spawnattr_setsigdefault(&attr, &default_signals), 0);
+  CHECK_EQ(posix_spawnattr_setsigmask(&attr, &original_mask), 0);
+  CHECK_EQ(posix_spawnattr_setflags(
+               &attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK),
+           0);
+  pid_t pid = -1;
+  const int spawn_error =
+      posix_spawn(&pid, "/bin/sh", file_actions, &attr,
+                  const_cast<char *const *>(argv), environ);
+  CHECK_EQ(posix_spawnattr_destroy(&attr), 0);
+  int status = -1;
+  if (spawn_error != 0) {
+    LOG(INFO) << "posix_spawn failed: " << strerror(spawn_error);
+  } else {
+    while (wait4(pid, &status, 0, &rusage) < 0) {
+      PCHECK(errno == EINTR) << "wait4 failed for " << command_line;
+    }
+  }
+  {
+    absl::MutexLock lock(&num_running_shells_mu);
+    if (--num_running_shells == 0) {
+      PCHECK(sigaction(SIGINT, &saved_sigint_action, nullptr) == 0);
+      PCHECK(sigaction(SIGQUIT, &saved_sigquit_action, nullptr) == 0);
+    }
+  }
+  CHECK_EQ(pthread_sigmask(SIG_SETMASK, &original_mask, nullptr), 0);
+  return status;
+}
+
+// Like system(), but also returns the resource usage of the shell (and hence
+// of the command, which the shell waits for) in `rusage`.
+int SystemWithRUsage(const std::string &command_line, struct rusage &rusage) {
+  return SpawnShellAndWait(command_line, /*file_actions=*/nullptr, rusage);
+}
+
+// Like system(), but with the stdout and stderr of the shell redirected to
+// `output_fd`.
+int SystemWithOutputFd(const std::string &command_line, int output_fd) {
+  posix_spawn_file_actions_t file_actions;
+  CHECK_EQ(posix_spawn_file_actions_init(&file_actions), 0);
+  CHECK_EQ(posix_spawn_file_actions_adddup2(&file_actions, output_fd,
+                                            STDOUT_FILENO),
+           0);
+  CHECK_EQ(posix_spawn_file_actions_adddup2(&file_actions, output_fd,
+                                            STDERR_FILENO),
+           0);
+  struct rusage rusage = {};
+  const int status = SpawnShellAndWait(command_line, &file_actions, rusage);
+  CHECK_EQ(posix_spawn_file_actions_destroy(&file_actions), 0);
+  return status;
+}
+
+// Returns the poll() timeout until `deadline`: -1 (infinite) if there is no
+// deadline, 0 if it passed.
+int PollTimeoutMs(absl::Time deadline) {
+  if (deadline == absl::InfiniteFuture()) return -1;
+  return static_cast<int>(std::clamp<int64_t>(
+      absl::ToInt64Milliseconds(deadline - absl::Now()), 0, INT_MAX));
+}
+
+}  // namespace
+
 // See the definition of --fork_server flag.
 inline constexpr std::string_view kCommandLineSeparator(" \\\n");
 inline constexpr std::string_view kNoForkServerRequestPrefix("%f");
@@ -52,6 +185,10 @@ Command::Command(std::string_view path, std::vector<std::string> args,
       temp_file_path_(temp_file_path) {}
 
 std::string Command::ToString() const {
+  return CommandLine(/*redirect_output=*/true);
+}
+
+std::string Command::CommandLine(bool redirect_output) const {
   std::vector<std::string> ss;
   // env.
   for (auto &env : env_) {
@@ -75,10 +212,10 @@ std::string Command::ToString() const {
     ss.emplace_back(arg);
   }
   // out/err.
-  if (!out_.empty()) {
+  if (redirect_output && !out_.empty()) {
     ss.emplace_back(absl::StrCat("> ", out_));
   }
-  if (!err_.empty()) {
+  if (redirect_output && !err_.empty()) {
     if (out_ != err_) {
       ss.emplace_back(absl::StrCat("2> ", err_));
     } else {
@@ -90,7 +227,7 @@ std::string Command::ToString() const {
 }
 
 bool Command::StartForkServer(std::string_view temp_dir_path,
-                              std::string_view prefix) {
+                              std::string_view prefix, size_t output_capacity) {
   if (absl::StartsWith(path_, kNoForkServerRequestPrefix)) {
     LOG(INFO) << "Fork server disabled for " << path();
     return false;
@@ -107,21 +244,48 @@ bool Command::StartForkServer(std::string_view temp_dir_path,
         << VV(i) << VV(fifo_path_[i]);
   }
 
+  // With the output captured, the fork server inherits the write end of the
+  // output pipe as stdout/stderr instead of redirecting them to `out_`. The
+  // children then write to the pipe, which Execute() drains, so a chatty
+  // target costs no file I/O and no more than `output_capacity` bytes of RAM.
+  int output_pipe[2] = {-1, -1};
+  if (output_capacity != 0) {
+    CHECK(!out_.empty() && out_ == err_) << VV(out_) << VV(err_);
+    PCHECK(pipe2(output_pipe, O_CLOEXEC) == 0);
+    // Only the read end is non-blocking: the children block on a full pipe
+    // until Execute() drains it, rather than lose their output.
+    PCHECK(fcntl(output_pipe[0], F_SETFL, O_NONBLOCK) == 0);
+    // Fewer wakeups of Execute() for chatty targets; fine if it fails.
+    (void)fcntl(output_pipe[0], F_SETPIPE_SZ, 1 << 20);
+  }
   const std::string command = absl::StrCat(
       "CENTIPEDE_FORK_SERVER_FIFO0=", fifo_path_[0], kCommandLineSeparator,
       "CENTIPEDE_FORK_SERVER_FIFO1=", fifo_path_[1], kCommandLineSeparator,
-      command_line_, " &");
+      output_capacity == 0 ? command_line_
+                           : CommandLine(/*redirect_output=*/false),
+      " &");
   LOG(INFO) << "Fork server command:\n" << command;
-  int ret = system(command.c_str());
+  int ret = output_capacity == 0
+                ? system(command.c_str())
+                : SystemWithOutputFd(command, output_pipe[1]);
   CHECK_EQ(ret, 0) << "Failed to start fork server using command:\n" << command;
+  if (output_capacity != 0) {
+    // Only the fork server and its children keep the write end open.
+    CHECK_EQ(close(output_pipe[1]), 0);
+  }
 
   pipe_[0] = open(fifo_path_[0].c_str(), O_WRONLY);
   pipe_[1] = open(fifo_path_[1].c_str(), O_RDONLY);
   if (pipe_[0] < 0 || pipe_[1] < 0) {
     LOG(INFO) << "Failed to establish communication with fork server; will "
                  "proceed without it";
+    if (output_capacity != 0) CHECK_EQ(close(output_pipe[0]), 0);
     return false;
   }
+  if (output_capacity != 0) {
+    output_fd_ = output_pipe[0];
+    output_capacity_ = output_capacity;
+  }
   return true;
 }
 
@@ -131,38 +295,79 @@ Command::~Command() {
     if (!fifo_path_[i].empty())
       CHECK(std::filesystem::remove(fifo_path_[i])) << fifo_path_[i];
   }
+  if (output_fd_ >= 0) CHECK_EQ(close(output_fd_), 0);
 }
 
-int Command::Execute() {
+void Command::ReadOutput() {
+  char buf[1 << 16];
+  while (output_fd_ >= 0) {
+    const ssize_t num_read = read(output_fd_, buf, sizeof(buf));
+    if (num_read < 0 && errno == EINTR) continue;
+    if (num_read < 0) {
+      PCHECK(errno == EAGAIN || errno == EWOULDBLOCK);
+      return;  // Nothing more to read for now.
+    }
+    if (num_read == 0) {
+      // The fork server and all its children are gone: stop polling the pipe.
+      CHECK_EQ(close(output_fd_), 0);
+      output_fd_ = -1;
+      return;
+    }
+    output_.append(buf, num_read);
+    // Trimming only at twice the capacity makes it amortized O(1) per byte.
+    if (output_.size() > 2 * output_capacity_)
+      output_.erase(0, output_.size() - output_capacity_);
+  }
+}
+
+std::string Command::captured_output() const {
+  if (output_.size() <= output_capacity_) return output_;
+  return output_.substr(output_.size() - output_capacity_);
+}
+
+int Command::Execute(absl::Duration timeout) {
   int exit_code = 0;
   if (pipe_[0] >= 0 && pipe_[1] >= 0) {
     // Wake up the fork server.
     char x = ' ';
     CHECK_EQ(1, write(pipe_[0], &x, 1));
 
+    // Drop the output written between executions, if any.
+    ReadOutput();
+    output_.clear();
+
     // The fork server forks, the child is running. Block until some readable
     // data appears in the pipe (that is, after the fork server writes the
-    // execution result to it).
-    const int poll_timeout_ms =
-        static_cast<int>(absl::ToInt64Milliseconds(timeout_));
+    // execution result to it). Meanwhile, drain the output of the child, if
+    // captured, so that it never blocks on a full pipe.
+    const absl::Time deadline = absl::Now() + timeout;
+    const int poll_timeout_ms = PollTimeoutMs(deadline);
     // The `poll()` syscall can get interrupted: it sets errno==EINTR in that
     // case. We should tolerate that.
-    struct pollfd poll_fd = {};
+    struct pollfd poll_fds[2] = {};
+    struct pollfd &poll_fd = poll_fds[0];
     int poll_ret = -1;
     do {
-      // NOTE: `poll_fd` has to be reset every time.
+      // NOTE: `poll_fds` has to be reset every time.
       poll_fd = {
           .fd = pipe_[1],    // The file descriptor to wait for.
           .events = POLLIN,  // Wait until `fd` gets readable data.
       };
-      poll_ret = poll(&poll_fd, 1, poll_timeout_ms);
-    } while (poll_ret < 0 && errno == EINTR);
+      // poll() ignores negative fds, i.e. the output if it's not captured.
+      poll_fds[1] = {.fd = output_fd_, .events = POLLIN};
+      poll_ret = poll(poll_fds, 2, PollTimeoutMs(deadline));
+      if (poll_ret > 0 && poll_fds[1].revents != 0) ReadOutput();
+    } while ((poll_ret < 0 && errno == EINTR) ||
+             (poll_ret > 0 && poll_fd.revents == 0));
 
-    if (poll_ret != 1 || (poll_fd.revents & POLLIN) == 0) {
+    if (poll_ret < 1 || (poll_fd.revents & POLLIN) == 0) {
       // The fork server errored out or timed out, or some other error occurred,
       // e.g. the syscall was interrupted.
       std::string fork_server_log = "<not dumped>";
-      if (!out_.empty()) {
+      if (captures_output()) {
+        ReadOutput();
+        fork_server_log = captured_output();
+      } else if (!out_.empty()) {
         ReadFromLocalFile(out_, fork_server_log);
       }
       if (poll_ret == 0) {
@@ -178,10 +383,27 @@ int Command::Execute() {
     }
 
     // The fork server wrote the execution result to the pipe: read it.
-    CHECK_EQ(sizeof(exit_code), read(pipe_[1], &exit_code, sizeof(exit_code)));
+    // It is the exit status, followed by the child's rusage unless the fork
+    // server is from an older version.
+    char result[sizeof(exit_code) + sizeof(struct rusage)];
+    const ssize_t num_read = read(pipe_[1], result, sizeof(result));
+    CHECK(num_read == sizeof(exit_code) || num_read == sizeof(result))
+        << VV(num_read);
+    memcpy(&exit_code, result, sizeof(exit_code));
+    if (num_read == sizeof(result)) {
+      struct rusage rusage;
+      memcpy(&rusage, result + sizeof(exit_code), sizeof(rusage));
+      last_child_rusage_ = ToChildRUsage(rusage);
+    } else {
+      last_child_rusage_ = std::nullopt;
+    }
+    // The child has exited, so all its output is already in the pipe.
+    ReadOutput();
   } else {
-    // No fork server, use system().
-    exit_code = system(command_line_.c_str());
+    // No fork server, spawn a shell like system() does.
+    struct rusage rusage = {};
+    exit_code = SystemWithRUsage(command_line_, rusage);
+    last_child_rusage_ = ToChildRUsage(rusage);
   }
   if (WIFSIGNALED(exit_code) && (WTERMSIG(exit_code) == SIGINT))
     RequestEarlyExit(EXIT_FAILURE);
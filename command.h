@@ -15,6 +15,9 @@
 #ifndef THIRD_PARTY_CENTIPEDE_COMMAND_H_
 #define THIRD_PARTY_CENTIPEDE_COMMAND_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -25,6 +28,14 @@
 namespace centipede {
 class Command final {
  public:
+  // Resource usage of the child process of Execute(), as reported by wait4().
+  // Includes the descendants of the child that it waited for.
+  struct ChildRUsage {
+    absl::Duration user_time = absl::ZeroDuration();
+    absl::Duration sys_time = absl::ZeroDuration();
+    int64_t max_rss_kb = 0;
+  };
+
   // Move-constructible only.
   Command(const Command& other) = delete;
   Command& operator=(const Command& other) = delete;
@@ -44,10 +55,15 @@ class Command final {
         command_line_(other.command_line_),
         fifo_path_{std::move(other.fifo_path_[0]),
                    std::move(other.fifo_path_[1])},
-        pipe_{other.pipe_[0], other.pipe_[1]} {
+        pipe_{other.pipe_[0], other.pipe_[1]},
+        output_fd_(other.output_fd_),
+        output_capacity_(other.output_capacity_),
+        output_(std::move(other.output_)),
+        last_child_rusage_(other.last_child_rusage_) {
     // If we don't do this, the moved-from object will close these pipes.
     other.pipe_[0] = -1;
     other.pipe_[1] = -1;
+    other.output_fd_ = -1;
   }
 
   // Constructs a command:
@@ -76,18 +92,43 @@ class Command final {
   // Executes the command, returns the exit status.
   // Can be called more than once.
   // If interrupted, may call RequestEarlyExit().
-  int Execute();
+  int Execute() { return Execute(timeout_); }
+  // Like Execute(), but terminates a fork server execution attempt after
+  // `timeout` instead of the one given to the constructor.
+  int Execute(absl::Duration timeout);
 
   // Attempts to start a fork server, returns true on success.
   // Pipe files for the fork server are created in `temp_dir_path`
   // with prefix `prefix`.
+  // If `output_capacity` is not 0, the combined stdout/stderr of the fork
+  // server (`out` must be equal to `err`) goes to a pipe instead of `out`.
+  // Execute() drains the pipe and keeps the last `output_capacity` bytes in
+  // memory, see captured_output().
   // See runner_fork_server.cc for details.
-  bool StartForkServer(std::string_view temp_dir_path, std::string_view prefix);
+  bool StartForkServer(std::string_view temp_dir_path, std::string_view prefix,
+                       size_t output_capacity = 0);
 
   // Accessors.
   const std::string& path() const { return path_; }
+  // The resource usage of the child of the last Execute(). std::nullopt before
+  // the first Execute() or if the fork server does not report it.
+  const std::optional<ChildRUsage>& last_child_rusage() const {
+    return last_child_rusage_;
+  }
+  // True if the output is captured in memory, see StartForkServer().
+  bool captures_output() const { return output_capacity_ != 0; }
+  // The last `output_capacity` bytes of the output of the last Execute(), if
+  // captures_output(); empty otherwise.
+  std::string captured_output() const;
 
  private:
+  // Returns the command line, with the stdout/stderr redirects to `out`/`err`
+  // iff `redirect_output`.
+  std::string CommandLine(bool redirect_output) const;
+  // Reads everything available from `output_fd_` without blocking, trims
+  // `output_` to at most twice the capacity.
+  void ReadOutput();
+
   const std::string path_;
   const std::vector<std::string> args_;
   const std::vector<std::string> env_;
@@ -99,6 +140,11 @@ class Command final {
   // Pipe paths and file descriptors for the fork server.
   std::string fifo_path_[2];
   int pipe_[2] = {-1, -1};
+  // The read end of the pipe with the captured output, see StartForkServer().
+  int output_fd_ = -1;
+  size_t output_capacity_ = 0;
+  std::string output_;
+  std::optional<ChildRUsage> last_child_rusage_;
 };
 
 }  // namespace centipede
@@ -18,10 +18,13 @@
 #include <sys/wait.h>  // NOLINT(for WTERMSIG)
 
 #include <cstdlib>
+#include <filesystem>
 #include <string>
 
 #include "googletest/include/gtest/gtest.h"
+#include "absl/strings/match.h"
 #include "absl/strings/substitute.h"
+#include "absl/time/time.h"
 #include "./logging.h"
 #include "./test_util.h"
 #include "./util.h"
@@ -55,6 +58,17 @@ TEST(CommandTest, Execute) {
   EXPECT_FALSE(EarlyExitRequested());
 }
 
+TEST(CommandTest, ChildRUsage) {
+  Command busy("bash -c 'for ((i = 0; i < 300000; ++i)); do :; done'");
+  EXPECT_FALSE(busy.last_child_rusage().has_value());
+  EXPECT_EQ(busy.Execute(), 0);
+  ASSERT_TRUE(busy.last_child_rusage().has_value());
+  EXPECT_GT(busy.last_child_rusage()->user_time +
+                busy.last_child_rusage()->sys_time,
+            absl::ZeroDuration());
+  EXPECT_GT(busy.last_child_rusage()->max_rss_kb, 0);
+}
+
 TEST(CommandDeathTest, Execute) {
   GTEST_FLAG_SET(death_test_style, "threadsafe");
   // Test for interrupt handling.
@@ -87,6 +101,8 @@ TEST(CommandTest, ForkServer) {
     Command cmd(helper, {input}, {}, log, log);
     EXPECT_TRUE(cmd.StartForkServer(test_tmpdir, "ForkServer"));
     EXPECT_EQ(cmd.Execute(), EXIT_SUCCESS);
+    ASSERT_TRUE(cmd.last_child_rusage().has_value());
+    EXPECT_GT(cmd.last_child_rusage()->max_rss_kb, 0);
     std::string log_contents;
     ReadFromLocalFile(log, log_contents);
     EXPECT_EQ(log_contents, absl::Substitute("Got input: $0", input));
@@ -128,6 +144,41 @@ TEST(CommandTest, ForkServer) {
   // TODO(kcc): [impl] test what happens if the child is interrupted.
 }
 
+TEST(CommandTest, ForkServerCapturedOutput) {
+  const std::string test_tmpdir = GetTestTempDir(test_info_->name());
+  const std::string helper = GetDataDependencyFilepath("command_test_helper");
+
+  {
+    const std::string input = "fail";
+    const std::string log = std::filesystem::path{test_tmpdir} / input;
+    Command cmd(helper, {input}, {}, log, log);
+    EXPECT_TRUE(cmd.StartForkServer(test_tmpdir, "ForkServer",
+                                    /*output_capacity=*/100));
+    EXPECT_TRUE(cmd.captures_output());
+    // Every execution captures only its own output.
+    for (int i = 0; i < 2; ++i) {
+      EXPECT_EQ(cmd.Execute(), EXIT_FAILURE);
+      EXPECT_EQ(cmd.captured_output(),
+                absl::Substitute("Got input: $0", input));
+    }
+    EXPECT_FALSE(std::filesystem::exists(log));
+  }
+
+  {
+    // Writes more than the pipe can hold: only the end is kept.
+    const std::string input = "chatty";
+    const std::string log = std::filesystem::path{test_tmpdir} / input;
+    Command cmd(helper, {input}, {}, log, log);
+    EXPECT_TRUE(cmd.StartForkServer(test_tmpdir, "ForkServer",
+                                    /*output_capacity=*/100));
+    EXPECT_EQ(cmd.Execute(), EXIT_FAILURE);
+    const std::string output = cmd.captured_output();
+    EXPECT_EQ(output.size(), 100u);
+    EXPECT_TRUE(absl::EndsWith(output, "0123456789012345678\nthe end\n"))
+        << output;
+  }
+}
+
 TEST(CommandDeathTest, ForkServerHangingBinary) {
   GTEST_FLAG_SET(death_test_style, "threadsafe");
   const std::string test_tmpdir = GetTestTempDir(test_info_->name());
@@ -28,6 +28,12 @@ int main(int argc, char **argv) {
   if (!strcmp(argv[1], "fail")) return EXIT_FAILURE;
   if (!strcmp(argv[1], "ret42")) return 42;
   if (!strcmp(argv[1], "abort")) abort();
+  // Write more than any pipe buffer, then a marker line.
+  if (!strcmp(argv[1], "chatty")) {
+    for (int i = 0; i < 100000; ++i) printf("0123456789012345678\n");
+    printf("the end\n");
+    return EXIT_FAILURE;
+  }
   // Sleep longer than kTimeout in CommandDeathTest_ForkServerHangingBinary.
   if (!strcmp(argv[1], "hang")) sleep(5);
   return 17;
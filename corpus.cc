@@ -14,8 +14,10 @@
 
 #include "./corpus.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <ostream>
 #include <queue>
 #include <string>
@@ -108,7 +110,42 @@ static size_t ComputeWeight(const FeatureVec &fv, const FeatureSet &fs,
       ++num_features_in_frontier;
     }
   }
-  return weight * (num_features_in_frontier + 1);  // Multiply by at least 1.
+  weight *= num_features_in_frontier + 1;  // Multiply by at least 1.
+  return std::min<size_t>(weight, std::numeric_limits<uint32_t>::max());
+}
+
+// Energy schedule parameters, see ApplyEnergy().
+// The energy of a record halves every time this many of its mutants are
+// executed without producing new features.
+static constexpr size_t kUnproductiveMutantsPerHalving = 4096;
+// The max factor by which the energy of a productive record is boosted.
+static constexpr size_t kMaxEnergyBoost = 8;
+// The energy of a record halves for every doubling of its peak heap usage
+// above this size.
+static constexpr uint64_t kMemoryHungryPeakHeapBytes = 64ULL << 20;
+
+// Returns the weight of `record` with its energy applied.
+// This is a simplified AFLFast/Entropic-style schedule:
+// the weight is boosted by the number of new features the mutants of `record`
+// have produced (capped by kMaxEnergyBoost), and is exponentially decayed
+// by the number of mutants executed since the last time that happened.
+// Memory-hungry records (see kMemoryHungryPeakHeapBytes) lose energy too.
+// A non-zero base weight never decays to zero, so that the energy schedule
+// doesn't cause Prune() to discard the record.
+// If the energy counters of `record` are all zero, returns its base weight.
+static uint32_t ApplyEnergy(const CorpusRecord &record) {
+  uint64_t weight = record.base_weight;
+  if (weight == 0) return 0;
+  weight *= 1 + std::min(record.num_new_features, kMaxEnergyBoost - 1);
+  const size_t num_halvings =
+      record.num_unproductive_mutants / kUnproductiveMutantsPerHalving;
+  weight >>= std::min(num_halvings, size_t{63});
+  for (uint64_t heap = record.peak_heap_bytes;
+       heap > kMemoryHungryPeakHeapBytes && weight != 0; heap >>= 1) {
+    weight >>= 1;
+  }
+  weight = std::min<uint64_t>(weight, std::numeric_limits<uint32_t>::max());
+  return std::max<uint64_t>(weight, 1);
 }
 
 size_t Corpus::Prune(const FeatureSet &fs,
@@ -120,9 +157,10 @@ size_t Corpus::Prune(const FeatureSet &fs,
   // Recompute the weights.
   size_t num_zero_weights = 0;
   for (size_t i = 0, n = records_.size(); i < n; ++i) {
-    fs.CountUnseenAndPruneFrequentFeatures(records_[i].features);
-    auto new_weight =
-        ComputeWeight(records_[i].features, fs, coverage_frontier);
+    auto &record = records_[i];
+    fs.CountUnseenAndPruneFrequentFeatures(record.features);
+    record.base_weight = ComputeWeight(record.features, fs, coverage_frontier);
+    auto new_weight = ApplyEnergy(record);
     weighted_distribution_.ChangeWeight(i, new_weight);
     num_zero_weights += new_weight == 0;
   }
@@ -152,20 +190,56 @@ size_t Corpus::Prune(const FeatureSet &fs,
 
 void Corpus::Add(const ByteArray &data, const FeatureVec &fv,
                  const ByteArray &cmp_args, const FeatureSet &fs,
-                 const CoverageFrontier &coverage_frontier) {
+                 const CoverageFrontier &coverage_frontier,
+                 uint64_t peak_heap_bytes) {
   // TODO(kcc): use coverage_frontier.
   CHECK(!data.empty());
   CHECK_EQ(records_.size(), weighted_distribution_.size());
   records_.push_back({data, fv, cmp_args});
-  weighted_distribution_.AddWeight(ComputeWeight(fv, fs, coverage_frontier));
+  auto &record = records_.back();
+  record.peak_heap_bytes = peak_heap_bytes;
+  record.base_weight = ComputeWeight(fv, fs, coverage_frontier);
+  weighted_distribution_.AddWeight(ApplyEnergy(record));
 }
 
-const CorpusRecord &Corpus::WeightedRandom(size_t random) const {
-  return records_[weighted_distribution_.RandomIndex(random)];
+const CorpusRecord &Corpus::WeightedRandom(size_t random) {
+  return records_[WeightedRandomIndex(random)];
 }
 
 const CorpusRecord &Corpus::UniformRandom(size_t random) const {
-  return records_[random % records_.size()];
+  return records_[UniformRandomIndex(random)];
+}
+
+size_t Corpus::WeightedRandomIndex(size_t random) {
+  if (!weighted_distribution_.is_valid())
+    weighted_distribution_.RecomputeInternalState();
+  return weighted_distribution_.RandomIndex(random);
+}
+
+size_t Corpus::UniformRandomIndex(size_t random) const {
+  return random % records_.size();
+}
+
+void Corpus::UpdateEnergy(const std::vector<size_t> &indices,
+                          size_t num_mutants, size_t num_new_features) {
+  if (indices.empty()) return;
+  const size_t num_new_features_per_record =
+      (num_new_features + indices.size() - 1) / indices.size();
+  for (auto idx : indices) {
+    CHECK_LT(idx, records_.size());
+    auto &record = records_[idx];
+    record.num_mutants += num_mutants;
+    if (num_new_features) {
+      record.num_new_features += num_new_features_per_record;
+      record.num_unproductive_mutants = 0;
+    } else {
+      record.num_unproductive_mutants += num_mutants;
+    }
+    // Most batches change no weight: the energy decays in steps.
+    const uint32_t new_weight = ApplyEnergy(record);
+    if (new_weight != weighted_distribution_.weight(idx))
+      weighted_distribution_.ChangeWeight(idx, new_weight);
+  }
 }
 
 void Corpus::PrintStats(std::ostream &out, const FeatureSet &fs) {
@@ -220,7 +294,7 @@ void WeightedDistribution::ChangeWeight(size_t idx, uint32_t new_weight) {
 
 __attribute__((noinline))  // to see it in profile.
 void WeightedDistribution::RecomputeInternalState() {
-  uint32_t partial_sum = 0;
+  uint64_t partial_sum = 0;
   for (size_t i = 0, n = size(); i < n; i++) {
     partial_sum += weights_[i];
     cumulative_weights_[i] = partial_sum;
@@ -233,7 +307,7 @@ size_t
 WeightedDistribution::RandomIndex(size_t random) const {
   CHECK(!weights_.empty());
   CHECK(cumulative_weights_valid_);
-  uint32_t sum_of_all_weights = cumulative_weights_.back();
+  uint64_t sum_of_all_weights = cumulative_weights_.back();
   if (sum_of_all_weights == 0)
     return random % size();  // can't do much else here.
   random = random % sum_of_all_weights;
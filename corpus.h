@@ -105,6 +105,7 @@ class FeatureSet {
 };
 
 // WeightedDistribution maintains an array of integer weights.
+// The weights are 32-bit, their sums are 64-bit and thus never overflow.
 // It allows to compute a random number in range [0,size()) such that
 // the probability of each number is proportional to its weight.
 class WeightedDistribution {
@@ -116,6 +117,11 @@ class WeightedDistribution {
   uint32_t PopBack();
   // Changes the existing idx-th weight to new_weight.
   void ChangeWeight(size_t idx, uint32_t new_weight);
+  // Returns the idx-th weight.
+  uint32_t weight(size_t idx) const { return weights_[idx]; }
+  // Returns false if RecomputeInternalState() needs to be called before
+  // RandomIndex().
+  bool is_valid() const { return cumulative_weights_valid_; }
   // Returns a random number in [0,size()), using a random number `random`.
   // For proper randomness, `random` should come from a 64-bit RNG.
   // RandomIndex() must not be called after ChangeWeight() without first
@@ -147,7 +153,7 @@ class WeightedDistribution {
   // is weights_[Idx] / SumOfAllWeights.
   std::vector<uint32_t> weights_;
   // i-th element is the sum of the first i elements of weights_.
-  std::vector<uint32_t> cumulative_weights_;
+  std::vector<uint64_t> cumulative_weights_;
   // If false, cumulative_weights_ needs to be recomputed.
   bool cumulative_weights_valid_ = true;
 };
@@ -159,6 +165,19 @@ struct CorpusRecord {
   ByteArray data;
   FeatureVec features;
   ByteArray cmp_args;
+  // Energy schedule state, see Corpus::UpdateEnergy().
+  // The weight computed from `features` alone, before applying the energy.
+  uint32_t base_weight = 0;
+  // The number of mutants of this record executed so far.
+  size_t num_mutants = 0;
+  // The number of mutants executed since the last time the mutants of this
+  // record produced new features.
+  size_t num_unproductive_mutants = 0;
+  // The number of new features produced by the mutants of this record.
+  size_t num_new_features = 0;
+  // The peak heap usage of `data` reported by the runner, if it is linked with
+  // the heap interceptors, see --malloc_limit_mb.
+  uint64_t peak_heap_bytes = 0;
 };
 
 // Maintains the corpus of inputs.
@@ -169,9 +188,12 @@ class Corpus {
   // 'fv' (the features associated with this input),
   // and `cmp_args` (arguments of CMP instructions).
   // `fs` is used to compute weights of `fv`.
+  // `peak_heap_bytes` is the peak heap usage of `data`, if known; inputs that
+  // use a lot of heap get lower weights.
   void Add(const ByteArray &data, const FeatureVec &fv,
            const ByteArray &cmp_args, const FeatureSet &fs,
-           const CoverageFrontier &coverage_frontier);
+           const CoverageFrontier &coverage_frontier,
+           uint64_t peak_heap_bytes = 0);
   // Returns the total number of inputs added.
   size_t NumTotal() const { return num_pruned_ + NumActive(); }
   // Return the number of currently active inputs, i.e. inputs that we want to
@@ -189,11 +211,31 @@ class Corpus {
   }
   // Returns a random active corpus record using weighted distribution.
   // See WeightedDistribution.
-  const CorpusRecord &WeightedRandom(size_t random) const;
+  const CorpusRecord &WeightedRandom(size_t random);
   // Returns a random active corpus record using uniform distribution.
   const CorpusRecord &UniformRandom(size_t random) const;
+  // Same as WeightedRandom(), but returns the index of the record.
+  // Recomputes the weighted distribution first if UpdateEnergy() changed it.
+  size_t WeightedRandomIndex(size_t random);
+  // Same as UniformRandom(), but returns the index of the record.
+  size_t UniformRandomIndex(size_t random) const;
+  // Energy schedule, see --use_energy_schedule.
+  // Records that `num_mutants` mutants were executed for every element
+  // in `indices` (indices of active records) and that those mutants produced
+  // `num_new_features` new features. Updates the weights accordingly:
+  // records whose mutants keep producing nothing new lose energy,
+  // records whose mutants reach new (hence rare) features gain energy.
+  // The new features can not be attributed to the individual records (the
+  // mutants of a batch are produced from all of them at once), so every record
+  // is credited with an equal share of them, rounded up.
+  // Only the changed weights are updated; the distribution is recomputed by
+  // the next WeightedRandomIndex().
+  void UpdateEnergy(const std::vector<size_t> &indices, size_t num_mutants,
+                    size_t num_new_features);
   // Returns the element with index 'idx', where `idx` < NumActive().
   const ByteArray &Get(size_t idx) const { return records_[idx].data; }
+  // Returns the record with index `idx`, where `idx` < NumActive().
+  const CorpusRecord &GetRecord(size_t idx) const { return records_[idx]; }
   // Returns the cmp_args for the element `idx`, `idx` < NumActive().
   ByteSpan GetCmpArgs(size_t idx) const { return records_[idx].cmp_args; }
   // Removes elements that contain only frequent features, according to 'fs'.
@@ -0,0 +1,365 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./corpus_exchange.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "./defs.h"
+#include "./feature.h"
+#include "./logging.h"
+#include "./util.h"
+
+namespace centipede {
+
+namespace {
+
+// Message types.
+enum : uint32_t {
+  kPublish = 1,
+  kPoll = 2,
+  kResponse = 3,
+};
+
+// Larger messages are treated as corrupted.
+constexpr uint64_t kMaxPayloadSize = 1ULL << 32;
+
+bool WriteAll(int fd, const void *data, size_t size) {
+  auto *ptr = static_cast<const uint8_t *>(data);
+  while (size) {
+    // MSG_NOSIGNAL: report a closed connection as an error, not SIGPIPE.
+    ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool ReadAll(int fd, void *data, size_t size) {
+  auto *ptr = static_cast<uint8_t *>(data);
+  while (size) {
+    ssize_t n = read(fd, ptr, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool SendMessage(int fd, uint32_t type, const ByteArray &payload) {
+  const uint64_t size = payload.size();
+  return WriteAll(fd, &type, sizeof(type)) &&
+         WriteAll(fd, &size, sizeof(size)) &&
+         WriteAll(fd, payload.data(), payload.size());
+}
+
+bool ReceiveMessage(int fd, uint32_t &type, ByteArray &payload) {
+  uint64_t size = 0;
+  if (!ReadAll(fd, &type, sizeof(type)) || !ReadAll(fd, &size, sizeof(size)))
+    return false;
+  if (size > kMaxPayloadSize) return false;
+  payload.resize(size);
+  return ReadAll(fd, payload.data(), size);
+}
+
+void AppendBlob(ByteArray &out, const void *data, uint64_t size) {
+  auto *size_bytes = reinterpret_cast<const uint8_t *>(&size);
+  out.insert(out.end(), size_bytes, size_bytes + sizeof(size));
+  auto *bytes = static_cast<const uint8_t *>(data);
+  out.insert(out.end(), bytes, bytes + size);
+}
+
+// Reads one blob from the beginning of `in` into `blob`, advances `in`.
+bool ReadBlob(ByteSpan &in, ByteSpan &blob) {
+  uint64_t size = 0;
+  if (in.size() < sizeof(size)) return false;
+  memcpy(&size, in.data(), sizeof(size));
+  in.remove_prefix(sizeof(size));
+  if (in.size() < size) return false;
+  blob = in.subspan(0, size);
+  in.remove_prefix(size);
+  return true;
+}
+
+void AppendInput(ByteArray &out, const ExchangedInput &input) {
+  AppendBlob(out, input.data.data(), input.data.size());
+  AppendBlob(out, input.features.data(),
+             input.features.size() * sizeof(input.features[0]));
+}
+
+bool ReadInput(ByteSpan &in, ExchangedInput &input) {
+  ByteSpan data, features;
+  if (!ReadBlob(in, data) || !ReadBlob(in, features)) return false;
+  if (features.size() % sizeof(feature_t)) return false;
+  input.data.assign(data.begin(), data.end());
+  input.features.resize(features.size() / sizeof(feature_t));
+  memcpy(input.features.data(), features.data(), features.size());
+  return true;
+}
+
+// Fills `addr` for `socket_path`. Returns false if the path is too long.
+bool MakeSocketAddress(std::string_view socket_path, sockaddr_un &addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) return false;
+  memcpy(addr.sun_path, socket_path.data(), socket_path.size());
+  return true;
+}
+
+}  // namespace
+
+//================= CorpusExchangeServer
+
+CorpusExchangeServer::CorpusExchangeServer(std::string_view socket_path,
+                                           size_t max_inputs_per_space)
+    : socket_path_(socket_path), max_inputs_per_space_(max_inputs_per_space) {
+  sockaddr_un addr;
+  if (!MakeSocketAddress(socket_path_, addr)) {
+    LOG(INFO) << "Corpus exchange: socket path too long: " << socket_path_;
+    return;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return;
+  unlink(socket_path_.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    LOG(INFO) << "Corpus exchange: failed to listen on " << socket_path_
+              << ": " << strerror(errno);
+    close(fd);
+    return;
+  }
+  listen_fd_ = fd;
+  accept_thread_ = std::thread(&CorpusExchangeServer::AcceptLoop, this);
+}
+
+CorpusExchangeServer::~CorpusExchangeServer() {
+  if (!ok()) return;
+  stopping_ = true;
+  // Wakes up accept().
+  shutdown(listen_fd_, SHUT_RDWR);
+  accept_thread_.join();
+  close(listen_fd_);
+  {
+    // Wakes up the connection threads.
+    absl::MutexLock lock(&mu_);
+    for (int fd : connection_fds_) shutdown(fd, SHUT_RDWR);
+  }
+  for (auto &[connection_id, thread] : connection_threads_) thread.join();
+  unlink(socket_path_.c_str());
+}
+
+void CorpusExchangeServer::AcceptLoop() {
+  size_t connection_id = 0;
+  while (!stopping_) {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;  // Stopping or a fatal error.
+    }
+    std::vector<size_t> finished_connections;
+    {
+      absl::MutexLock lock(&mu_);
+      if (stopping_) {
+        close(fd);
+        break;
+      }
+      connection_fds_.insert(fd);
+      finished_connections.swap(finished_connections_);
+    }
+    // Join the threads of the closed connections, so that they don't pile up.
+    for (size_t finished : finished_connections) {
+      auto it = connection_threads_.find(finished);
+      it->second.join();
+      connection_threads_.erase(it);
+    }
+    connection_threads_.emplace(
+        connection_id,
+        std::thread(&CorpusExchangeServer::ServeConnection, this, fd,
+                    connection_id));
+    ++connection_id;
+  }
+}
+
+void CorpusExchangeServer::ServeConnection(int fd, size_t connection_id) {
+  // For every space, the index of the next input to deliver, among all novel
+  // inputs of that space (see Space::first_input_index).
+  absl::flat_hash_map<std::string, size_t> cursors;
+  uint32_t type = 0;
+  ByteArray request, response;
+  while (ReceiveMessage(fd, type, request)) {
+    ByteSpan in = request;
+    ByteSpan space_name;
+    if (!ReadBlob(in, space_name)) break;
+    const std::string space_key(space_name.begin(), space_name.end());
+    response.clear();
+    if (type == kPublish) {
+      std::vector<ExchangedInput> inputs;
+      bool corrupted = false;
+      while (!in.empty() && !corrupted) {
+        corrupted = !ReadInput(in, inputs.emplace_back());
+      }
+      if (corrupted) break;
+      uint64_t num_novel = 0;
+      absl::MutexLock lock(&mu_);
+      auto &space = spaces_[space_key];
+      for (auto &input : inputs) {
+        bool novel = false;
+        for (auto feature : input.features) {
+          novel |= space.features.insert(feature).second;
+        }
+        if (!novel) continue;
+        ++num_novel;
+        space.inputs.push_back(std::move(input));
+        space.publishers.push_back(connection_id);
+      }
+      // Drop the oldest inputs. The connections that didn't poll them yet
+      // skip them, see kPoll.
+      while (space.inputs.size() > max_inputs_per_space_) {
+        space.inputs.pop_front();
+        space.publishers.pop_front();
+        ++space.first_input_index;
+        ++num_dropped_;
+      }
+      num_published_ += inputs.size();
+      num_novel_ += num_novel;
+      AppendBlob(response, &num_novel, sizeof(num_novel));
+    } else if (type == kPoll) {
+      absl::MutexLock lock(&mu_);
+      auto &space = spaces_[space_key];
+      auto &cursor = cursors[space_key];
+      cursor = std::max(cursor, space.first_input_index);
+      const size_t end = space.first_input_index + space.inputs.size();
+      for (; cursor < end; ++cursor) {
+        const size_t i = cursor - space.first_input_index;
+        if (space.publishers[i] == connection_id) continue;
+        AppendInput(response, space.inputs[i]);
+        ++num_delivered_;
+      }
+    } else {
+      break;  // Unknown request.
+    }
+    if (!SendMessage(fd, kResponse, response)) break;
+  }
+  absl::MutexLock lock(&mu_);
+  connection_fds_.erase(fd);
+  close(fd);
+  finished_connections_.push_back(connection_id);
+}
+
+std::string CorpusExchangeServer::StatsString() const {
+  absl::MutexLock lock(&mu_);
+  return absl::StrCat("Corpus exchange: connections: ", connection_fds_.size(),
+                      " spaces: ", spaces_.size(),
+                      " published: ", num_published_, " novel: ", num_novel_,
+                      " delivered: ", num_delivered_,
+                      " dropped: ", num_dropped_);
+}
+
+int RunCorpusExchangeServer(std::string_view socket_path) {
+  CorpusExchangeServer server(socket_path);
+  if (!server.ok()) return EXIT_FAILURE;
+  LOG(INFO) << "Corpus exchange: serving on " << socket_path;
+  for (size_t seconds = 1; !EarlyExitRequested(); ++seconds) {
+    sleep(1);
+    if (seconds % 60 == 0) LOG(INFO) << server.StatsString();
+  }
+  LOG(INFO) << server.StatsString();
+  return EXIT_SUCCESS;
+}
+
+//================= CorpusExchangeClient
+
+CorpusExchangeClient::CorpusExchangeClient(std::string_view socket_path,
+                                           std::string_view space)
+    : space_(space) {
+  sockaddr_un addr;
+  if (!MakeSocketAddress(socket_path, addr)) return;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return;
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return;
+  }
+  fd_ = fd;
+}
+
+CorpusExchangeClient::~CorpusExchangeClient() { Disconnect(); }
+
+void CorpusExchangeClient::Disconnect() {
+  if (fd_ < 0) return;
+  close(fd_);
+  fd_ = -1;
+}
+
+bool CorpusExchangeClient::Call(uint32_t type, const ByteArray &request,
+                                ByteArray &response) {
+  if (!connected()) return false;
+  uint32_t response_type = 0;
+  if (SendMessage(fd_, type, request) &&
+      ReceiveMessage(fd_, response_type, response) &&
+      response_type == kResponse) {
+    return true;
+  }
+  Disconnect();
+  return false;
+}
+
+bool CorpusExchangeClient::Publish(const std::vector<ExchangedInput> &inputs,
+                                   size_t &num_novel) {
+  ByteArray request, response;
+  AppendBlob(request, space_.data(), space_.size());
+  for (const auto &input : inputs) AppendInput(request, input);
+  if (!Call(kPublish, request, response)) return false;
+  ByteSpan in = response;
+  ByteSpan blob;
+  uint64_t num_novel64 = 0;
+  if (!ReadBlob(in, blob) || blob.size() != sizeof(num_novel64)) return false;
+  memcpy(&num_novel64, blob.data(), sizeof(num_novel64));
+  num_novel = num_novel64;
+  return true;
+}
+
+bool CorpusExchangeClient::Poll(std::vector<ExchangedInput> &inputs) {
+  inputs.clear();
+  ByteArray request, response;
+  AppendBlob(request, space_.data(), space_.size());
+  if (!Call(kPoll, request, response)) return false;
+  ByteSpan in = response;
+  ExchangedInput input;
+  while (!in.empty()) {
+    if (!ReadInput(in, input)) return false;
+    inputs.push_back(input);
+  }
+  return true;
+}
+
+}  // namespace centipede
@@ -0,0 +1,174 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Local corpus exchange, see --corpus_exchange.
+//
+// Centipede processes (and threads) running on the same host may exchange
+// newly found inputs via a coordinator reached over a Unix domain socket.
+// Every client publishes the inputs it added to its corpus, along with their
+// features. The coordinator maintains the global view of the features
+// observed so far and keeps only the inputs that are novel w.r.t. that view.
+// Every client then polls the novel inputs published by other clients.
+//
+// The exchange is in-memory only: every input is still stored durably in the
+// corpus and features files of the shard that found it, and the file-based
+// sharing (--load_other_shard_frequency) works as before. If the coordinator
+// is unreachable, the clients simply continue without it.
+//
+// The coordinator maintains separate feature views for different "spaces"
+// (Centipede uses the hash of the target binary), so that one coordinator
+// may serve several targets. Only the most recent novel inputs of every space
+// are kept in memory: a client that polls too rarely (or joins late) misses
+// the older ones, which it can still get from the files of other shards.
+//
+// Wire format: every message is
+//   [4-byte type][8-byte payload size][payload]
+// where the payload is a sequence of [8-byte size][bytes] blobs.
+
+#ifndef THIRD_PARTY_CENTIPEDE_CORPUS_EXCHANGE_H_
+#define THIRD_PARTY_CENTIPEDE_CORPUS_EXCHANGE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "./defs.h"
+#include "./feature.h"
+
+namespace centipede {
+
+// One input with its features, as exchanged via the coordinator.
+struct ExchangedInput {
+  ByteArray data;
+  FeatureVec features;
+
+  bool operator==(const ExchangedInput &other) const {
+    return data == other.data && features == other.features;
+  }
+};
+
+// The coordinator. Serves every connection in a separate thread.
+// This class is thread-safe.
+class CorpusExchangeServer {
+ public:
+  // The default max number of novel inputs kept per space.
+  static constexpr size_t kDefaultMaxInputsPerSpace = 1 << 14;
+
+  // Starts serving on `socket_path` (removes the existing file, if any).
+  // Keeps at most `max_inputs_per_space` most recent novel inputs per space.
+  // Check ok() to see if that succeeded.
+  explicit CorpusExchangeServer(
+      std::string_view socket_path,
+      size_t max_inputs_per_space = kDefaultMaxInputsPerSpace);
+  // Stops serving, closes all connections, removes the socket file.
+  ~CorpusExchangeServer();
+
+  CorpusExchangeServer(const CorpusExchangeServer &) = delete;
+  CorpusExchangeServer &operator=(const CorpusExchangeServer &) = delete;
+
+  // Returns true if the server is listening.
+  bool ok() const { return listen_fd_ >= 0; }
+
+  // Returns a string with the exchange stats, for logging.
+  std::string StatsString() const;
+
+ private:
+  // The state of one space.
+  struct Space {
+    // All features observed in this space.
+    absl::flat_hash_set<feature_t> features;
+    // The most recent novel inputs, in the order they were published, and
+    // the ids of the connections that published them.
+    std::deque<ExchangedInput> inputs;
+    std::deque<size_t> publishers;
+    // The number of older inputs dropped from the front of `inputs`, i.e.
+    // the index of inputs[0] among all novel inputs of this space.
+    size_t first_input_index = 0;
+  };
+
+  // Accepts connections until stopped.
+  void AcceptLoop();
+  // Serves the connection `fd`, whose id is `connection_id`.
+  void ServeConnection(int fd, size_t connection_id);
+
+  const std::string socket_path_;
+  const size_t max_inputs_per_space_;
+  int listen_fd_ = -1;
+  std::atomic<bool> stopping_{false};
+
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<std::string, Space> spaces_ ABSL_GUARDED_BY(mu_);
+  // Open connections, to be shut down when stopping.
+  absl::flat_hash_set<int> connection_fds_ ABSL_GUARDED_BY(mu_);
+  size_t num_published_ ABSL_GUARDED_BY(mu_) = 0;
+  size_t num_novel_ ABSL_GUARDED_BY(mu_) = 0;
+  size_t num_delivered_ ABSL_GUARDED_BY(mu_) = 0;
+  size_t num_dropped_ ABSL_GUARDED_BY(mu_) = 0;
+  // The ids of the connections whose threads are done and can be joined.
+  std::vector<size_t> finished_connections_ ABSL_GUARDED_BY(mu_);
+
+  // The connection threads by connection id. Used only by AcceptLoop(), which
+  // joins the finished ones, and by the destructor.
+  absl::flat_hash_map<size_t, std::thread> connection_threads_;
+  std::thread accept_thread_;
+};
+
+// Runs the coordinator on `socket_path` until early exit is requested
+// (e.g. on SIGINT). Returns the exit code.
+int RunCorpusExchangeServer(std::string_view socket_path);
+
+// A connection to the coordinator.
+// This class is thread-compatible.
+class CorpusExchangeClient {
+ public:
+  // Connects to the coordinator at `socket_path`, to exchange the inputs
+  // in `space`. Check connected() to see if that succeeded.
+  CorpusExchangeClient(std::string_view socket_path, std::string_view space);
+  ~CorpusExchangeClient();
+
+  CorpusExchangeClient(const CorpusExchangeClient &) = delete;
+  CorpusExchangeClient &operator=(const CorpusExchangeClient &) = delete;
+
+  // Returns true if connected. The client disconnects on any I/O error.
+  bool connected() const { return fd_ >= 0; }
+
+  // Publishes `inputs`. Sets `num_novel` to the number of them found novel
+  // by the coordinator. Returns false on failure.
+  bool Publish(const std::vector<ExchangedInput> &inputs, size_t &num_novel);
+
+  // Replaces the contents of `inputs` with the novel inputs published by the
+  // other clients since the previous Poll(). Returns false on failure.
+  bool Poll(std::vector<ExchangedInput> &inputs);
+
+ private:
+  // Sends a request and receives the response. Disconnects on failure.
+  bool Call(uint32_t type, const ByteArray &request, ByteArray &response);
+  void Disconnect();
+
+  const std::string space_;
+  int fd_ = -1;
+};
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_CORPUS_EXCHANGE_H_
@@ -0,0 +1,126 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./corpus_exchange.h"
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+#include "./defs.h"
+#include "./test_util.h"
+
+namespace centipede {
+namespace {
+
+using Inputs = std::vector<ExchangedInput>;
+
+std::string SocketPath() {
+  return std::filesystem::path(GetTestTempDir()).append("exchange.sock");
+}
+
+TEST(CorpusExchange, PublishAndPoll) {
+  CorpusExchangeServer server(SocketPath());
+  ASSERT_TRUE(server.ok());
+  CorpusExchangeClient a(SocketPath(), "space");
+  CorpusExchangeClient b(SocketPath(), "space");
+  CorpusExchangeClient other_space(SocketPath(), "other");
+  ASSERT_TRUE(a.connected());
+  ASSERT_TRUE(b.connected());
+  ASSERT_TRUE(other_space.connected());
+
+  size_t num_novel = 0;
+  // {2} is not novel after {1, 2}.
+  EXPECT_TRUE(a.Publish({{{1}, {1, 2}}, {{2}, {2}}}, num_novel));
+  EXPECT_EQ(num_novel, 1);
+  // {4} is not novel, it was already published by `a`.
+  EXPECT_TRUE(b.Publish({{{3}, {3}}, {{4}, {1}}}, num_novel));
+  EXPECT_EQ(num_novel, 1);
+
+  // Every client gets only the novel inputs from the other clients.
+  Inputs inputs;
+  EXPECT_TRUE(a.Poll(inputs));
+  EXPECT_EQ(inputs, (Inputs{{{3}, {3}}}));
+  EXPECT_TRUE(b.Poll(inputs));
+  EXPECT_EQ(inputs, (Inputs{{{1}, {1, 2}}}));
+  // Nothing new since the last poll.
+  EXPECT_TRUE(a.Poll(inputs));
+  EXPECT_TRUE(inputs.empty());
+  // Spaces are independent.
+  EXPECT_TRUE(other_space.Poll(inputs));
+  EXPECT_TRUE(inputs.empty());
+  EXPECT_TRUE(other_space.Publish({{{5}, {1}}}, num_novel));
+  EXPECT_EQ(num_novel, 1);
+  EXPECT_TRUE(a.Poll(inputs));
+  EXPECT_TRUE(inputs.empty());
+
+  // A late client gets everything published so far.
+  CorpusExchangeClient late(SocketPath(), "space");
+  EXPECT_TRUE(late.Poll(inputs));
+  EXPECT_EQ(inputs, (Inputs{{{1}, {1, 2}}, {{3}, {3}}}));
+}
+
+TEST(CorpusExchange, OldInputsAreDropped) {
+  CorpusExchangeServer server(SocketPath(), /*max_inputs_per_space=*/2);
+  ASSERT_TRUE(server.ok());
+  CorpusExchangeClient a(SocketPath(), "space");
+  CorpusExchangeClient b(SocketPath(), "space");
+
+  size_t num_novel = 0;
+  EXPECT_TRUE(a.Publish({{{1}, {1}}}, num_novel));
+  Inputs inputs;
+  EXPECT_TRUE(b.Poll(inputs));
+  EXPECT_EQ(inputs, (Inputs{{{1}, {1}}}));
+  EXPECT_TRUE(a.Publish({{{2}, {2}}, {{3}, {3}}, {{4}, {4}}}, num_novel));
+  EXPECT_EQ(num_novel, 3);
+  // {2} was dropped before `b` polled it.
+  EXPECT_TRUE(b.Poll(inputs));
+  EXPECT_EQ(inputs, (Inputs{{{3}, {3}}, {{4}, {4}}}));
+  EXPECT_TRUE(b.Poll(inputs));
+  EXPECT_TRUE(inputs.empty());
+  // Dropped inputs are still known: they are not novel.
+  EXPECT_TRUE(b.Publish({{{5}, {2}}}, num_novel));
+  EXPECT_EQ(num_novel, 0);
+
+  // Closed connections don't keep anything alive, new ones still work.
+  for (int i = 0; i < 10; ++i) {
+    CorpusExchangeClient client(SocketPath(), "space");
+    EXPECT_TRUE(client.Poll(inputs));
+    EXPECT_EQ(inputs, (Inputs{{{3}, {3}}, {{4}, {4}}}));
+  }
+  EXPECT_NE(server.StatsString().find("dropped: 2"), std::string::npos);
+}
+
+TEST(CorpusExchange, NoServer) {
+  auto server = std::make_unique<CorpusExchangeServer>(SocketPath());
+  ASSERT_TRUE(server->ok());
+  CorpusExchangeClient client(SocketPath(), "space");
+  EXPECT_TRUE(client.connected());
+  server.reset();
+
+  // The server is gone: the client disconnects.
+  Inputs inputs;
+  EXPECT_FALSE(client.Poll(inputs));
+  EXPECT_FALSE(client.connected());
+  size_t num_novel = 0;
+  EXPECT_FALSE(client.Publish({{{1}, {1}}}, num_novel));
+
+  CorpusExchangeClient no_server(SocketPath(), "space");
+  EXPECT_FALSE(no_server.connected());
+}
+
+}  // namespace
+}  // namespace centipede
@@ -259,6 +259,74 @@ TEST(Corpus, PruneRegressionTest1) {
   corpus.Prune(fs, coverage_frontier, max_corpus_size, rng);
 }
 
+TEST(Corpus, UpdateEnergy) {
+  Coverage::PCTable pc_table(100);
+  CoverageFrontier coverage_frontier(pc_table);
+  FeatureSet fs(3);
+  Corpus corpus;
+  FeatureVec features1 = {10};
+  FeatureVec features2 = {20};
+  fs.IncrementFrequencies(features1);
+  fs.IncrementFrequencies(features2);
+  corpus.Add({1}, features1, {}, fs, coverage_frontier);
+  corpus.Add({2}, features2, {}, fs, coverage_frontier);
+  const auto base_weight = corpus.GetRecord(0).base_weight;
+  EXPECT_GT(base_weight, 0);
+  EXPECT_EQ(corpus.GetRecord(1).base_weight, base_weight);
+
+  // Counts how many times each of the two records is chosen.
+  auto CountChoices = [&]() {
+    std::vector<size_t> counts(2);
+    for (size_t i = 0; i < 10000; ++i) ++counts[corpus.WeightedRandomIndex(i)];
+    return counts;
+  };
+  auto counts = CountChoices();
+  EXPECT_NEAR(counts[0], counts[1], 500);
+
+  // Record 0 doesn't produce anything new for a long time => decays.
+  corpus.UpdateEnergy({0}, 1000000, 0);
+  EXPECT_EQ(corpus.GetRecord(0).num_mutants, 1000000);
+  EXPECT_EQ(corpus.GetRecord(0).num_unproductive_mutants, 1000000);
+  counts = CountChoices();
+  EXPECT_GT(counts[1], counts[0] * 100);
+  // Decayed, but still not zero, so that Prune() doesn't discard it.
+  EXPECT_GT(counts[0], 0);
+
+  // Record 0 produced new features => the decay is reset and it gets boosted.
+  corpus.UpdateEnergy({0}, 1, 3);
+  EXPECT_EQ(corpus.GetRecord(0).num_mutants, 1000001);
+  EXPECT_EQ(corpus.GetRecord(0).num_unproductive_mutants, 0);
+  EXPECT_EQ(corpus.GetRecord(0).num_new_features, 3);
+  counts = CountChoices();
+  EXPECT_GT(counts[0], counts[1] * 3);
+
+  // Prune() recomputes the base weights, but keeps the energy.
+  Rng rng(0);
+  EXPECT_EQ(corpus.Prune(fs, coverage_frontier, 1000, rng), 0);
+  EXPECT_EQ(CountChoices(), counts);
+}
+
+TEST(Corpus, MemoryHungryRecordsLoseEnergy) {
+  Coverage::PCTable pc_table(100);
+  CoverageFrontier coverage_frontier(pc_table);
+  FeatureSet fs(3);
+  Corpus corpus;
+  FeatureVec features1 = {10};
+  FeatureVec features2 = {20};
+  fs.IncrementFrequencies(features1);
+  fs.IncrementFrequencies(features2);
+  corpus.Add({1}, features1, {}, fs, coverage_frontier,
+             /*peak_heap_bytes=*/1ULL << 30);
+  corpus.Add({2}, features2, {}, fs, coverage_frontier,
+             /*peak_heap_bytes=*/1ULL << 20);
+  EXPECT_EQ(corpus.GetRecord(0).peak_heap_bytes, 1ULL << 30);
+  std::vector<size_t> counts(2);
+  for (size_t i = 0; i < 10000; ++i) ++counts[corpus.WeightedRandomIndex(i)];
+  // 1Gb is 4 doublings above the threshold.
+  EXPECT_GT(counts[1], counts[0] * 10);
+  EXPECT_GT(counts[0], 0);
+}
+
 TEST(WeightedDistribution, WeightedDistribution) {
   std::vector<uint32_t> freq;
   WeightedDistribution wd;
@@ -353,6 +421,16 @@ TEST(WeightedDistribution, WeightedDistribution) {
   compute_freq();
 }
 
+TEST(WeightedDistribution, LargeWeightsDontOverflow) {
+  WeightedDistribution wd;
+  // The sum of the weights doesn't fit into 32 bits.
+  const uint32_t kWeight = 3'000'000'000;
+  for (int i = 0; i < 4; i++) wd.AddWeight(kWeight);
+  std::vector<size_t> freq(wd.size());
+  for (uint64_t i = 0; i < 4; i++) freq[wd.RandomIndex(i * kWeight + 1)]++;
+  EXPECT_EQ(freq, std::vector<size_t>({1, 1, 1, 1}));
+}
+
 TEST(CoverageFrontier, Compute) {
   // Function [0, 1): Fully covered.
   // Function [1, 2): Not covered.
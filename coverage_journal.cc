@@ -0,0 +1,236 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./coverage_journal.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "./logging.h"
+
+namespace centipede {
+
+namespace {
+
+constexpr size_t kNumColumns = 13;
+
+// A point of a coverage curve: covered PCs (y) at wall or CPU time (x).
+struct Point {
+  double x;
+  double y;
+};
+using Curve = std::vector<Point>;
+
+// Returns the value of the step function `curve` at `x`: the value of the last
+// point at or before `x`, or the value of the first point if there is none.
+double ValueAt(const Curve &curve, double x) {
+  CHECK(!curve.empty());
+  auto it = std::upper_bound(curve.begin(), curve.end(), x,
+                             [](double x, const Point &p) { return x < p.x; });
+  if (it == curve.begin()) return curve.front().y;
+  return std::prev(it)->y;
+}
+
+// Returns the mean of the step functions `curves`, with a point at every
+// point of every curve up to the end of the shortest curve.
+Curve MeanCurve(const std::vector<Curve> &curves) {
+  CHECK(!curves.empty());
+  double horizon = curves.front().back().x;
+  for (const auto &curve : curves) horizon = std::min(horizon, curve.back().x);
+  std::vector<double> xs;
+  for (const auto &curve : curves) {
+    for (const auto &point : curve) {
+      if (point.x <= horizon) xs.push_back(point.x);
+    }
+  }
+  xs.push_back(horizon);
+  std::sort(xs.begin(), xs.end());
+  xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+  Curve mean;
+  mean.reserve(xs.size());
+  for (double x : xs) {
+    double sum = 0;
+    for (const auto &curve : curves) sum += ValueAt(curve, x);
+    mean.push_back({x, sum / curves.size()});
+  }
+  return mean;
+}
+
+// Returns the area under the step function `curve` from zero to its last
+// point, divided by the length of that interval: the average value.
+double AverageValue(const Curve &curve) {
+  CHECK(!curve.empty());
+  const double horizon = curve.back().x;
+  if (horizon <= 0) return curve.back().y;
+  double area = 0;
+  double prev_x = 0;
+  double prev_y = curve.front().y;
+  for (const auto &point : curve) {
+    area += prev_y * (point.x - prev_x);
+    prev_x = point.x;
+    prev_y = point.y;
+  }
+  return area / horizon;
+}
+
+// Returns the first x at which `curve` reaches `fraction` of its final value.
+double TimeToPlateau(const Curve &curve, double fraction) {
+  CHECK(!curve.empty());
+  const double target = fraction * curve.back().y;
+  for (const auto &point : curve) {
+    if (point.y >= target) return point.x;
+  }
+  return curve.back().x;
+}
+
+}  // namespace
+
+bool CoverageJournalEntry::operator==(const CoverageJournalEntry &other) const {
+  return experiment == other.experiment && seconds == other.seconds &&
+         num_execs == other.num_execs && num_features == other.num_features &&
+         counters == other.counters && data_flow == other.data_flow &&
+         cmp == other.cmp && bounded_path == other.bounded_path &&
+         pc_pair == other.pc_pair && covered_pcs == other.covered_pcs &&
+         corpus_size == other.corpus_size &&
+         engine_cpu_seconds == other.engine_cpu_seconds &&
+         runner_cpu_seconds == other.runner_cpu_seconds;
+}
+
+std::string CoverageJournalHeader() {
+  return "experiment,seconds,execs,features,counters,data_flow,cmp,"
+         "bounded_path,pc_pair,covered_pcs,corpus_size,engine_cpu_seconds,"
+         "runner_cpu_seconds\n";
+}
+
+std::string CoverageJournalLine(const CoverageJournalEntry &entry) {
+  return absl::StrFormat("%s,%.3f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.3f,%.3f\n",
+                         entry.experiment, entry.seconds, entry.num_execs,
+                         entry.num_features, entry.counters, entry.data_flow,
+                         entry.cmp, entry.bounded_path, entry.pc_pair,
+                         entry.covered_pcs, entry.corpus_size,
+                         entry.engine_cpu_seconds, entry.runner_cpu_seconds);
+}
+
+std::vector<CoverageJournalEntry> ParseCoverageJournal(
+    std::string_view contents) {
+  std::vector<CoverageJournalEntry> entries;
+  for (std::string_view line : absl::StrSplit(contents, '\n')) {
+    if (line.empty() || absl::StartsWith(line, "experiment,")) continue;
+    const std::vector<std::string_view> fields = absl::StrSplit(line, ',');
+    CoverageJournalEntry entry;
+    if (fields.size() != kNumColumns ||
+        !absl::SimpleAtod(fields[1], &entry.seconds) ||
+        !absl::SimpleAtoi(fields[2], &entry.num_execs) ||
+        !absl::SimpleAtoi(fields[3], &entry.num_features) ||
+        !absl::SimpleAtoi(fields[4], &entry.counters) ||
+        !absl::SimpleAtoi(fields[5], &entry.data_flow) ||
+        !absl::SimpleAtoi(fields[6], &entry.cmp) ||
+        !absl::SimpleAtoi(fields[7], &entry.bounded_path) ||
+        !absl::SimpleAtoi(fields[8], &entry.pc_pair) ||
+        !absl::SimpleAtoi(fields[9], &entry.covered_pcs) ||
+        !absl::SimpleAtoi(fields[10], &entry.corpus_size) ||
+        !absl::SimpleAtod(fields[11], &entry.engine_cpu_seconds) ||
+        !absl::SimpleAtod(fields[12], &entry.runner_cpu_seconds)) {
+      LOG(INFO) << "Skipping malformed coverage journal line: " << line;
+      continue;
+    }
+    entry.experiment = std::string(fields[0]);
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+std::vector<CoverageCurveSummary> SummarizeCoverageJournals(
+    const std::vector<std::vector<CoverageJournalEntry>> &journals,
+    const std::vector<std::string> &default_arms, double plateau_fraction) {
+  CHECK_EQ(journals.size(), default_arms.size());
+  // The curves of the journals of every arm. All lines of a journal have the
+  // same experiment name.
+  struct ArmCurves {
+    std::vector<Curve> by_time;
+    std::vector<Curve> by_cpu;
+    std::vector<Curve> execs_by_time;
+  };
+  std::map<std::string, ArmCurves> arms;
+  for (size_t i = 0; i < journals.size(); ++i) {
+    const auto &journal = journals[i];
+    if (journal.empty()) continue;
+    const std::string &arm = journal.front().experiment.empty()
+                                 ? default_arms[i]
+                                 : journal.front().experiment;
+    Curve by_time, by_cpu, execs_by_time;
+    for (const auto &entry : journal) {
+      const double covered_pcs = static_cast<double>(entry.covered_pcs);
+      by_time.push_back({entry.seconds, covered_pcs});
+      by_cpu.push_back(
+          {entry.engine_cpu_seconds + entry.runner_cpu_seconds, covered_pcs});
+      execs_by_time.push_back(
+          {entry.seconds, static_cast<double>(entry.num_execs)});
+    }
+    auto &curves = arms[arm];
+    curves.by_time.push_back(std::move(by_time));
+    curves.by_cpu.push_back(std::move(by_cpu));
+    curves.execs_by_time.push_back(std::move(execs_by_time));
+  }
+
+  std::vector<CoverageCurveSummary> summaries;
+  for (const auto &[arm, curves] : arms) {
+    const Curve by_time = MeanCurve(curves.by_time);
+    const Curve by_cpu = MeanCurve(curves.by_cpu);
+    const Curve execs_by_time = MeanCurve(curves.execs_by_time);
+    CoverageCurveSummary summary;
+    summary.arm = arm;
+    summary.num_journals = curves.by_time.size();
+    summary.seconds = by_time.back().x;
+    summary.cpu_seconds = by_cpu.back().x;
+    summary.covered_pcs = by_time.back().y;
+    summary.num_execs = ValueAt(execs_by_time, summary.seconds);
+    summary.avg_covered_pcs = AverageValue(by_time);
+    summary.avg_covered_pcs_by_cpu = AverageValue(by_cpu);
+    summary.seconds_to_plateau = TimeToPlateau(by_time, plateau_fraction);
+    summary.cpu_seconds_to_plateau = TimeToPlateau(by_cpu, plateau_fraction);
+    summaries.push_back(std::move(summary));
+  }
+  return summaries;
+}
+
+std::string CoverageCurveSummariesToString(
+    const std::vector<CoverageCurveSummary> &summaries) {
+  std::string result = absl::StrFormat(
+      "%-12s %4s %9s %9s %12s %9s %9s %9s %11s %11s\n", "arm", "n", "seconds",
+      "cpu_sec", "execs", "cov", "avg_cov", "avg_cov/c", "plateau_s",
+      "plateau_c");
+  for (const auto &s : summaries) {
+    absl::StrAppendFormat(
+        &result,
+        "%-12s %4d %9.0f %9.0f %12.0f %9.1f %9.1f %9.1f %11.0f %11.0f\n", s.arm,
+        s.num_journals, s.seconds, s.cpu_seconds, s.num_execs, s.covered_pcs,
+        s.avg_covered_pcs, s.avg_covered_pcs_by_cpu, s.seconds_to_plateau,
+        s.cpu_seconds_to_plateau);
+  }
+  return result;
+}
+
+}  // namespace centipede
@@ -0,0 +1,102 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Coverage journals: the fuzzing progress of every shard over time, see
+// --coverage_journal_interval and --summarize_coverage_journals.
+//
+// A journal is a CSV file with a header line and one line per sample.
+// Journals of shards that fuzz the same configuration (the same experiment
+// arm, or the same workdir outside of experiments) are merged into one curve
+// per arm: the mean of the shards' covered PCs, as a step function of the
+// wall time or of the CPU time. The curves are summarized by their area
+// (the average coverage over the run) and by the time to plateau, so that
+// arms can be compared by the shape of their coverage growth and not only by
+// the final coverage.
+
+#ifndef THIRD_PARTY_CENTIPEDE_COVERAGE_JOURNAL_H_
+#define THIRD_PARTY_CENTIPEDE_COVERAGE_JOURNAL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace centipede {
+
+// One sample of a coverage journal.
+struct CoverageJournalEntry {
+  std::string experiment;     // Environment::experiment_name, may be empty.
+  double seconds = 0;         // Wall time since the start of fuzzing.
+  uint64_t num_execs = 0;     // Inputs executed since the start of fuzzing.
+  uint64_t num_features = 0;  // Features in all domains.
+  // Features in the individual domains.
+  uint64_t counters = 0;
+  uint64_t data_flow = 0;
+  uint64_t cmp = 0;
+  uint64_t bounded_path = 0;
+  uint64_t pc_pair = 0;
+  uint64_t covered_pcs = 0;
+  uint64_t corpus_size = 0;
+  double engine_cpu_seconds = 0;  // The CPU time of the engine thread.
+  double runner_cpu_seconds = 0;  // The CPU time of its runners, if known.
+
+  bool operator==(const CoverageJournalEntry &other) const;
+};
+
+// Returns the header line of a journal, with the trailing newline.
+std::string CoverageJournalHeader();
+// Returns `entry` as a journal line, with the trailing newline.
+std::string CoverageJournalLine(const CoverageJournalEntry &entry);
+// Parses the journal `contents`. Skips the header and malformed lines.
+std::vector<CoverageJournalEntry> ParseCoverageJournal(
+    std::string_view contents);
+
+// The merged curve of one arm.
+struct CoverageCurveSummary {
+  std::string arm;
+  size_t num_journals = 0;
+  // The horizon of the curves: the shortest of the merged journals, so that
+  // every journal contributes to every point of the curve.
+  double seconds = 0;
+  double cpu_seconds = 0;
+  // The mean coverage and executions of the journals at `seconds`.
+  double covered_pcs = 0;
+  double num_execs = 0;
+  // The average coverage over [0, seconds] and [0, cpu_seconds], i.e. the
+  // area under the curve divided by the horizon.
+  double avg_covered_pcs = 0;
+  double avg_covered_pcs_by_cpu = 0;
+  // The time at which the curve first reaches `plateau_fraction` of its final
+  // coverage, in wall and CPU seconds.
+  double seconds_to_plateau = 0;
+  double cpu_seconds_to_plateau = 0;
+};
+
+// Merges `journals` (each is a parsed journal of one shard) into one curve
+// per arm and summarizes the curves, ordered by arm. The arm of a journal is
+// its experiment name, or `default_arms[i]` for the i-th journal if the
+// experiment name is empty. Empty journals are ignored.
+std::vector<CoverageCurveSummary> SummarizeCoverageJournals(
+    const std::vector<std::vector<CoverageJournalEntry>> &journals,
+    const std::vector<std::string> &default_arms,
+    double plateau_fraction = 0.99);
+
+// Returns `summaries` as a human-readable table.
+std::string CoverageCurveSummariesToString(
+    const std::vector<CoverageCurveSummary> &summaries);
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_COVERAGE_JOURNAL_H_
@@ -0,0 +1,108 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./coverage_journal.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace centipede {
+namespace {
+
+// Returns a journal entry of `experiment` with `covered_pcs` at `seconds`,
+// where the engine and the runner each used one CPU second per second and the
+// target executed 100 inputs per second.
+CoverageJournalEntry Entry(std::string experiment, double seconds,
+                           uint64_t covered_pcs) {
+  CoverageJournalEntry entry;
+  entry.experiment = experiment;
+  entry.seconds = seconds;
+  entry.num_execs = 100 * seconds;
+  entry.covered_pcs = covered_pcs;
+  entry.engine_cpu_seconds = seconds;
+  entry.runner_cpu_seconds = seconds;
+  return entry;
+}
+
+TEST(CoverageJournal, WriteAndParse) {
+  CoverageJournalEntry entry;
+  entry.experiment = "E01";
+  entry.seconds = 1.5;
+  entry.num_execs = 2;
+  entry.num_features = 3;
+  entry.counters = 4;
+  entry.data_flow = 5;
+  entry.cmp = 6;
+  entry.bounded_path = 7;
+  entry.pc_pair = 8;
+  entry.covered_pcs = 9;
+  entry.corpus_size = 10;
+  entry.engine_cpu_seconds = 11.25;
+  entry.runner_cpu_seconds = 12.5;
+  EXPECT_EQ(CoverageJournalLine(entry),
+            "E01,1.500,2,3,4,5,6,7,8,9,10,11.250,12.500\n");
+  const std::string journal = CoverageJournalHeader() +
+                              CoverageJournalLine(entry) + "malformed\n" +
+                              CoverageJournalLine(Entry("", 2, 42));
+  const std::vector<CoverageJournalEntry> expected = {entry, Entry("", 2, 42)};
+  EXPECT_EQ(ParseCoverageJournal(journal), expected);
+}
+
+TEST(CoverageJournal, Summarize) {
+  const std::vector<std::vector<CoverageJournalEntry>> journals = {
+      {Entry("E01", 0, 10), Entry("E01", 10, 20), Entry("E01", 20, 30)},
+      {},  // Ignored.
+      {Entry("", 0, 5), Entry("", 5, 5)},
+      {Entry("E01", 0, 10), Entry("E01", 10, 40), Entry("E01", 30, 50)},
+  };
+  const auto summaries = SummarizeCoverageJournals(
+      journals, {"workdir_a", "workdir_a", "workdir_b", "workdir_a"});
+  ASSERT_EQ(summaries.size(), 2);
+
+  // The mean curve of E01 is 10 in [0, 10), 30 in [10, 20) and 35 at 20, the
+  // end of the shorter journal.
+  const auto &e01 = summaries[0];
+  EXPECT_EQ(e01.arm, "E01");
+  EXPECT_EQ(e01.num_journals, 2);
+  EXPECT_DOUBLE_EQ(e01.seconds, 20);
+  EXPECT_DOUBLE_EQ(e01.cpu_seconds, 40);
+  EXPECT_DOUBLE_EQ(e01.covered_pcs, 35);
+  EXPECT_DOUBLE_EQ(e01.num_execs, (2000 + 1000) / 2);
+  EXPECT_DOUBLE_EQ(e01.avg_covered_pcs, (10 * 10 + 30 * 10) / 20.);
+  EXPECT_DOUBLE_EQ(e01.avg_covered_pcs_by_cpu, (10 * 20 + 30 * 20) / 40.);
+  EXPECT_DOUBLE_EQ(e01.seconds_to_plateau, 20);
+  EXPECT_DOUBLE_EQ(e01.cpu_seconds_to_plateau, 40);
+
+  const auto &workdir_b = summaries[1];
+  EXPECT_EQ(workdir_b.arm, "workdir_b");
+  EXPECT_EQ(workdir_b.num_journals, 1);
+  EXPECT_DOUBLE_EQ(workdir_b.seconds, 5);
+  EXPECT_DOUBLE_EQ(workdir_b.avg_covered_pcs, 5);
+  EXPECT_DOUBLE_EQ(workdir_b.seconds_to_plateau, 0);
+
+  // A lower plateau is reached earlier.
+  EXPECT_DOUBLE_EQ(
+      SummarizeCoverageJournals(journals, {"a", "a", "b", "a"}, 0.8)[0]
+          .seconds_to_plateau,
+      10);
+
+  EXPECT_NE(CoverageCurveSummariesToString(summaries).find("workdir_b"),
+            std::string::npos);
+}
+
+}  // namespace
+}  // namespace centipede
@@ -0,0 +1,138 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./cpu_affinity.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "./logging.h"
+
+namespace centipede {
+
+namespace {
+
+// Reads an integer from a sysfs file. Returns `default_value` on failure.
+int ReadIntFromFile(const std::filesystem::path &path, int default_value) {
+  std::ifstream file(path);
+  int value = default_value;
+  if (!(file >> value)) return default_value;
+  return value;
+}
+
+}  // namespace
+
+CpuAffinityMode ParseCpuAffinityMode(std::string_view mode) {
+  if (mode.empty() || mode == "none") return CpuAffinityMode::kNone;
+  if (mode == "core") return CpuAffinityMode::kCore;
+  if (mode == "ht_pair") return CpuAffinityMode::kHtPair;
+  LOG(FATAL) << "Unknown --cpu_affinity value: " << mode;
+  return CpuAffinityMode::kNone;
+}
+
+std::vector<CpuInfo> GetAvailableCpus() {
+  std::vector<CpuInfo> result;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) return result;
+  // Maps (package, core_id) to a machine-wide core number.
+  std::map<std::pair<int, int>, int> cores;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &set)) continue;
+    const auto cpu_dir = std::filesystem::path("/sys/devices/system/cpu") /
+                         absl::StrCat("cpu", cpu);
+    const int package =
+        ReadIntFromFile(cpu_dir / "topology/physical_package_id", 0);
+    // Unknown topology: treat the CPU as a separate core.
+    const int core_id = ReadIntFromFile(cpu_dir / "topology/core_id", -1 - cpu);
+    const auto core = cores.emplace(std::make_pair(package, core_id),
+                                    static_cast<int>(cores.size()));
+    // The node is reported as a "nodeN" entry in the CPU's directory.
+    int numa_node = 0;
+    std::error_code error;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(cpu_dir, error)) {
+      const auto name = entry.path().filename().string();
+      if (absl::StartsWith(name, "node") &&
+          absl::SimpleAtoi(name.substr(4), &numa_node)) {
+        break;
+      }
+    }
+    result.push_back({cpu, numa_node, core.first->second});
+  }
+  return result;
+}
+
+std::vector<CpuPlacement> ComputeCpuPlacement(const std::vector<CpuInfo> &cpus,
+                                              size_t num_threads,
+                                              CpuAffinityMode mode) {
+  CHECK(mode != CpuAffinityMode::kNone);
+  CHECK(!cpus.empty());
+  // Group the CPUs by node, then by core.
+  std::map<std::pair<int, int>, std::vector<int>> cores;
+  for (const auto &cpu : cpus) {
+    cores[{cpu.numa_node, cpu.core}].push_back(cpu.cpu);
+  }
+
+  // The units of placement, in the order in which they are assigned.
+  std::vector<CpuPlacement> units;
+  if (mode == CpuAffinityMode::kHtPair) {
+    for (const auto &[node_and_core, core_cpus] : cores) {
+      units.push_back({core_cpus, node_and_core.first});
+    }
+  } else {
+    // Use the first logical CPU of every core first, then the second ones,
+    // and so on: threads share physical cores only if they have to.
+    for (size_t sibling = 0; units.size() < cpus.size(); ++sibling) {
+      for (const auto &[node_and_core, core_cpus] : cores) {
+        if (sibling >= core_cpus.size()) continue;
+        units.push_back({{core_cpus[sibling]}, node_and_core.first});
+      }
+    }
+  }
+
+  std::vector<CpuPlacement> placements;
+  placements.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    placements.push_back(units[i % units.size()]);
+  }
+  return placements;
+}
+
+bool PinThisThread(const CpuPlacement &placement) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : placement.cpus) CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+std::string CpuPlacementToString(const CpuPlacement &placement) {
+  return absl::StrCat("cpus: ", absl::StrJoin(placement.cpus, ","),
+                      " numa node: ", placement.numa_node);
+}
+
+}  // namespace centipede
@@ -0,0 +1,85 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Placement of the fuzzing threads (and hence their runner subprocesses)
+// on CPUs, see --cpu_affinity.
+
+#ifndef THIRD_PARTY_CENTIPEDE_CPU_AFFINITY_H_
+#define THIRD_PARTY_CENTIPEDE_CPU_AFFINITY_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace centipede {
+
+// One logical CPU and its place in the machine topology.
+struct CpuInfo {
+  int cpu = 0;        // Logical CPU number, as in sched_setaffinity().
+  int numa_node = 0;  // NUMA node of `cpu`.
+  int core = 0;       // Physical core: CPUs with the same `core` are siblings.
+
+  bool operator==(const CpuInfo &other) const {
+    return cpu == other.cpu && numa_node == other.numa_node &&
+           core == other.core;
+  }
+};
+
+// The set of CPUs one thread is pinned to.
+struct CpuPlacement {
+  std::vector<int> cpus;
+  int numa_node = 0;
+};
+
+// How threads are placed on CPUs.
+enum class CpuAffinityMode {
+  kNone,    // No pinning.
+  kCore,    // Every thread gets one logical CPU, on distinct physical cores
+            // as long as there are enough of them.
+  kHtPair,  // Every thread gets all logical CPUs of one physical core
+            // (e.g. a hyperthread pair).
+};
+
+// Parses the value of --cpu_affinity. CHECK-fails on unknown values.
+CpuAffinityMode ParseCpuAffinityMode(std::string_view mode);
+
+// Returns the CPUs this process is allowed to run on, with their topology,
+// as reported by sched_getaffinity() and /sys/devices/system/cpu.
+// CPUs with unknown topology are reported as their own core on node 0.
+std::vector<CpuInfo> GetAvailableCpus();
+
+// Computes the placement of `num_threads` threads on `cpus` according to
+// `mode` (which must not be kNone). Consecutive threads are placed on the same
+// NUMA node as long as it has free cores, so that threads stay close to the
+// memory they share. If there are fewer placement units than threads, the
+// units are reused round-robin. Returns one placement per thread.
+std::vector<CpuPlacement> ComputeCpuPlacement(const std::vector<CpuInfo> &cpus,
+                                              size_t num_threads,
+                                              CpuAffinityMode mode);
+
+// Pins the calling thread to `placement.cpus`. The processes later started by
+// this thread (runners, fork servers and their children) inherit the pinning.
+// Shared memory pages are allocated on the NUMA node of the thread that
+// touches them first, so pinning also keeps the shared memory of this
+// thread and its runner on `placement.numa_node`.
+// Returns false on failure.
+bool PinThisThread(const CpuPlacement &placement);
+
+// Returns a human-readable description of `placement`, for logging.
+std::string CpuPlacementToString(const CpuPlacement &placement);
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_CPU_AFFINITY_H_
@@ -0,0 +1,86 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./cpu_affinity.h"
+
+#include <sched.h>
+
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace centipede {
+namespace {
+
+// Two NUMA nodes, two cores per node, two hyperthreads per core,
+// numbered like on a typical Linux machine: siblings are N and N+4.
+std::vector<CpuInfo> TwoNodeMachine() {
+  return {
+      {0, 0, 0}, {1, 0, 1}, {2, 1, 2}, {3, 1, 3},
+      {4, 0, 0}, {5, 0, 1}, {6, 1, 2}, {7, 1, 3},
+  };
+}
+
+std::vector<std::vector<int>> Cpus(const std::vector<CpuPlacement> &ps) {
+  std::vector<std::vector<int>> result;
+  for (const auto &p : ps) result.push_back(p.cpus);
+  return result;
+}
+
+TEST(CpuAffinity, ParseCpuAffinityMode) {
+  EXPECT_EQ(ParseCpuAffinityMode(""), CpuAffinityMode::kNone);
+  EXPECT_EQ(ParseCpuAffinityMode("none"), CpuAffinityMode::kNone);
+  EXPECT_EQ(ParseCpuAffinityMode("core"), CpuAffinityMode::kCore);
+  EXPECT_EQ(ParseCpuAffinityMode("ht_pair"), CpuAffinityMode::kHtPair);
+  EXPECT_DEATH(ParseCpuAffinityMode("foo"), "foo");
+}
+
+TEST(CpuAffinity, ComputeCpuPlacementCore) {
+  auto placements =
+      ComputeCpuPlacement(TwoNodeMachine(), 10, CpuAffinityMode::kCore);
+  // Distinct physical cores first, grouped by node, then the siblings.
+  // Then wrap around.
+  EXPECT_EQ(Cpus(placements), (std::vector<std::vector<int>>{
+                                  {0}, {1}, {2}, {3}, {4}, {5}, {6}, {7},
+                                  {0}, {1}}));
+  EXPECT_EQ(placements[0].numa_node, 0);
+  EXPECT_EQ(placements[1].numa_node, 0);
+  EXPECT_EQ(placements[2].numa_node, 1);
+  EXPECT_EQ(placements[3].numa_node, 1);
+}
+
+TEST(CpuAffinity, ComputeCpuPlacementHtPair) {
+  auto placements =
+      ComputeCpuPlacement(TwoNodeMachine(), 5, CpuAffinityMode::kHtPair);
+  EXPECT_EQ(Cpus(placements),
+            (std::vector<std::vector<int>>{
+                {0, 4}, {1, 5}, {2, 6}, {3, 7}, {0, 4}}));
+  EXPECT_EQ(placements[2].numa_node, 1);
+  EXPECT_EQ(CpuPlacementToString(placements[2]), "cpus: 2,6 numa node: 1");
+}
+
+TEST(CpuAffinity, PinThisThread) {
+  auto cpus = GetAvailableCpus();
+  ASSERT_FALSE(cpus.empty());
+  auto placements = ComputeCpuPlacement(cpus, 1, CpuAffinityMode::kCore);
+  ASSERT_EQ(placements.size(), 1);
+  EXPECT_TRUE(PinThisThread(placements[0]));
+  cpu_set_t set;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(set), &set), 0);
+  EXPECT_EQ(CPU_COUNT(&set), 1);
+  EXPECT_TRUE(CPU_ISSET(placements[0].cpus[0], &set));
+}
+
+}  // namespace
+}  // namespace centipede
@@ -23,6 +23,7 @@
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/flags/flag.h"
+#include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_split.h"
@@ -54,6 +55,19 @@ ABSL_FLAG(std::string, extra_binaries, "",
           "from them is not collected. Use this e.g. to run the target under "
           "sanitizers.");
 ABSL_FLAG(std::string, workdir, "", "The working directory.");
+ABSL_FLAG(std::string, targets, "",
+          "If not empty, one process fuzzes several targets: a comma-separated "
+          "list of <workdir>=<binary> pairs, which replace --workdir and "
+          "--binary. Every target has its own --num_threads threads, corpus, "
+          "coverage state and telemetry files (in its own workdir), but at "
+          "most --num_threads batches of all targets combined execute at any "
+          "time. The executor time is sliced between the targets according to "
+          "their recent coverage growth (new features per second of CPU "
+          "time of the engine and the runner), see --target_growth_half_life; "
+          "targets that stopped growing still get a small share.");
+ABSL_FLAG(size_t, target_growth_half_life, 600,
+          "With --targets, the contribution of a batch to the coverage growth "
+          "rate of its target halves every this many seconds.");
 ABSL_FLAG(std::string, merge_from, "",
           "Another working directory to merge the corpus from. Inputs from "
           "--merge_from will be added to --workdir if the add new features.");
@@ -74,16 +88,80 @@ ABSL_FLAG(size_t, j, 0,
           "--num_threads=N --total_shards=N --first_shard_index=0. "
           "Overrides values of these flags if they are also used.");
 ABSL_FLAG(size_t, max_len, 4096, "Max length of mutants. Passed to mutator.");
+ABSL_FLAG(size_t, len_control, 0,
+          "If not zero, enables length control, similar to libFuzzer's "
+          "-len_control: fuzzing starts with a small cap on the length of "
+          "mutants, which is raised (up to --max_len) every time this many "
+          "batches are executed without observing new features. Small inputs "
+          "execute faster, so this lets the fuzzer explore them first. Zero "
+          "means the mutant length is capped by --max_len from the start, "
+          "so --experiment=len_control=0,N compares only the ramp. The cap "
+          "is rounded up to the size alignment of the mutator.");
+ABSL_FLAG(std::string, cpu_affinity, "",
+          "If not empty, pins every fuzzing thread, and hence the runner "
+          "processes it starts, to dedicated CPUs. 'core': one logical CPU "
+          "per thread, on distinct physical cores while there are enough of "
+          "them. 'ht_pair': all logical CPUs of one physical core (e.g. a "
+          "hyperthread pair) per thread. Threads are packed by NUMA node, so "
+          "the shared memory used by a thread and its runner is allocated on "
+          "the local node. The placement is logged at startup.");
+ABSL_FLAG(size_t, shard_lease_seconds, 0,
+          "If not zero, shards are assigned to the fuzzing threads dynamically "
+          "rather than as (--first_shard_index + thread index): every thread "
+          "leases one of the --total_shards shards for this many seconds, "
+          "renews the lease while fuzzing it, and releases it when the "
+          "coverage growth stalls (see --shard_stall_seconds); then it leases "
+          "another shard, without restarting the process. The least fuzzed "
+          "shards are leased first. Any number of processes may share the "
+          "leases; they are stored in <workdir>/shard-leases, which must be "
+          "on a local file system. A lease that is not renewed (e.g. its "
+          "owner has crashed) expires and may be taken by another thread. "
+          "--num_runs then limits the total runs of every thread.");
+ABSL_FLAG(size_t, shard_stall_seconds, 1800,
+          "With --shard_lease_seconds, a thread releases its shard if the "
+          "shard has not gained new coverage for this many seconds.");
+ABSL_FLAG(size_t, num_executors, 0,
+          "If not zero, the inputs are executed by a pool of this many "
+          "executor threads, each with its own runner process, shared by all "
+          "--num_threads fuzzing threads. Every batch is split into chunks, "
+          "one per executor; idle executors steal chunks queued for the busy "
+          "ones. This keeps all executors busy when some fuzzing threads get "
+          "slow inputs. Corpus and features remain per-thread (per-shard). "
+          "Zero means every fuzzing thread executes its own inputs. "
+          "Incompatible with --experiment.");
 ABSL_FLAG(size_t, batch_size, 1000,
           "The number of inputs given to the target at one time. Batches of "
           "more than 1 input are used to amortize the process start-up cost.");
 ABSL_FLAG(size_t, mutate_batch_size, 2,
           "Mutate this many inputs to produce batch_size mutants");
+ABSL_FLAG(size_t, auto_batch_size_overhead, 0,
+          "If not zero, the batch size is tuned automatically during fuzzing: "
+          "Centipede measures the fixed per-batch overhead (e.g. starting the "
+          "target) and the per-input execution time, and picks the batch size "
+          "such that the overhead takes about this percentage of the batch "
+          "wall time. Crashes halve the batch size. --batch_size is used as "
+          "the initial batch size, --mutate_batch_size is scaled along with "
+          "the batch size. Must be less than 100.");
+ABSL_FLAG(size_t, auto_batch_size_max, 100000,
+          "The max batch size chosen by --auto_batch_size_overhead.");
 ABSL_FLAG(size_t, load_other_shard_frequency, 10,
           "Load a random other shard after processing this many batches. Use 0 "
           "to disable loading other shards.  For now, choose the value of this "
           "flag so that shard loads  happen at most once in a few minutes. In "
           "future we may be able to find the suitable value automatically.");
+ABSL_FLAG(std::string, corpus_exchange, "",
+          "If not empty, the path to a Unix domain socket of a local corpus "
+          "exchange coordinator. Every fuzzing thread sends the inputs it adds "
+          "to the corpus, with their features, to the coordinator after every "
+          "batch, and receives the inputs found by other threads and "
+          "processes on this host that are novel w.r.t. all features seen by "
+          "the coordinator. The corpus and features files remain the durable "
+          "storage, and --load_other_shard_frequency keeps working (and may "
+          "be reduced). If the coordinator is unreachable, fuzzing continues "
+          "without it. Start the coordinator with --corpus_exchange_server.");
+ABSL_FLAG(bool, corpus_exchange_server, false,
+          "If true, runs the corpus exchange coordinator on --corpus_exchange "
+          "until interrupted, instead of fuzzing.");
 ABSL_FLAG(size_t, prune_frequency, 100,
           "Prune the corpus every time after this many inputs were added. If "
           "zero, pruning is disabled. Pruning removes redundant inputs from "
@@ -106,16 +184,62 @@ ABSL_FLAG(size_t, rss_limit_mb, 4096,
           "--rss_limit_mb allows Centipede to *report* an OOM condition in "
           "most cases, while --address_space_limit_mb will cause a crash that "
           "may be hard to attribute to OOM.");
+ABSL_FLAG(size_t, malloc_limit_mb, 0,
+          "If not zero, instructs the target to fail and report an OOM as soon "
+          "as a single allocation (malloc, calloc, realloc, memalign) exceeds "
+          "this number of megabytes, rather than waiting for --rss_limit_mb "
+          "to be exceeded. Implemented by the malloc interceptors of the "
+          "runner, which also report the peak heap usage of every input; "
+          "inputs with a large peak heap usage are mutated less often. The "
+          "interceptors are opt-in: the target must be linked with "
+          ":centipede_runner_heap_interceptors; otherwise the flag has no "
+          "effect. Once linked, they report the heap usage with or without "
+          "this flag. They are disabled under ASAN/MSAN/TSAN.");
+ABSL_FLAG(bool, perf_counters, false,
+          "If true, instructs the runner to count instructions, task-clock "
+          "and page faults of every input in the user space using "
+          "perf_event_open(2). The counters that are not available (e.g. "
+          "hardware counters in a VM, or with a restrictive "
+          "/proc/sys/kernel/perf_event_paranoid) are skipped. The sums are "
+          "shown in the rusage report, see --telemetry_frequency.");
 ABSL_FLAG(size_t, timeout, 60,
           "Timeout in seconds (if not 0). If an input runs longer than this "
           "number of seconds the runner process will abort. Support may vary "
-          "depending on the runner.");
+          "depending on the runner. See also --timeout_ms.");
+ABSL_FLAG(size_t, timeout_ms, 0,
+          "If not 0, the per-input timeout in milliseconds, overrides "
+          "--timeout. The runner arms a timer before every input and aborts "
+          "as soon as it expires, so that hanging inputs are detected within "
+          "milliseconds.");
+ABSL_FLAG(size_t, slow_input_ms, 0,
+          "If not 0, inputs that take longer than this many milliseconds to "
+          "execute, but don't time out, are reported as slow: counted in the "
+          "slow_inputs_total metric, and the first ones are logged with their "
+          "execution time.");
 ABSL_FLAG(bool, fork_server, true,
           "If true (default) tries to execute the target(s) via the fork "
           "server, if supported by the target(s). Prepend the binary path with "
           "'%f' to disable the fork server. --fork_server applies to binaries "
           "passed via these flags: --binary, --extra_binaries, "
           "--input_filter.");
+ABSL_FLAG(size_t, max_runner_output_kb, 1024,
+          "If not 0 and the fork server is used, the stdout/stderr of the "
+          "target binary is captured in memory instead of a log file, and "
+          "only the last max_runner_output_kb KB of every batch are kept. The "
+          "output is reported only for failed batches, so normal batches of "
+          "chatty targets cost no file I/O. If 0, the output goes to a log "
+          "file in the temp dir.");
+ABSL_FLAG(bool, snapshot_reset, false,
+          "Experimental. If true, with the fork server, a child of the fork "
+          "server executes batch after batch instead of exiting after one. "
+          "Between the batches, it resets its memory to a snapshot taken "
+          "before the first one, copying back only the pages written since "
+          "(tracked with the soft-dirty bits of Linux). Saves the fork() and "
+          "the teardown of the process for every batch. Falls back to a fresh "
+          "fork when the memory can't be reset, e.g. when the target created "
+          "mappings or threads, or the kernel doesn't support soft-dirty bits. "
+          "Only the memory is reset: targets that keep state elsewhere (files, "
+          "fds) may behave differently.");
 ABSL_FLAG(bool, full_sync, false,
           "Perform a full corpus sync on startup. If true, feature sets and "
           "corpora are read from all shards before fuzzing. This way fuzzing "
@@ -128,6 +252,15 @@ ABSL_FLAG(bool, use_corpus_weights, true,
 ABSL_FLAG(bool, use_coverage_frontier, false,
           "If true, use coverage frontier when choosing the corpus element to "
           "mutate. This flag is mostly for Centipede developers.");
+ABSL_FLAG(bool, use_energy_schedule, false,
+          "If true, adjusts the corpus weights using an energy schedule "
+          "(similar to AFLFast/Entropic): for every corpus element, Centipede "
+          "tracks how many of its mutants were executed and how many new "
+          "features they produced. Elements whose mutants keep finding new "
+          "features are chosen more often, elements whose mutants have not "
+          "found anything new for a while are chosen less often. Has effect "
+          "only with --use_corpus_weights. Can be A/B tested with "
+          "--experiment=use_energy_schedule=false,true.");
 ABSL_FLAG(size_t, max_corpus_size, 100000,
           "Indicates the number of inputs in the in-memory corpus after which"
           "more aggressive pruning will be applied.");
@@ -225,10 +358,12 @@ ABSL_FLAG(std::string, experiment, "",
           "'--foo=3 --bar=20'. The number of threads should be multiple of the "
           "number of flag combinations.");
 ABSL_FLAG(bool, analyze, false,
-          "If set, Centipede will read the corpora from the work dirs provided"
-          " as argv and analyze differences between those corpora."
-          " Used by the Centipede developers to improve the engine. "
-          " TODO(kcc) implement. ");
+          "If set, Centipede will read the corpora from the two or more work "
+          "dirs provided as argv, using --j threads, and print the "
+          "differences between those corpora as JSON to stdout: the PCs "
+          "covered by every corpus, the PCs covered only by it, and for every "
+          "pair of corpora the PCs covered by one and not by the other. "
+          "Used by the Centipede developers to improve the engine.");
 ABSL_FLAG(std::string, dictionary, "",
           "A comma-separated list of paths to dictionary files. The dictionary "
           "file is either in AFL/libFuzzer plain text format or in the binary "
@@ -242,6 +377,46 @@ ABSL_FLAG(std::string, function_filter, "",
 ABSL_FLAG(size_t, shmem_size_mb, 1024,
           "Size of the shared memory regions used to communicate between the "
           "ending and the runner.");
+ABSL_FLAG(size_t, metrics_export_interval, 0,
+          "If not zero, every this many seconds the engine metrics (counters "
+          "of executions, batches, crashes, timeouts, shared memory bytes, "
+          "prunings and shard syncs; corpus, coverage and runner RSS gauges; "
+          "histograms of batch latency, prune and shard sync durations) of "
+          "all threads of this process are written to the workdir: "
+          "metrics-<binary>.<first shard>.prom (overwritten, in the "
+          "Prometheus text format, per thread) and "
+          "metrics-<binary>.<first shard>.jsonl (appended, one JSON line "
+          "with the totals per export).");
+ABSL_FLAG(std::string, trace_path, "",
+          "If not empty, the engine threads record a timeline of their "
+          "activity (mutation, execution, triage, pruning, shard loading and "
+          "corpus exchange, telemetry, crash reproduction) and of the runner "
+          "(per-input prep/exec/post times, laid out sequentially within "
+          "each batch) into per-thread ring buffers. The timeline is written "
+          "to this path as Chrome trace-event JSON (open it in "
+          "ui.perfetto.dev or chrome://tracing) at exit and whenever the "
+          "process receives SIGUSR1.");
+ABSL_FLAG(size_t, trace_events_per_thread, 1 << 18,
+          "With --trace_path, the capacity of the ring buffer of every "
+          "thread: only the most recent this many events of every thread are "
+          "kept. An event takes 32 bytes.");
+ABSL_FLAG(size_t, coverage_journal_interval, 0,
+          "If not zero, every this many seconds of fuzzing every thread "
+          "appends a line with its progress (executions, features per domain, "
+          "covered PCs, corpus size, CPU time of the engine thread and of its "
+          "runners) to workdir/coverage-journal-<binary>.<shard>.csv. A shard "
+          "that was fuzzed before (e.g. by the previous holder of its lease, "
+          "see --shard_lease_seconds) continues its journal. Compare "
+          "the journals of experiment arms or of several workdirs with "
+          "--summarize_coverage_journals.");
+ABSL_FLAG(bool, summarize_coverage_journals, false,
+          "If set, Centipede does not fuzz. Instead, it reads the coverage "
+          "journals (see --coverage_journal_interval) in the workdirs passed "
+          "as argv (or in --workdir if none), merges the journals of every "
+          "experiment arm (every workdir, outside of experiments) into a mean "
+          "coverage curve, and prints for every arm the average coverage over "
+          "the run (the area under the curve, by wall and by CPU time) and the "
+          "time to plateau (to reach 99% of the final coverage).");
 
 namespace centipede {
 
@@ -255,25 +430,44 @@ Environment::Environment(const std::vector<std::string> &argv)
       extra_binaries(absl::StrSplit(absl::GetFlag(FLAGS_extra_binaries), ',',
                                     absl::SkipEmpty{})),
       workdir(absl::GetFlag(FLAGS_workdir)),
+      targets(absl::StrSplit(absl::GetFlag(FLAGS_targets), ',',
+                             absl::SkipEmpty{})),
+      target_growth_half_life(absl::GetFlag(FLAGS_target_growth_half_life)),
       merge_from(absl::GetFlag(FLAGS_merge_from)),
       num_runs(absl::GetFlag(FLAGS_num_runs)),
       total_shards(absl::GetFlag(FLAGS_total_shards)),
       my_shard_index(absl::GetFlag(FLAGS_first_shard_index)),
       num_threads(absl::GetFlag(FLAGS_num_threads)),
+      num_executors(absl::GetFlag(FLAGS_num_executors)),
+      cpu_affinity(absl::GetFlag(FLAGS_cpu_affinity)),
+      shard_lease_seconds(absl::GetFlag(FLAGS_shard_lease_seconds)),
+      shard_stall_seconds(absl::GetFlag(FLAGS_shard_stall_seconds)),
       max_len(absl::GetFlag(FLAGS_max_len)),
+      len_control(absl::GetFlag(FLAGS_len_control)),
       batch_size(absl::GetFlag(FLAGS_batch_size)),
       mutate_batch_size(absl::GetFlag(FLAGS_mutate_batch_size)),
+      auto_batch_size_overhead(absl::GetFlag(FLAGS_auto_batch_size_overhead)),
+      auto_batch_size_max(absl::GetFlag(FLAGS_auto_batch_size_max)),
       load_other_shard_frequency(
           absl::GetFlag(FLAGS_load_other_shard_frequency)),
+      corpus_exchange(absl::GetFlag(FLAGS_corpus_exchange)),
+      corpus_exchange_server(absl::GetFlag(FLAGS_corpus_exchange_server)),
       seed(absl::GetFlag(FLAGS_seed)),
       prune_frequency(absl::GetFlag(FLAGS_prune_frequency)),
       address_space_limit_mb(absl::GetFlag(FLAGS_address_space_limit_mb)),
       rss_limit_mb(absl::GetFlag(FLAGS_rss_limit_mb)),
+      malloc_limit_mb(absl::GetFlag(FLAGS_malloc_limit_mb)),
+      perf_counters(absl::GetFlag(FLAGS_perf_counters)),
       timeout(absl::GetFlag(FLAGS_timeout)),
+      timeout_ms(absl::GetFlag(FLAGS_timeout_ms)),
+      slow_input_ms(absl::GetFlag(FLAGS_slow_input_ms)),
       fork_server(absl::GetFlag(FLAGS_fork_server)),
+      max_runner_output_kb(absl::GetFlag(FLAGS_max_runner_output_kb)),
+      snapshot_reset(absl::GetFlag(FLAGS_snapshot_reset)),
       full_sync(absl::GetFlag(FLAGS_full_sync)),
       use_corpus_weights(absl::GetFlag(FLAGS_use_corpus_weights)),
       use_coverage_frontier(absl::GetFlag(FLAGS_use_coverage_frontier)),
+      use_energy_schedule(absl::GetFlag(FLAGS_use_energy_schedule)),
       max_corpus_size(absl::GetFlag(FLAGS_max_corpus_size)),
       crossover_level(absl::GetFlag(FLAGS_crossover_level)),
       use_pc_features(absl::GetFlag(FLAGS_use_pc_features)),
@@ -305,6 +499,13 @@ Environment::Environment(const std::vector<std::string> &argv)
       exit_on_crash(absl::GetFlag(FLAGS_exit_on_crash)),
       max_num_crash_reports(absl::GetFlag(FLAGS_num_crash_reports)),
       shmem_size_mb(absl::GetFlag(FLAGS_shmem_size_mb)),
+      metrics_export_interval(absl::GetFlag(FLAGS_metrics_export_interval)),
+      trace_path(absl::GetFlag(FLAGS_trace_path)),
+      trace_events_per_thread(absl::GetFlag(FLAGS_trace_events_per_thread)),
+      coverage_journal_interval(
+          absl::GetFlag(FLAGS_coverage_journal_interval)),
+      summarize_coverage_journals(
+          absl::GetFlag(FLAGS_summarize_coverage_journals)),
       cmd(binary),
       binary_name(std::filesystem::path(coverage_binary).filename().string()),
       binary_hash(HashOfFileContents(coverage_binary)) {
@@ -315,6 +516,23 @@ Environment::Environment(const std::vector<std::string> &argv)
   }
   CHECK_GE(total_shards, 1);
   CHECK_GE(batch_size, 1);
+  CHECK_LT(auto_batch_size_overhead, 100);
+  CHECK(!corpus_exchange_server || !corpus_exchange.empty())
+      << "--corpus_exchange_server requires --corpus_exchange";
+  CHECK(num_executors == 0 || experiment.empty())
+      << "--num_executors is incompatible with --experiment";
+  CHECK(shard_lease_seconds == 0 || experiment.empty())
+      << "--shard_lease_seconds is incompatible with --experiment";
+  if (!targets.empty()) {
+    CHECK(experiment.empty() && num_executors == 0 &&
+          cpu_affinity.empty() && shard_lease_seconds == 0 &&
+          corpus_dir.empty() && extra_binaries.empty() &&
+          clang_coverage_binary.empty())
+        << "--targets is incompatible with --experiment, --num_executors, "
+           "--cpu_affinity, --shard_lease_seconds, --corpus_dir, "
+           "--extra_binaries and --clang_coverage_binary";
+    CHECK_GT(target_growth_half_life, 0);
+  }
   CHECK_GE(num_threads, 1);
   CHECK_LE(num_threads, total_shards);
   CHECK_LE(my_shard_index + num_threads, total_shards)
@@ -333,6 +551,7 @@ Environment::Environment(const std::vector<std::string> &argv)
     LOG(INFO) << "@@ detected; running in standalone mode with batch_size=1";
     has_input_wildcards = true;
     batch_size = 1;
+    auto_batch_size_overhead = 0;
     // TODO(kcc): do we need to check if extra_binaries have @@?
   }
 }
@@ -361,6 +580,10 @@ std::string Environment::MakeCoverageDirPath() const {
       absl::StrCat(binary_name, "-", binary_hash));
 }
 
+std::string Environment::MakeShardLeaseDirPath() const {
+  return std::filesystem::path(workdir).append("shard-leases");
+}
+
 std::string Environment::MakeCrashReproducerDirPath() const {
   return std::filesystem::path(workdir).append("crashes");
 }
@@ -440,6 +663,24 @@ std::vector<std::string> Environment::EnumerateRawCoverageProfiles() const {
   return raw_profiles;
 }
 
+std::string Environment::MakePrometheusMetricsPath() const {
+  return std::filesystem::path(workdir).append(absl::StrFormat(
+      "metrics-%s.%0*d.prom", binary_name, kDigitsInShardIndex,
+      my_shard_index));
+}
+
+std::string Environment::MakeJsonLinesMetricsPath() const {
+  return std::filesystem::path(workdir).append(absl::StrFormat(
+      "metrics-%s.%0*d.jsonl", binary_name, kDigitsInShardIndex,
+      my_shard_index));
+}
+
+std::string Environment::MakeCoverageJournalPath() const {
+  return std::filesystem::path(workdir).append(absl::StrFormat(
+      "coverage-journal-%s.%0*d.csv", binary_name, kDigitsInShardIndex,
+      my_shard_index));
+}
+
 std::string Environment::MakeRUsageReportPath(
     std::string_view annotation) const {
   return std::filesystem::path(workdir).append(absl::StrFormat(
@@ -502,7 +743,8 @@ void Environment::SetFlag(std::string_view name, std::string_view value) {
   absl::flat_hash_map<std::string, bool *> bool_flags{
       {"use_cmp_features", &use_cmp_features},
       {"use_auto_dictionary", &use_auto_dictionary},
-      {"use_coverage_frontier", &use_coverage_frontier}};
+      {"use_coverage_frontier", &use_coverage_frontier},
+      {"use_energy_schedule", &use_energy_schedule}};
   auto bool_iter = bool_flags.find(name);
   if (bool_iter != bool_flags.end()) {
     *bool_iter->second = GetBoolFlag(value);
@@ -514,7 +756,9 @@ void Environment::SetFlag(std::string_view name, std::string_view value) {
       {"path_level", &path_level},
       {"max_corpus_size", &max_corpus_size},
       {"max_len", &max_len},
-      {"mutate_batch_size", &mutate_batch_size}};
+      {"len_control", &len_control},
+      {"mutate_batch_size", &mutate_batch_size},
+      {"auto_batch_size_overhead", &auto_batch_size_overhead}};
   auto int_iter = int_flags.find(name);
   if (int_iter != int_flags.end()) {
     *int_iter->second = GetIntFlag(value);
@@ -523,6 +767,24 @@ void Environment::SetFlag(std::string_view name, std::string_view value) {
   CHECK(false) << "Unknown flag for experiment: " << name << "=" << value;
 }
 
+void Environment::UpdateForTarget(size_t index) {
+  CHECK_LT(index, targets.size());
+  const std::vector<std::string> workdir_and_binary =
+      absl::StrSplit(targets[index], absl::MaxSplits('=', 1));
+  CHECK_EQ(workdir_and_binary.size(), 2)
+      << "Expected <workdir>=<binary>: " << targets[index];
+  workdir = workdir_and_binary[0];
+  binary = workdir_and_binary[1];
+  CHECK(!absl::StrContains(binary, "@@"))
+      << "--targets does not support @@: " << binary;
+  coverage_binary = std::string(*absl::StrSplit(binary, ' ').begin());
+  cmd = binary;
+  binary_name = std::filesystem::path(coverage_binary).filename().string();
+  binary_hash = HashOfFileContents(coverage_binary);
+  target_index = index;
+  experiment_name = absl::StrCat("T", index);
+}
+
 void Environment::UpdateForExperiment() {
   if (experiment.empty()) return;
 
@@ -572,6 +834,7 @@ void Environment::UpdateForExperiment() {
   }
   experiment_name = "E" + experiment_name;
   load_other_shard_frequency = 0;  // The experiments should be independent.
+  corpus_exchange.clear();         // Same.
 }
 
 }  // namespace centipede
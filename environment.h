@@ -37,24 +37,42 @@ struct Environment {
   std::string clang_coverage_binary;
   std::vector<std::string> extra_binaries;
   std::string workdir;
+  std::vector<std::string> targets;
+  size_t target_growth_half_life;
   std::string merge_from;
   size_t num_runs;
   size_t total_shards;
   size_t my_shard_index;
   size_t num_threads;
+  size_t num_executors;
+  std::string cpu_affinity;
+  size_t shard_lease_seconds;
+  size_t shard_stall_seconds;
   size_t max_len;
+  size_t len_control;
   size_t batch_size;
   size_t mutate_batch_size;
+  size_t auto_batch_size_overhead;
+  size_t auto_batch_size_max;
   size_t load_other_shard_frequency;
+  std::string corpus_exchange;
+  bool corpus_exchange_server;
   size_t seed;
   size_t prune_frequency;
   size_t address_space_limit_mb;
   size_t rss_limit_mb;
+  size_t malloc_limit_mb;
+  bool perf_counters;
   size_t timeout;
+  size_t timeout_ms;
+  size_t slow_input_ms;
   bool fork_server;
+  size_t max_runner_output_kb;
+  bool snapshot_reset;
   bool full_sync;
   bool use_corpus_weights;
   bool use_coverage_frontier;
+  bool use_energy_schedule;
   size_t max_corpus_size;
   int crossover_level;
   bool use_pc_features;
@@ -82,9 +100,16 @@ struct Environment {
   bool exit_on_crash;
   size_t max_num_crash_reports;
   size_t shmem_size_mb;
+  size_t metrics_export_interval;
+  std::string trace_path;
+  size_t trace_events_per_thread;
+  size_t coverage_journal_interval;
+  bool summarize_coverage_journals;
 
-  std::string experiment_name;   // Set by UpdateForExperiment.
+  // Set by UpdateForExperiment or UpdateForTarget.
+  std::string experiment_name;
   std::string experiment_flags;  // Set by UpdateForExperiment.
+  size_t target_index = 0;       // Set by UpdateForTarget.
 
   // Set to zero to reduce logging in tests.
   size_t log_level = 1;
@@ -92,15 +117,17 @@ struct Environment {
   std::string exec_name;          // copied from argv[0]
   std::vector<std::string> args;  // copied from argv[1:].
 
-  // Created once in CTOR, don't override.
+  // Created in CTOR (or by UpdateForTarget), don't override.
   // The command to execute the binary (may contain arguments).
-  const std::string cmd;
-  const std::string binary_name;  // Name of coverage_binary, w/o directories.
-  const std::string binary_hash;  // Hash of the coverage_binary file.
+  std::string cmd;
+  std::string binary_name;  // Name of coverage_binary, w/o directories.
+  std::string binary_hash;  // Hash of the coverage_binary file.
   bool has_input_wildcards = false;  // Set to true iff `binary` contains "@@"
 
   // Returns the path to the coverage dir.
   std::string MakeCoverageDirPath() const;
+  // Returns the path to the shard lease dir, see --shard_lease_seconds.
+  std::string MakeShardLeaseDirPath() const;
   // Returns the path to the crash reproducer dir.
   std::string MakeCrashReproducerDirPath() const;
   // Returns the path for a corpus file by its shard_index.
@@ -117,6 +144,9 @@ struct Environment {
   std::string MakeDistilledPath() const;
   // Returns true if we want to distill the corpus in this shard before fuzzing.
   bool DistillingInThisShard() const { return my_shard_index < distill_shards; }
+  // Returns the per-input timeout in milliseconds, 0 if none: --timeout_ms if
+  // set, otherwise --timeout.
+  size_t TimeoutMs() const { return timeout_ms ? timeout_ms : timeout * 1000; }
   // Returns true if we want to log features as symbols in this shard.
   bool LogFeaturesInThisShard() const {
     return my_shard_index < log_features_shards;
@@ -132,6 +162,12 @@ struct Environment {
   // Returns the path to the source-based coverage report directory.
   std::string MakeSourceBasedCoverageReportPath(
       std::string_view annotation = "") const;
+  // Returns the paths of the metrics files for my_shard_index, in the
+  // Prometheus text format and as JSON lines.
+  std::string MakePrometheusMetricsPath() const;
+  std::string MakeJsonLinesMetricsPath() const;
+  // Returns the path of the coverage journal for my_shard_index.
+  std::string MakeCoverageJournalPath() const;
   // Returns the path for the performance report file for my_shard_index.
   // Non-default `annotation` becomes a part of the returned filename.
   // `annotation` must not start with a '.'.
@@ -173,6 +209,11 @@ struct Environment {
   // Sets this->experiment_name to a string like "E01",
   // which means "value #0 is used for foo and value #1 is used for bar".
   void UpdateForExperiment();
+
+  // Sets workdir and binary (and the fields derived from binary) from the
+  // `index`-th element of --targets. Sets target_index to `index` and
+  // experiment_name to "T<index>", which prefixes the log lines.
+  void UpdateForTarget(size_t index);
 };
 
 }  // namespace centipede
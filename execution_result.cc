@@ -14,6 +14,7 @@
 
 #include "./execution_result.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 
@@ -30,6 +31,7 @@ enum Tags : SharedMemoryBlobSequence::Blob::SizeAndTagT {
   kTagInputEnd,
   kTagStats,
   kTagCmpArgs,
+  kTagPackedCmpArgs,
 };
 }  // namespace
 
@@ -63,6 +65,11 @@ bool BatchResult::WriteCmpArgs(const uint8_t *v0, const uint8_t *v1,
   return blobseq.Write({kTagCmpArgs, size * 2, data});
 }
 
+bool BatchResult::WritePackedCmpArgs(const uint8_t *data, size_t size,
+                                     SharedMemoryBlobSequence &blobseq) {
+  return blobseq.Write({kTagPackedCmpArgs, size, data});
+}
+
 // The sequence we expect to receive is
 // InputBegin, Features, Stats, InputEnd, InputBegin, ...
 // with a total of results().size() tuples (InputBegin ... InputEnd).
@@ -100,9 +107,22 @@ bool BatchResult::Read(SharedMemoryBlobSequence &blobseq) {
       cmp_args.insert(cmp_args.end(), blob.data, blob.data + blob.size);
       continue;
     }
+    if (blob.tag == kTagPackedCmpArgs) {
+      // The blob must be a sequence of (size, v0, v1).
+      for (size_t pos = 0; pos < blob.size; pos += 1 + 2 * blob.data[pos]) {
+        if (pos + 1 + 2 * blob.data[pos] > blob.size) return false;
+      }
+      auto &cmp_args = current_execution_result->cmp_args();
+      cmp_args.insert(cmp_args.end(), blob.data, blob.data + blob.size);
+      continue;
+    }
     if (blob.tag == kTagStats) {
-      if (blob.size != sizeof(ExecutionResult::Stats)) return false;
-      memcpy(&current_execution_result->stats(), blob.data, blob.size);
+      // Stats only grows at the end: runners built with an older (smaller) or
+      // a newer (larger) Stats are still understood, the fields that one side
+      // doesn't know about are zeros or ignored.
+      auto &stats = current_execution_result->stats();
+      stats = {};
+      memcpy(&stats, blob.data, std::min(blob.size, sizeof(stats)));
       continue;
     }
     if (blob.tag == kTagFeatures) {
@@ -44,13 +44,34 @@ class ExecutionResult {
     uint64_t exec_time_usec = 0;  // Time taken to execute the input.
     uint64_t post_time_usec = 0;  // Time taken to post-process the coverage.
     uint64_t peak_rss_mb = 0;     // Peak RSS in Mb after executing the input.
+    // Heap usage of the input, from the runner's malloc interceptors (zero if
+    // those are not linked, or under sanitizers, see
+    // runner_heap_interceptors.cc): the peak of the live heap
+    // during the execution, above the live heap before it, and the number of
+    // allocations.
+    uint64_t peak_heap_bytes = 0;
+    uint64_t num_mallocs = 0;
+    // Time taken to execute the input, with the resolution of the monotonic
+    // clock (exec_time_usec is this, rounded down).
+    uint64_t exec_time_nsec = 0;
+    // Performance counters of the input in the user space, if enabled by
+    // --perf_counters and available; zeros otherwise.
+    uint64_t instructions = 0;
+    uint64_t task_clock_nsec = 0;
+    uint64_t page_faults = 0;
 
     // For tests.
     bool operator==(const Stats& other) const {  // = default in C++20.
       return prep_time_usec == other.prep_time_usec &&
              exec_time_usec == other.exec_time_usec &&
              peak_rss_mb == other.peak_rss_mb &&
-             post_time_usec == other.post_time_usec;
+             post_time_usec == other.post_time_usec &&
+             peak_heap_bytes == other.peak_heap_bytes &&
+             num_mallocs == other.num_mallocs &&
+             exec_time_nsec == other.exec_time_nsec &&
+             instructions == other.instructions &&
+             task_clock_nsec == other.task_clock_nsec &&
+             page_faults == other.page_faults;
     }
   };
 
@@ -90,6 +111,15 @@ class ExecutionResult {
 // Centipede uses Read() to get all the data from blobseq.
 class BatchResult {
  public:
+  // Resource usage of the runner process(es) that executed the batch, as
+  // reported by wait4(). Set by Centipede, not by the runner.
+  struct RunnerRUsage {
+    bool known = false;  // False if it could not be obtained.
+    uint64_t user_time_usec = 0;
+    uint64_t sys_time_usec = 0;
+    uint64_t max_rss_kb = 0;
+  };
+
   // If BatchResult is used in a hot loop, define it outside the loop and
   // use ClearAndResize() on every iteration.
   // This will reduce the number of mallocs.
@@ -106,6 +136,7 @@ class BatchResult {
     log_.clear();
     exit_code_ = EXIT_SUCCESS;
     num_outputs_read_ = 0;
+    runner_rusage_ = {};
   }
 
   // Writes one FeatureVec (from `vec` and `size`) to `blobseq`.
@@ -127,6 +158,11 @@ class BatchResult {
   // Returns true iff successful.
   static bool WriteCmpArgs(const uint8_t* v0, const uint8_t* v1, size_t size,
                            SharedMemoryBlobSequence& blobseq);
+  // Writes all CMP argument pairs of one input, `size` bytes at `data`, already
+  // packed in the format of ExecutionResult::cmp_args(), as one blob.
+  // Returns true iff successful.
+  static bool WritePackedCmpArgs(const uint8_t* data, size_t size,
+                                 SharedMemoryBlobSequence& blobseq);
 
   // Reads everything written by the runner to `blobseq` into `this`.
   // Returns true iff successful.
@@ -141,7 +177,10 @@ class BatchResult {
   int& exit_code() { return exit_code_; }
   int exit_code() const { return exit_code_; }
   size_t num_outputs_read() const { return num_outputs_read_; }
+  size_t& num_outputs_read() { return num_outputs_read_; }
   std::string &failure_description() { return failure_description_; }
+  RunnerRUsage& runner_rusage() { return runner_rusage_; }
+  const RunnerRUsage& runner_rusage() const { return runner_rusage_; }
 
  private:
   std::vector<ExecutionResult> results_;
@@ -149,6 +188,7 @@ class BatchResult {
   int exit_code_ = EXIT_SUCCESS;  // Process exit code.
   std::string failure_description_;
   size_t num_outputs_read_ = 0;
+  RunnerRUsage runner_rusage_;
 };
 
 }  // namespace centipede
@@ -16,6 +16,8 @@
 
 #include <unistd.h>
 
+#include <cstdint>
+#include <cstring>
 #include <sstream>
 #include <string>
 #include <thread>  // NOLINT
@@ -66,6 +68,10 @@ TEST(ExecutionResult, WriteThenRead) {
                                         blobseq));
   EXPECT_TRUE(BatchResult::WriteCmpArgs(cmp1.data(), cmp2.data(), cmp1.size(),
                                         blobseq));
+  // Write CMP traces packed into one blob.
+  std::vector<uint8_t> packed_cmp_args{1, 5, 7, 2, 6, 7, 8, 9};
+  EXPECT_TRUE(BatchResult::WritePackedCmpArgs(packed_cmp_args.data(),
+                                              packed_cmp_args.size(), blobseq));
   // Done.
   EXPECT_TRUE(BatchResult::WriteInputEnd(blobseq));
 
@@ -84,8 +90,11 @@ TEST(ExecutionResult, WriteThenRead) {
                                    6, 7, 8,  // cmp1
                                    3,        // size
                                    6, 7, 8,  // cmp1
-                                   7, 8, 9   // cmp2
-                                   ));
+                                   7, 8, 9,  // cmp2
+                                   1,        // size
+                                   5, 7,     // packed
+                                   2,        // size
+                                   6, 7, 8, 9));
 
   // If there are fewer ExecutionResult-s than expected everything should work.
   blobseq.Reset();
@@ -102,5 +111,41 @@ TEST(ExecutionResult, WriteThenRead) {
   batch_result.ClearAndResize(1);
   EXPECT_FALSE(batch_result.Read(blobseq));
 }
+
+// Stats written by a runner with an older, smaller, or a newer, larger,
+// Stats can still be read.
+TEST(ExecutionResult, ReadStatsOfDifferentSize) {
+  SharedMemoryBlobSequence blobseq(ShmemName().c_str(), 1000);
+  // The tag of the stats blob in execution_result.cc.
+  constexpr SharedMemoryBlobSequence::Blob::SizeAndTagT kTagStats = 4;
+  const ExecutionResult::Stats stats{.prep_time_usec = 1,
+                                     .exec_time_usec = 2,
+                                     .post_time_usec = 3,
+                                     .peak_rss_mb = 4,
+                                     .peak_heap_bytes = 5};
+  // The old Stats: the first 4 fields.
+  constexpr size_t kOldStatsSize = 4 * sizeof(uint64_t);
+  std::vector<uint8_t> new_stats(sizeof(stats) + 8, 0xff);
+  memcpy(new_stats.data(), &stats, sizeof(stats));
+  EXPECT_TRUE(BatchResult::WriteInputBegin(blobseq));
+  EXPECT_TRUE(blobseq.Write({kTagStats, kOldStatsSize,
+                             reinterpret_cast<const uint8_t *>(&stats)}));
+  EXPECT_TRUE(BatchResult::WriteInputEnd(blobseq));
+  EXPECT_TRUE(BatchResult::WriteInputBegin(blobseq));
+  EXPECT_TRUE(
+      blobseq.Write({kTagStats, new_stats.size(), new_stats.data()}));
+  EXPECT_TRUE(BatchResult::WriteInputEnd(blobseq));
+
+  blobseq.Reset();
+  BatchResult batch_result;
+  batch_result.ClearAndResize(2);
+  EXPECT_TRUE(batch_result.Read(blobseq));
+  const ExecutionResult::Stats expected_old_stats{.prep_time_usec = 1,
+                                                  .exec_time_usec = 2,
+                                                  .post_time_usec = 3,
+                                                  .peak_rss_mb = 4};
+  EXPECT_EQ(batch_result.results()[0].stats(), expected_old_stats);
+  EXPECT_EQ(batch_result.results()[1].stats(), stats);
+}
 }  // namespace
 }  // namespace centipede
@@ -0,0 +1,190 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./executor_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./centipede_callbacks.h"
+#include "./defs.h"
+#include "./environment.h"
+#include "./execution_result.h"
+#include "./logging.h"
+#include "./util.h"
+
+namespace centipede {
+
+ExecutorPool::ExecutorPool(const Environment &env,
+                           CentipedeCallbacksFactory &callbacks_factory,
+                           size_t num_executors)
+    : env_(env),
+      callbacks_factory_(callbacks_factory),
+      queues_(num_executors),
+      busy_usec_(new std::atomic<uint64_t>[num_executors]) {
+  CHECK_GT(num_executors, 0);
+  for (size_t i = 0; i < num_executors; ++i) {
+    busy_usec_[i] = 0;
+    executors_.emplace_back(&ExecutorPool::ExecutorLoop, this, i);
+  }
+}
+
+ExecutorPool::~ExecutorPool() {
+  {
+    absl::MutexLock lock(&mu_);
+    stopping_ = true;
+  }
+  for (auto &executor : executors_) executor.join();
+}
+
+bool ExecutorPool::Execute(std::string_view binary,
+                           const std::vector<ByteArray> &inputs,
+                           BatchResult &batch_result) {
+  batch_result.ClearAndResize(inputs.size());
+  if (inputs.empty()) return true;
+  const size_t num_executors = executors_.size();
+  // One chunk per executor, rounded up.
+  const size_t chunk_size = (inputs.size() + num_executors - 1) / num_executors;
+  const size_t num_chunks = (inputs.size() + chunk_size - 1) / chunk_size;
+
+  Request request;
+  request.binary = binary;
+  request.chunk_results = std::vector<BatchResult>(num_chunks);
+  request.chunk_success.resize(num_chunks);
+  request.num_pending_chunks = num_chunks;
+  {
+    absl::MutexLock lock(&mu_);
+    for (size_t i = 0; i < num_chunks; ++i) {
+      auto begin = inputs.begin() + i * chunk_size;
+      auto end = inputs.begin() + std::min(inputs.size(), (i + 1) * chunk_size);
+      queues_[next_queue_].push_back({&request, i, {begin, end}});
+      next_queue_ = (next_queue_ + 1) % num_executors;
+    }
+    num_queued_tasks_ += num_chunks;
+    mu_.Await(absl::Condition(
+        +[](size_t *num_pending) { return *num_pending == 0; },
+        &request.num_pending_chunks));
+  }
+
+  // Merge the chunk results.
+  bool success = true;
+  auto &rusage = batch_result.runner_rusage();
+  rusage.known = true;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    auto &chunk_result = request.chunk_results[i];
+    for (size_t j = 0; j < chunk_result.results().size(); ++j) {
+      batch_result.results()[i * chunk_size + j] =
+          std::move(chunk_result.results()[j]);
+    }
+    // The chunks ran in different processes: sum the CPU times, but the peak
+    // RSS is that of the largest process.
+    const auto &chunk_rusage = chunk_result.runner_rusage();
+    rusage.known &= chunk_rusage.known;
+    rusage.user_time_usec += chunk_rusage.user_time_usec;
+    rusage.sys_time_usec += chunk_rusage.sys_time_usec;
+    rusage.max_rss_kb = std::max(rusage.max_rss_kb, chunk_rusage.max_rss_kb);
+    if (!success || request.chunk_success[i]) continue;
+    success = false;
+    batch_result.log() = std::move(chunk_result.log());
+    batch_result.exit_code() = chunk_result.exit_code();
+    batch_result.failure_description() =
+        std::move(chunk_result.failure_description());
+    batch_result.num_outputs_read() =
+        i * chunk_size + chunk_result.num_outputs_read();
+  }
+  if (success) batch_result.num_outputs_read() = inputs.size();
+  return success;
+}
+
+bool ExecutorPool::HasTasksOrStopping() const {
+  return stopping_ || num_queued_tasks_ != 0;
+}
+
+bool ExecutorPool::PopTask(size_t executor_index, Task &task) {
+  absl::MutexLock lock(&mu_);
+  mu_.Await(absl::Condition(this, &ExecutorPool::HasTasksOrStopping));
+  if (num_queued_tasks_ == 0) return false;  // stopping_.
+  --num_queued_tasks_;
+  auto &own_queue = queues_[executor_index];
+  if (!own_queue.empty()) {
+    task = std::move(own_queue.front());
+    own_queue.pop_front();
+    return true;
+  }
+  // Steal from the back of the first non-empty queue, starting from the next
+  // executor, so that the victims are spread evenly.
+  for (size_t i = 1, n = queues_.size(); i < n; ++i) {
+    auto &queue = queues_[(executor_index + i) % n];
+    if (queue.empty()) continue;
+    task = std::move(queue.back());
+    queue.pop_back();
+    ++num_stolen_tasks_;
+    return true;
+  }
+  LOG(FATAL) << "num_queued_tasks_ != 0, but all queues are empty";
+  return false;
+}
+
+void ExecutorPool::ExecutorLoop(size_t executor_index) {
+  // The callbacks use per-thread temp dirs and shared memory names,
+  // so they must be created in this thread.
+  CreateLocalDirRemovedAtExit(TemporaryLocalDirPath());
+  auto *callbacks = callbacks_factory_.create(env_);
+  Task task;
+  while (PopTask(executor_index, task)) {
+    Request &request = *task.request;
+    auto &chunk_result = request.chunk_results[task.chunk_index];
+    const auto start_time = absl::Now();
+    const bool success =
+        callbacks->Execute(request.binary, task.inputs, chunk_result);
+    busy_usec_[executor_index] +=
+        absl::ToInt64Microseconds(absl::Now() - start_time);
+    ++num_tasks_;
+    absl::MutexLock lock(&mu_);
+    request.chunk_success[task.chunk_index] = success;
+    --request.num_pending_chunks;
+  }
+  callbacks_factory_.destroy(callbacks);
+}
+
+std::string ExecutorPool::UtilizationString() const {
+  const double wall_usec = std::max<int64_t>(
+      1, absl::ToInt64Microseconds(absl::Now() - start_time_));
+  std::string per_executor;
+  uint64_t total_busy_usec = 0;
+  for (size_t i = 0; i < executors_.size(); ++i) {
+    const uint64_t busy_usec = busy_usec_[i];
+    total_busy_usec += busy_usec;
+    absl::StrAppend(&per_executor, i ? " " : "",
+                    static_cast<int>(100 * busy_usec / wall_usec));
+  }
+  return absl::StrCat(
+      "executors: ", executors_.size(), " utilization: ",
+      static_cast<int>(100 * total_busy_usec / (wall_usec * executors_.size())),
+      "% per-executor: [", per_executor, "] tasks: ", num_tasks_.load(),
+      " stolen: ", num_stolen_tasks_.load());
+}
+
+}  // namespace centipede
@@ -0,0 +1,129 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CENTIPEDE_EXECUTOR_POOL_H_
+#define THIRD_PARTY_CENTIPEDE_EXECUTOR_POOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./centipede_callbacks.h"
+#include "./defs.h"
+#include "./environment.h"
+#include "./execution_result.h"
+
+namespace centipede {
+
+// A pool of executor threads, each owning one CentipedeCallbacks object
+// (and hence one runner process), shared by all fuzzing threads.
+// See --num_executors.
+//
+// Every Execute() call splits its inputs into chunks, one per executor, and
+// puts the chunks into the per-executor queues. An executor takes work from
+// the front of its own queue; when that is empty, it steals from the back of
+// the other queues. So, a fuzzing thread whose batch happens to be slow
+// doesn't leave the other executors idle, and vice versa.
+//
+// This class is thread-safe.
+class ExecutorPool {
+ public:
+  // Creates `num_executors` executor threads. Each thread creates its own
+  // CentipedeCallbacks object from `callbacks_factory` with a copy of `env`.
+  // `callbacks_factory` must outlive `this`.
+  ExecutorPool(const Environment &env,
+               CentipedeCallbacksFactory &callbacks_factory,
+               size_t num_executors);
+  // Stops and joins the executor threads.
+  ~ExecutorPool();
+
+  ExecutorPool(const ExecutorPool &) = delete;
+  ExecutorPool &operator=(const ExecutorPool &) = delete;
+
+  // Same as CentipedeCallbacks::Execute(), but runs `inputs` on the pool.
+  // Blocks until all `inputs` are executed.
+  // If some chunk fails, `batch_result` gets the log, exit code and the
+  // failure description of the first failed chunk, and num_outputs_read()
+  // points at the input on which that chunk failed.
+  bool Execute(std::string_view binary, const std::vector<ByteArray> &inputs,
+               BatchResult &batch_result);
+
+  // Returns a string describing the executor utilization so far,
+  // for logging.
+  std::string UtilizationString() const;
+
+ private:
+  // One Execute() call.
+  struct Request {
+    std::string_view binary;
+    // Chunk results, one per chunk.
+    std::vector<BatchResult> chunk_results;
+    // Chunk success statuses, one per chunk.
+    std::vector<bool> chunk_success;
+    // The number of chunks not yet executed.
+    size_t num_pending_chunks = 0;
+  };
+
+  // One chunk of a Request.
+  struct Task {
+    Request *request;
+    size_t chunk_index;
+    std::vector<ByteArray> inputs;
+  };
+
+  // The main loop of the `executor_index`-th executor thread.
+  void ExecutorLoop(size_t executor_index);
+
+  // Returns true if there are queued tasks or the pool is stopping.
+  bool HasTasksOrStopping() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Waits until there is a task for `executor_index` or the pool is stopping.
+  // Returns false if the pool is stopping.
+  bool PopTask(size_t executor_index, Task &task);
+
+  const Environment env_;
+  CentipedeCallbacksFactory &callbacks_factory_;
+  const absl::Time start_time_ = absl::Now();
+
+  mutable absl::Mutex mu_;
+  // Per-executor queues of tasks.
+  std::vector<std::deque<Task>> queues_ ABSL_GUARDED_BY(mu_);
+  // The number of tasks in all queues_.
+  size_t num_queued_tasks_ ABSL_GUARDED_BY(mu_) = 0;
+  // The queue into which the next Execute() puts its first chunk.
+  size_t next_queue_ ABSL_GUARDED_BY(mu_) = 0;
+  bool stopping_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Utilization stats.
+  // Time spent by every executor in CentipedeCallbacks::Execute().
+  std::unique_ptr<std::atomic<uint64_t>[]> busy_usec_;
+  std::atomic<size_t> num_tasks_{0};
+  std::atomic<size_t> num_stolen_tasks_{0};
+
+  std::vector<std::thread> executors_;
+};
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_EXECUTOR_POOL_H_
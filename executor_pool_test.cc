@@ -0,0 +1,118 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./executor_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./centipede_callbacks.h"
+#include "./defs.h"
+#include "./environment.h"
+#include "./execution_result.h"
+
+namespace centipede {
+namespace {
+
+// The input {kCrash} crashes the "target".
+constexpr uint8_t kCrash = 255;
+
+// Executes every input for input[0] milliseconds,
+// the only feature of an input is its input[0].
+class SlowInputsCallbacks : public CentipedeCallbacks {
+ public:
+  explicit SlowInputsCallbacks(const Environment &env)
+      : CentipedeCallbacks(env) {}
+  bool Execute(std::string_view binary, const std::vector<ByteArray> &inputs,
+               BatchResult &batch_result) override {
+    batch_result.ClearAndResize(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      if (inputs[i][0] == kCrash) {
+        batch_result.exit_code() = EXIT_FAILURE;
+        batch_result.log() = "crash";
+        return false;
+      }
+      absl::SleepFor(absl::Milliseconds(inputs[i][0]));
+      batch_result.results()[i].mutable_features() = {inputs[i][0]};
+      ++batch_result.num_outputs_read();
+    }
+    return true;
+  }
+  void Mutate(const std::vector<ByteArray> &inputs, size_t num_mutants,
+              std::vector<ByteArray> &mutants) override {}
+};
+
+TEST(ExecutorPool, ExecutesHeterogeneousInputsFromManyThreads) {
+  Environment env;
+  DefaultCallbacksFactory<SlowInputsCallbacks> factory;
+  ExecutorPool pool(env, factory, /*num_executors=*/4);
+
+  // Every thread has a batch with a few slow inputs.
+  constexpr size_t kNumThreads = 3;
+  constexpr size_t kBatchSize = 40;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&pool, t]() {
+      std::vector<ByteArray> inputs;
+      for (size_t i = 0; i < kBatchSize; ++i) {
+        inputs.push_back({static_cast<uint8_t>(i % (5 + t) == 0 ? 20 : 0)});
+      }
+      for (size_t iter = 0; iter < 3; ++iter) {
+        BatchResult batch_result;
+        EXPECT_TRUE(pool.Execute("binary", inputs, batch_result));
+        ASSERT_EQ(batch_result.results().size(), inputs.size());
+        EXPECT_EQ(batch_result.num_outputs_read(), inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i) {
+          EXPECT_EQ(batch_result.results()[i].features(),
+                    FeatureVec{inputs[i][0]});
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  auto utilization = pool.UtilizationString();
+  EXPECT_NE(utilization.find("executors: 4"), std::string::npos)
+      << utilization;
+  EXPECT_NE(utilization.find("tasks: 36"), std::string::npos) << utilization;
+}
+
+TEST(ExecutorPool, ReportsFailures) {
+  Environment env;
+  DefaultCallbacksFactory<SlowInputsCallbacks> factory;
+  ExecutorPool pool(env, factory, /*num_executors=*/3);
+  std::vector<ByteArray> inputs(10, ByteArray{0});
+  inputs[7] = {kCrash};
+  BatchResult batch_result;
+  EXPECT_FALSE(pool.Execute("binary", inputs, batch_result));
+  EXPECT_EQ(batch_result.results().size(), inputs.size());
+  EXPECT_EQ(batch_result.num_outputs_read(), 7);
+  EXPECT_EQ(batch_result.exit_code(), EXIT_FAILURE);
+  EXPECT_EQ(batch_result.log(), "crash");
+  // The inputs before and after the failed chunk are executed.
+  EXPECT_EQ(batch_result.results()[0].features(), FeatureVec{0});
+  EXPECT_EQ(batch_result.results()[9].features(), FeatureVec{0});
+
+  // An empty batch is trivially successful.
+  EXPECT_TRUE(pool.Execute("binary", {}, batch_result));
+  EXPECT_TRUE(batch_result.results().empty());
+}
+
+}  // namespace
+}  // namespace centipede
@@ -0,0 +1,228 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./metrics.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "./defs.h"
+#include "./logging.h"
+#include "./remote_file.h"
+
+namespace centipede {
+
+namespace {
+
+struct MetricInfo {
+  const char *name;  // Without the "centipede_" prefix.
+  const char *help;
+};
+
+constexpr MetricInfo kCounterInfo[] = {
+    {"executions_total", "Inputs executed."},
+    {"batches_total", "Batches executed."},
+    {"crashes_total", "Failed batches."},
+    {"timeouts_total", "Failed batches due to a timeout."},
+    {"shmem_bytes_total", "Bytes passed via shared memory."},
+    {"prunes_total", "Corpus prunings."},
+    {"shard_syncs_total", "Loaded shards and corpus exchanges."},
+    {"slow_inputs_total", "Inputs slower than --slow_input_ms."},
+    {"mutate_usec_total", "Engine time in the mutate phase."},
+    {"execute_usec_total", "Engine time in the execute phase."},
+    {"triage_usec_total", "Engine time in the triage phase."},
+    {"prune_usec_total", "Engine time in the prune phase."},
+    {"sync_usec_total", "Engine time in the sync phase."},
+    {"telemetry_usec_total", "Engine time in the telemetry phase."},
+    {"other_usec_total", "Engine time outside of the phases."},
+    {"runner_prep_usec_total", "Runner time preparing for the executions."},
+    {"runner_exec_usec_total", "Runner time executing the inputs."},
+    {"runner_post_usec_total", "Runner time post-processing the coverage."},
+};
+constexpr MetricInfo kGaugeInfo[] = {
+    {"corpus_size", "Active corpus elements."},
+    {"features", "Features observed."},
+    {"covered_pcs", "PCs covered."},
+    {"runner_peak_rss_mb", "Peak RSS of the runner in the last batch."},
+};
+constexpr MetricInfo kHistogramInfo[] = {
+    {"batch_latency_usec", "Execution time of one batch."},
+    {"prune_duration_usec", "Duration of one corpus pruning."},
+    {"shard_sync_duration_usec",
+     "Duration of one shard load or corpus exchange."},
+};
+static_assert(std::size(kCounterInfo) ==
+              static_cast<size_t>(Counter::kNumCounters));
+static_assert(std::size(kGaugeInfo) == static_cast<size_t>(Gauge::kNumGauges));
+static_assert(std::size(kHistogramInfo) ==
+              static_cast<size_t>(Histogram::kNumHistograms));
+
+// Returns the bucket of `value`, see HistogramSnapshot.
+size_t BucketIndex(uint64_t value) {
+  size_t bit_width = 0;
+  while (value) {
+    ++bit_width;
+    value >>= 1;
+  }
+  return std::min(bit_width, HistogramSnapshot::kNumBuckets - 1);
+}
+
+void AppendHelpAndType(std::string &out, const MetricInfo &info,
+                       const char *type) {
+  absl::StrAppend(&out, "# HELP centipede_", info.name, " ", info.help,
+                  "\n# TYPE centipede_", info.name, " ", type, "\n");
+}
+
+}  // namespace
+
+uint64_t HistogramSnapshot::Quantile(double quantile) const {
+  if (count == 0) return 0;
+  const double rank = quantile * count;
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    cumulative += buckets[i];
+    if (cumulative >= rank && cumulative > 0) return BucketUpperBound(i);
+  }
+  return BucketUpperBound(kNumBuckets - 1);
+}
+
+void HistogramSnapshot::Merge(const HistogramSnapshot &other) {
+  count += other.count;
+  sum += other.sum;
+  for (size_t i = 0; i < kNumBuckets; ++i) buckets[i] += other.buckets[i];
+}
+
+void ThreadMetrics::Record(Histogram histogram, uint64_t value) {
+  auto &values = histograms_[static_cast<size_t>(histogram)];
+  auto add = [](std::atomic<uint64_t> &atomic, uint64_t delta) {
+    atomic.store(atomic.load(std::memory_order_relaxed) + delta,
+                 std::memory_order_relaxed);
+  };
+  add(values.count, 1);
+  add(values.sum, value);
+  add(values.buckets[BucketIndex(value)], 1);
+}
+
+HistogramSnapshot ThreadMetrics::Get(Histogram histogram) const {
+  const auto &values = histograms_[static_cast<size_t>(histogram)];
+  HistogramSnapshot snapshot;
+  snapshot.count = values.count.load(std::memory_order_relaxed);
+  snapshot.sum = values.sum.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < HistogramSnapshot::kNumBuckets; ++i) {
+    snapshot.buckets[i] = values.buckets[i].load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+std::string MetricsToPrometheusText(
+    absl::Span<const ThreadMetrics *const> metrics) {
+  std::string out;
+  for (size_t c = 0; c < std::size(kCounterInfo); ++c) {
+    AppendHelpAndType(out, kCounterInfo[c], "counter");
+    for (size_t t = 0; t < metrics.size(); ++t) {
+      absl::StrAppend(&out, "centipede_", kCounterInfo[c].name, "{thread=\"",
+                      t, "\"} ", metrics[t]->Get(static_cast<Counter>(c)),
+                      "\n");
+    }
+  }
+  for (size_t g = 0; g < std::size(kGaugeInfo); ++g) {
+    AppendHelpAndType(out, kGaugeInfo[g], "gauge");
+    for (size_t t = 0; t < metrics.size(); ++t) {
+      absl::StrAppend(&out, "centipede_", kGaugeInfo[g].name, "{thread=\"", t,
+                      "\"} ", metrics[t]->Get(static_cast<Gauge>(g)), "\n");
+    }
+  }
+  for (size_t h = 0; h < std::size(kHistogramInfo); ++h) {
+    const char *name = kHistogramInfo[h].name;
+    AppendHelpAndType(out, kHistogramInfo[h], "histogram");
+    for (size_t t = 0; t < metrics.size(); ++t) {
+      const auto snapshot = metrics[t]->Get(static_cast<Histogram>(h));
+      // Prometheus buckets are cumulative and have inclusive upper bounds;
+      // the last one is reported as +Inf.
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i + 1 < HistogramSnapshot::kNumBuckets; ++i) {
+        cumulative += snapshot.buckets[i];
+        absl::StrAppend(&out, "centipede_", name, "_bucket{thread=\"", t,
+                        "\",le=\"",
+                        HistogramSnapshot::BucketUpperBound(i) - 1, "\"} ",
+                        cumulative, "\n");
+      }
+      absl::StrAppend(&out, "centipede_", name, "_bucket{thread=\"", t,
+                      "\",le=\"+Inf\"} ", snapshot.count, "\n");
+      absl::StrAppend(&out, "centipede_", name, "_sum{thread=\"", t, "\"} ",
+                      snapshot.sum, "\n");
+      absl::StrAppend(&out, "centipede_", name, "_count{thread=\"", t, "\"} ",
+                      snapshot.count, "\n");
+    }
+  }
+  return out;
+}
+
+std::string MetricsToJsonLine(absl::Span<const ThreadMetrics *const> metrics,
+                              int64_t unix_time_sec) {
+  std::string out = absl::StrCat("{\"unix_time_sec\":", unix_time_sec);
+  for (size_t c = 0; c < std::size(kCounterInfo); ++c) {
+    uint64_t total = 0;
+    for (const auto *m : metrics) total += m->Get(static_cast<Counter>(c));
+    absl::StrAppend(&out, ",\"", kCounterInfo[c].name, "\":", total);
+  }
+  for (size_t g = 0; g < std::size(kGaugeInfo); ++g) {
+    uint64_t max = 0;
+    for (const auto *m : metrics) {
+      max = std::max(max, m->Get(static_cast<Gauge>(g)));
+    }
+    absl::StrAppend(&out, ",\"", kGaugeInfo[g].name, "\":", max);
+  }
+  for (size_t h = 0; h < std::size(kHistogramInfo); ++h) {
+    HistogramSnapshot total;
+    for (const auto *m : metrics) total.Merge(m->Get(static_cast<Histogram>(h)));
+    absl::StrAppend(&out, ",\"", kHistogramInfo[h].name,
+                    "\":{\"count\":", total.count, ",\"sum\":", total.sum,
+                    ",\"p50\":", total.Quantile(0.5),
+                    ",\"p99\":", total.Quantile(0.99), "}");
+  }
+  absl::StrAppend(&out, "}\n");
+  return out;
+}
+
+void ExportMetrics(absl::Span<const ThreadMetrics *const> metrics,
+                   std::string_view prometheus_path,
+                   std::string_view json_lines_path) {
+  const std::string prometheus_text = MetricsToPrometheusText(metrics);
+  const std::string json_line =
+      MetricsToJsonLine(metrics, absl::ToUnixSeconds(absl::Now()));
+  if (RemoteFile *file = RemoteFileOpen(prometheus_path, "w")) {
+    RemoteFileAppend(file,
+                     ByteArray(prometheus_text.begin(), prometheus_text.end()));
+    RemoteFileClose(file);
+  } else {
+    LOG(INFO) << "Failed to open " << prometheus_path;
+  }
+  if (RemoteFile *file = RemoteFileOpen(json_lines_path, "a")) {
+    RemoteFileAppend(file, ByteArray(json_line.begin(), json_line.end()));
+    RemoteFileClose(file);
+  } else {
+    LOG(INFO) << "Failed to open " << json_lines_path;
+  }
+}
+
+}  // namespace centipede
@@ -0,0 +1,163 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Engine metrics: counters, gauges and latency histograms, see
+// --metrics_export_interval.
+//
+// Every fuzzing thread has its own ThreadMetrics object and is the only
+// writer of it. Every value lives on its own cache line, and is updated with
+// a relaxed load and store (no read-modify-write), so updating a metric costs
+// about as much as updating a plain variable. Any thread may read the values
+// concurrently, e.g. to export them.
+
+#ifndef THIRD_PARTY_CENTIPEDE_METRICS_H_
+#define THIRD_PARTY_CENTIPEDE_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "absl/types/span.h"
+
+namespace centipede {
+
+// Monotonically increasing counts.
+enum class Counter : size_t {
+  kExecutions,   // Inputs executed.
+  kBatches,      // Batches executed.
+  kCrashes,      // Failed batches.
+  kTimeouts,     // Failed batches due to a timeout.
+  kShmemBytes,   // Bytes passed via shared memory: inputs and features.
+  kPrunes,       // Corpus prunings.
+  kShardSyncs,   // Loaded shards and corpus exchanges.
+  kSlowInputs,   // Inputs slower than --slow_input_ms.
+  // Engine time by phase of the fuzzing loop, in microseconds, see PhaseTimer.
+  kMutateUsec,
+  kExecuteUsec,
+  kTriageUsec,
+  kPruneUsec,
+  kSyncUsec,
+  kTelemetryUsec,
+  kOtherUsec,  // Outside of the phases.
+  // Runner time summed over the executed inputs, in microseconds.
+  kRunnerPrepUsec,
+  kRunnerExecUsec,
+  kRunnerPostUsec,
+  kNumCounters,
+};
+
+// Current values.
+enum class Gauge : size_t {
+  kCorpusSize,       // Active corpus elements.
+  kNumFeatures,      // Features observed.
+  kCoveredPcs,       // PCs covered.
+  kRunnerPeakRssMb,  // Peak RSS of the runner in the last batch.
+  kNumGauges,
+};
+
+// Distributions of durations, in microseconds.
+enum class Histogram : size_t {
+  kBatchLatency,       // Execution of one batch.
+  kPruneDuration,      // One corpus pruning.
+  kShardSyncDuration,  // One shard load or corpus exchange.
+  kNumHistograms,
+};
+
+// A snapshot of a histogram. Bucket 0 counts the zero values, bucket i > 0
+// counts the values in [2^(i-1), 2^i); the last bucket also counts all larger
+// values.
+struct HistogramSnapshot {
+  static constexpr size_t kNumBuckets = 40;
+
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  std::array<uint64_t, kNumBuckets> buckets = {};
+
+  // Returns the upper bound of bucket `i`.
+  static uint64_t BucketUpperBound(size_t i) { return uint64_t{1} << i; }
+  // Returns the upper bound of the bucket where the `quantile` is reached.
+  uint64_t Quantile(double quantile) const;
+  // Adds `other` to this.
+  void Merge(const HistogramSnapshot &other);
+};
+
+// This class is thread-compatible for writing and thread-safe for reading.
+class ThreadMetrics {
+ public:
+  void Increment(Counter counter, uint64_t delta = 1) {
+    auto &value = counters_[static_cast<size_t>(counter)].value;
+    value.store(value.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+  }
+  void Set(Gauge gauge, uint64_t value) {
+    gauges_[static_cast<size_t>(gauge)].value.store(value,
+                                                    std::memory_order_relaxed);
+  }
+  void Record(Histogram histogram, uint64_t value);
+
+  uint64_t Get(Counter counter) const {
+    return counters_[static_cast<size_t>(counter)].value.load(
+        std::memory_order_relaxed);
+  }
+  uint64_t Get(Gauge gauge) const {
+    return gauges_[static_cast<size_t>(gauge)].value.load(
+        std::memory_order_relaxed);
+  }
+  HistogramSnapshot Get(Histogram histogram) const;
+
+ private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  struct alignas(kCacheLineSize) PaddedValue {
+    std::atomic<uint64_t> value = 0;
+  };
+  // A histogram is updated as a whole, so its values share cache lines.
+  struct alignas(kCacheLineSize) HistogramValues {
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> sum = 0;
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::kNumBuckets> buckets =
+        {};
+  };
+
+  std::array<PaddedValue, static_cast<size_t>(Counter::kNumCounters)>
+      counters_;
+  std::array<PaddedValue, static_cast<size_t>(Gauge::kNumGauges)> gauges_;
+  std::array<HistogramValues, static_cast<size_t>(Histogram::kNumHistograms)>
+      histograms_;
+};
+
+// Returns the metrics of every element of `metrics` in the Prometheus text
+// exposition format, labeled with thread="<index in `metrics`>".
+std::string MetricsToPrometheusText(
+    absl::Span<const ThreadMetrics *const> metrics);
+
+// Returns the metrics of all elements of `metrics` as one line of JSON (with
+// the trailing newline), with `unix_time_sec` as the timestamp. Counters and
+// histograms are summed, gauges are reported as their maximum. Histograms are
+// summarized by count, sum, p50 and p99.
+std::string MetricsToJsonLine(absl::Span<const ThreadMetrics *const> metrics,
+                              int64_t unix_time_sec);
+
+// Overwrites `prometheus_path` with MetricsToPrometheusText() and appends
+// MetricsToJsonLine() with the current time to `json_lines_path`.
+void ExportMetrics(absl::Span<const ThreadMetrics *const> metrics,
+                   std::string_view prometheus_path,
+                   std::string_view json_lines_path);
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_METRICS_H_
@@ -0,0 +1,96 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./metrics.h"
+
+#include <filesystem>
+#include <string>
+#include <algorithm>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+#include "absl/strings/match.h"
+#include "./test_util.h"
+#include "./util.h"
+
+namespace centipede {
+namespace {
+
+TEST(ThreadMetrics, CountersGaugesHistograms) {
+  ThreadMetrics metrics;
+  metrics.Increment(Counter::kExecutions, 10);
+  metrics.Increment(Counter::kExecutions);
+  metrics.Set(Gauge::kCorpusSize, 5);
+  metrics.Set(Gauge::kCorpusSize, 3);
+  EXPECT_EQ(metrics.Get(Counter::kExecutions), 11);
+  EXPECT_EQ(metrics.Get(Counter::kCrashes), 0);
+  EXPECT_EQ(metrics.Get(Gauge::kCorpusSize), 3);
+
+  for (uint64_t value : {0, 1, 2, 3, 1000}) {
+    metrics.Record(Histogram::kBatchLatency, value);
+  }
+  const auto histogram = metrics.Get(Histogram::kBatchLatency);
+  EXPECT_EQ(histogram.count, 5);
+  EXPECT_EQ(histogram.sum, 1006);
+  EXPECT_EQ(histogram.buckets[0], 1);   // 0
+  EXPECT_EQ(histogram.buckets[1], 1);   // 1
+  EXPECT_EQ(histogram.buckets[2], 2);   // 2, 3
+  EXPECT_EQ(histogram.buckets[10], 1);  // 1000
+  EXPECT_EQ(histogram.Quantile(0.5), 4);
+  EXPECT_EQ(histogram.Quantile(1), 1024);
+}
+
+TEST(ThreadMetrics, Export) {
+  ThreadMetrics metrics1, metrics2;
+  metrics1.Increment(Counter::kBatches, 2);
+  metrics2.Increment(Counter::kBatches, 3);
+  metrics1.Set(Gauge::kCoveredPcs, 4);
+  metrics2.Set(Gauge::kCoveredPcs, 7);
+  metrics2.Record(Histogram::kPruneDuration, 5);
+  const std::vector<const ThreadMetrics *> all = {&metrics1, &metrics2};
+
+  const std::string text = MetricsToPrometheusText(all);
+  EXPECT_TRUE(absl::StrContains(text, "# TYPE centipede_batches_total counter\n"
+                                      "centipede_batches_total{thread=\"0\"} 2\n"
+                                      "centipede_batches_total{thread=\"1\"} 3\n"));
+  EXPECT_TRUE(absl::StrContains(text, "centipede_covered_pcs{thread=\"1\"} 7\n"));
+  EXPECT_TRUE(absl::StrContains(
+      text, "centipede_prune_duration_usec_bucket{thread=\"1\",le=\"3\"} 0\n"
+            "centipede_prune_duration_usec_bucket{thread=\"1\",le=\"7\"} 1\n"));
+  EXPECT_TRUE(absl::StrContains(
+      text, "centipede_prune_duration_usec_count{thread=\"1\"} 1\n"));
+
+  const std::string json = MetricsToJsonLine(all, 123);
+  EXPECT_TRUE(absl::StartsWith(json, "{\"unix_time_sec\":123,"));
+  EXPECT_TRUE(absl::StrContains(json, "\"batches_total\":5,"));
+  EXPECT_TRUE(absl::StrContains(json, "\"covered_pcs\":7,"));
+  EXPECT_TRUE(absl::StrContains(
+      json, "\"prune_duration_usec\":{\"count\":1,\"sum\":5,\"p50\":8,"));
+  EXPECT_TRUE(absl::EndsWith(json, "}\n"));
+
+  const auto dir = std::filesystem::path(GetTestTempDir());
+  const auto prometheus_path = dir / "metrics.prom";
+  const auto json_lines_path = dir / "metrics.jsonl";
+  std::filesystem::remove(json_lines_path);
+  ExportMetrics(all, prometheus_path.string(), json_lines_path.string());
+  ExportMetrics(all, prometheus_path.string(), json_lines_path.string());
+  std::string contents;
+  ReadFromLocalFile(prometheus_path.string(), contents);
+  EXPECT_EQ(contents, text);
+  ReadFromLocalFile(json_lines_path.string(), contents);
+  EXPECT_EQ(std::count(contents.begin(), contents.end(), '\n'), 2);
+}
+
+}  // namespace
+}  // namespace centipede
@@ -0,0 +1,553 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of the engine and runner hot paths. Usage:
+//
+//   centipede_microbenchmarks [--benchmark_filter=Mutate]
+//     [--benchmark_out=results.json] [--benchmark_min_time=0.5]
+//     [--corpus_path=WORKDIR/corpus.000000
+//      --features_path=WORKDIR/BINARY-HASH/features.000000]
+//
+// Every benchmark runs its iteration until it takes --benchmark_min_time
+// seconds. The results are printed as a table to stderr and as JSON to
+// --benchmark_out (or stdout), in the format of Google Benchmark, so that
+// the results of two releases can be compared with its tools/compare.py.
+//
+// The inputs are generated to resemble real ones: features are mostly 8-bit
+// counter features of hot PCs, inputs have the given sizes. With
+// --corpus_path and --features_path, the benchmarks of features and inputs
+// additionally run on a shard of a real workdir.
+
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./byte_array_mutator.h"
+#include "./corpus.h"
+#include "./defs.h"
+#include "./execution_result.h"
+#include "./feature.h"
+#include "./logging.h"
+#include "./remote_file.h"
+#include "./shard_reader.h"
+#include "./shared_memory_blob_sequence.h"
+#include "./util.h"
+
+ABSL_FLAG(std::string, benchmark_filter, "",
+          "Run only the benchmarks whose name contains this string.");
+ABSL_FLAG(double, benchmark_min_time, 0.5,
+          "Run every benchmark for at least this many seconds.");
+ABSL_FLAG(std::string, benchmark_out, "",
+          "Write the JSON results to this path instead of stdout.");
+ABSL_FLAG(std::string, corpus_path, "",
+          "A corpus shard (workdir/corpus.NNNNNN) to also run the benchmarks "
+          "of features and inputs on. Requires --features_path.");
+ABSL_FLAG(std::string, features_path, "",
+          "The features shard (workdir/BINARY-HASH/features.NNNNNN) of "
+          "--corpus_path.");
+
+namespace centipede {
+namespace {
+
+// Prevents the compiler from optimizing away the computation of `value`.
+template <typename T>
+void DoNotOptimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// The code of a benchmark: one iteration, and the amount of work it does.
+struct BenchmarkBody {
+  std::function<void()> iteration;
+  size_t items_per_iteration = 1;
+  size_t bytes_per_iteration = 0;
+};
+
+struct Benchmark {
+  std::string name;
+  // Creates the inputs of the benchmark, not timed.
+  std::function<BenchmarkBody()> setup;
+};
+
+struct BenchmarkResult {
+  std::string name;
+  size_t iterations = 0;
+  double real_time_ns = 0;  // Per iteration.
+  double cpu_time_ns = 0;   // Per iteration.
+  double items_per_second = 0;
+  double bytes_per_second = 0;
+};
+
+double ProcessCpuTimeNs() {
+  struct timespec ts = {};
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Runs `benchmark` with a growing number of iterations until the iterations
+// take `min_time`. Returns the result of the last run.
+BenchmarkResult RunBenchmark(const Benchmark &benchmark,
+                             absl::Duration min_time) {
+  const BenchmarkBody body = benchmark.setup();
+  size_t iterations = 1;
+  while (true) {
+    const absl::Time start = absl::Now();
+    const double start_cpu_ns = ProcessCpuTimeNs();
+    for (size_t i = 0; i < iterations; ++i) body.iteration();
+    const absl::Duration elapsed = absl::Now() - start;
+    const double cpu_ns = ProcessCpuTimeNs() - start_cpu_ns;
+    if (elapsed >= min_time || iterations >= 1000000000) {
+      BenchmarkResult result;
+      result.name = benchmark.name;
+      result.iterations = iterations;
+      const double seconds = absl::ToDoubleSeconds(elapsed);
+      result.real_time_ns = seconds * 1e9 / iterations;
+      result.cpu_time_ns = cpu_ns / iterations;
+      result.items_per_second =
+          seconds > 0 ? iterations * body.items_per_iteration / seconds : 0;
+      result.bytes_per_second =
+          seconds > 0 ? iterations * body.bytes_per_iteration / seconds : 0;
+      return result;
+    }
+    // Aim at 1.4x the min time, but grow at most 10x at once.
+    const double multiplier =
+        elapsed > absl::ZeroDuration()
+            ? 1.4 * absl::FDivDuration(min_time, elapsed)
+            : 10;
+    iterations = std::max(iterations + 1,
+                          static_cast<size_t>(iterations *
+                                              std::clamp(multiplier, 1., 10.)));
+  }
+}
+
+// Returns the features of a typical input of a target with `num_pcs` PCs:
+// mostly 8-bit counter features, skewed towards the (hot) low PC indices,
+// and a few CMP features.
+FeatureVec GenerateFeatures(Rng &rng, size_t num_features, size_t num_pcs) {
+  std::uniform_real_distribution<double> uniform(0, 1);
+  FeatureVec features;
+  features.reserve(num_features);
+  for (size_t i = 0; i < num_features; ++i) {
+    if (i % 10 == 9) {
+      features.push_back(feature_domains::kCMP.ConvertToMe(rng()));
+      continue;
+    }
+    const double u = uniform(rng);
+    const size_t pc_index = static_cast<size_t>(num_pcs * u * u * u);
+    const uint8_t counter = 1 << (rng() % 8 == 0 ? rng() % 8 : 0);
+    features.push_back(feature_domains::k8bitCounters.ConvertToMe(
+        Convert8bitCounterToNumber(pc_index, counter)));
+  }
+  std::sort(features.begin(), features.end());
+  features.erase(std::unique(features.begin(), features.end()),
+                 features.end());
+  return features;
+}
+
+// Returns `num_inputs` random inputs of `input_size` bytes.
+std::vector<ByteArray> GenerateInputs(Rng &rng, size_t num_inputs,
+                                      size_t input_size) {
+  std::vector<ByteArray> inputs(num_inputs, ByteArray(input_size));
+  for (auto &input : inputs) {
+    for (auto &byte : input) byte = rng();
+  }
+  return inputs;
+}
+
+// A corpus: the inputs and their features.
+struct CorpusData {
+  std::vector<ByteArray> inputs;
+  std::vector<FeatureVec> features;
+};
+
+// Returns a synthetic corpus of `num_inputs` inputs of `input_size` bytes
+// with `num_features` features each.
+std::shared_ptr<CorpusData> GenerateCorpus(size_t num_inputs,
+                                           size_t input_size,
+                                           size_t num_features) {
+  Rng rng(num_inputs * 31 + input_size * 7 + num_features);
+  auto corpus = std::make_shared<CorpusData>();
+  corpus->inputs = GenerateInputs(rng, num_inputs, input_size);
+  for (size_t i = 0; i < num_inputs; ++i) {
+    corpus->features.push_back(
+        GenerateFeatures(rng, num_features, /*num_pcs=*/100000));
+  }
+  return corpus;
+}
+
+// Returns the corpus of --corpus_path/--features_path, loaded once.
+std::shared_ptr<CorpusData> LoadCorpus() {
+  static std::shared_ptr<CorpusData> corpus;
+  if (corpus != nullptr) return corpus;
+  const std::string corpus_path = absl::GetFlag(FLAGS_corpus_path);
+  corpus = std::make_shared<CorpusData>();
+  ReadShard(corpus_path, absl::GetFlag(FLAGS_features_path),
+            [&](const ByteArray &input, const FeatureVec &features) {
+              if (input.empty() || features.empty()) return;
+              corpus->inputs.push_back(input);
+              corpus->features.push_back(features);
+            });
+  CHECK(!corpus->inputs.empty())
+      << "No inputs with features in " << corpus_path;
+  LOG(INFO) << "Loaded " << corpus->inputs.size() << " inputs from "
+            << corpus_path;
+  return corpus;
+}
+
+// Returns the average number of features of `corpus`.
+size_t AverageNumFeatures(const CorpusData &corpus) {
+  size_t total = 0;
+  for (const auto &features : corpus.features) total += features.size();
+  return std::max(size_t{1}, total / corpus.features.size());
+}
+
+// Returns the total size of the inputs of `corpus`.
+size_t TotalSize(const std::vector<ByteArray> &inputs) {
+  size_t total = 0;
+  for (const auto &input : inputs) total += input.size();
+  return total;
+}
+
+// The corpus is added to a FeatureSet, then the features of its inputs are
+// counted and pruned again, as in RunBatch() for the inputs of a batch.
+Benchmark FeatureSetBenchmark(std::string name,
+                              std::function<std::shared_ptr<CorpusData>()>
+                                  get_corpus) {
+  return {absl::StrCat("FeatureSet_CountUnseenAndPruneFrequentFeatures/", name),
+          [get_corpus] {
+            auto corpus = get_corpus();
+            auto feature_set = std::make_shared<FeatureSet>(100);
+            for (const auto &features : corpus->features) {
+              feature_set->IncrementFrequencies(features);
+            }
+            auto scratch = std::make_shared<FeatureVec>();
+            auto index = std::make_shared<size_t>(0);
+            return BenchmarkBody{
+                [=] {
+                  const auto &features =
+                      corpus->features[(*index)++ % corpus->features.size()];
+                  scratch->assign(features.begin(), features.end());
+                  DoNotOptimize(
+                      feature_set->CountUnseenAndPruneFrequentFeatures(
+                          *scratch));
+                },
+                AverageNumFeatures(*corpus)};
+          }};
+}
+
+// A batch of mutants is created from a batch of corpus inputs, as in
+// FuzzingLoop() with the default --batch_size and --mutate_batch_size.
+Benchmark MutateManyBenchmark(std::string name,
+                              std::function<std::shared_ptr<CorpusData>()>
+                                  get_corpus) {
+  return {absl::StrCat("ByteArrayMutator_MutateMany/", name), [get_corpus] {
+            constexpr size_t kBatchSize = 1000;
+            constexpr size_t kMutateBatchSize = 2;
+            auto corpus = get_corpus();
+            auto mutator = std::make_shared<ByteArrayMutator>(1);
+            auto inputs = std::make_shared<std::vector<ByteArray>>();
+            auto mutants = std::make_shared<std::vector<ByteArray>>();
+            auto index = std::make_shared<size_t>(0);
+            return BenchmarkBody{
+                [=] {
+                  inputs->clear();
+                  for (size_t i = 0; i < kMutateBatchSize; ++i) {
+                    inputs->push_back(
+                        corpus->inputs[(*index)++ % corpus->inputs.size()]);
+                  }
+                  mutator->MutateMany(*inputs, kBatchSize,
+                                      /*crossover_level=*/50, *mutants);
+                  DoNotOptimize(mutants->data());
+                },
+                kBatchSize};
+          }};
+}
+
+// The corpus inputs are packed and appended, as when written to a blob file,
+// then unpacked.
+Benchmark PackUnpackBenchmark(std::string name,
+                              std::function<std::shared_ptr<CorpusData>()>
+                                  get_corpus) {
+  return {absl::StrCat("PackBytesForAppendFile_Unpack/", name), [get_corpus] {
+            auto corpus = get_corpus();
+            auto packed = std::make_shared<ByteArray>();
+            auto unpacked = std::make_shared<std::vector<ByteArray>>();
+            return BenchmarkBody{
+                [=] {
+                  packed->clear();
+                  for (const auto &input : corpus->inputs) {
+                    const ByteArray bytes = PackBytesForAppendFile(input);
+                    packed->insert(packed->end(), bytes.begin(), bytes.end());
+                  }
+                  unpacked->clear();
+                  UnpackBytesFromAppendFile(*packed, unpacked.get());
+                  DoNotOptimize(unpacked->data());
+                },
+                corpus->inputs.size(), TotalSize(corpus->inputs)};
+          }};
+}
+
+// Random indices are chosen from the weights of a corpus of `size` inputs,
+// as in Corpus::WeightedRandomIndex().
+Benchmark RandomIndexBenchmark(size_t size) {
+  return {absl::StrCat("WeightedDistribution_RandomIndex/", size), [size] {
+            Rng rng(size);
+            auto distribution = std::make_shared<WeightedDistribution>();
+            for (size_t i = 0; i < size; ++i) {
+              distribution->AddWeight(1 + rng() % 1000);
+            }
+            auto random = std::make_shared<Rng>(1);
+            return BenchmarkBody{[=] {
+              DoNotOptimize(distribution->RandomIndex((*random)()));
+            }};
+          }};
+}
+
+// Every iteration writes `num_blobs` blobs of `blob_size` bytes and reads
+// them back, as the runner and the engine do for every batch.
+Benchmark BlobSequenceBenchmark(size_t num_blobs, size_t blob_size) {
+  return {absl::StrCat("SharedMemoryBlobSequence_WriteRead/", num_blobs, "x",
+                       blob_size),
+          [num_blobs, blob_size] {
+            const std::string name = absl::StrCat(
+                "/centipede-microbenchmarks-", getpid(), "-", blob_size);
+            auto blobseq = std::make_shared<SharedMemoryBlobSequence>(
+                name.c_str(), num_blobs * (blob_size + 16) + 64);
+            auto data = std::make_shared<ByteArray>(blob_size, 42);
+            return BenchmarkBody{
+                [=] {
+                  blobseq->Reset();
+                  for (size_t i = 0; i < num_blobs; ++i) {
+                    CHECK(blobseq->Write({1, blob_size, data->data()}));
+                  }
+                  blobseq->Reset();
+                  for (size_t i = 0; i < num_blobs; ++i) {
+                    DoNotOptimize(blobseq->Read().data);
+                  }
+                },
+                num_blobs, num_blobs * blob_size};
+          }};
+}
+
+// The runner writes the results of `num_inputs` inputs with `num_features`
+// features each, the engine reads them with BatchResult::Read(). Only the
+// reading is timed.
+Benchmark BatchResultReadBenchmark(size_t num_inputs, size_t num_features) {
+  return {absl::StrCat("BatchResult_Read/", num_inputs, "x", num_features),
+          [num_inputs, num_features] {
+            const std::string name =
+                absl::StrCat("/centipede-microbenchmarks-", getpid(), "-batch");
+            auto blobseq = std::make_shared<SharedMemoryBlobSequence>(
+                name.c_str(),
+                num_inputs * (num_features * sizeof(feature_t) + 256));
+            Rng rng(num_features);
+            const FeatureVec features =
+                GenerateFeatures(rng, num_features, /*num_pcs=*/100000);
+            for (size_t i = 0; i < num_inputs; ++i) {
+              CHECK(BatchResult::WriteInputBegin(*blobseq));
+              CHECK(BatchResult::WriteOneFeatureVec(
+                  features.data(), features.size(), *blobseq));
+              CHECK(BatchResult::WriteStats({}, *blobseq));
+              CHECK(BatchResult::WriteInputEnd(*blobseq));
+            }
+            auto batch_result = std::make_shared<BatchResult>();
+            return BenchmarkBody{
+                [=] {
+                  blobseq->Reset();
+                  batch_result->ClearAndResize(num_inputs);
+                  CHECK(batch_result->Read(*blobseq));
+                },
+                num_inputs,
+                num_inputs * features.size() * sizeof(feature_t)};
+          }};
+}
+
+// The 8-bit counters of a target with 1M PCs, of which `permille` / 1000 are
+// non-zero, are iterated over, as in the runner after every input.
+Benchmark ForEachNonZeroByteBenchmark(size_t permille) {
+  return {absl::StrCat("ForEachNonZeroByte/", permille, "permille"),
+          [permille] {
+            constexpr size_t kSize = 1 << 20;
+            auto counters = std::make_shared<std::vector<uint8_t>>(kSize);
+            Rng rng(permille);
+            for (auto &counter : *counters) {
+              if (rng() % 1000 < permille) counter = 1 + rng() % 255;
+            }
+            return BenchmarkBody{
+                [=] {
+                  size_t sum = 0;
+                  ForEachNonZeroByte(counters->data(), counters->size(),
+                                     [&](size_t idx, uint8_t value) {
+                                       sum += idx + value;
+                                     });
+                  DoNotOptimize(sum);
+                },
+                kSize, kSize};
+          }};
+}
+
+// A bit set of the size used by the runner for the data-flow, CMP and path
+// features, with `permille` / 1000 of its bits set, is iterated over, as in
+// the runner after every input.
+Benchmark ForEachNonZeroBitBenchmark(size_t permille) {
+  return {absl::StrCat("ConcurrentBitSet_ForEachNonZeroBit/", permille,
+                       "permille"),
+          [permille] {
+            constexpr size_t kSizeInBits = 1 << 18;
+            using BitSet = ConcurrentBitSet<kSizeInBits>;
+            auto bit_set = std::make_shared<BitSet>();
+            Rng rng(permille);
+            const size_t num_bits_set = kSizeInBits * permille / 1000;
+            for (size_t i = 0; i < num_bits_set; ++i) bit_set->set(rng());
+            return BenchmarkBody{
+                [=] {
+                  size_t sum = 0;
+                  bit_set->ForEachNonZeroBit([&](size_t idx) { sum += idx; });
+                  DoNotOptimize(sum);
+                },
+                kSizeInBits, kSizeInBits / 8};
+          }};
+}
+
+std::vector<Benchmark> AllBenchmarks() {
+  std::vector<Benchmark> benchmarks;
+  // The synthetic corpora: small and large inputs, few and many features.
+  struct CorpusConfig {
+    size_t num_inputs;
+    size_t input_size;
+    size_t num_features;
+  };
+  for (const auto &config : {CorpusConfig{100, 64, 100},
+                             CorpusConfig{1000, 1024, 1000},
+                             CorpusConfig{1000, 4096, 10000}}) {
+    const std::string name =
+        absl::StrCat(config.num_inputs, "x", config.input_size, "x",
+                     config.num_features);
+    auto get_corpus = [config] {
+      return GenerateCorpus(config.num_inputs, config.input_size,
+                            config.num_features);
+    };
+    benchmarks.push_back(FeatureSetBenchmark(name, get_corpus));
+    benchmarks.push_back(MutateManyBenchmark(name, get_corpus));
+    benchmarks.push_back(PackUnpackBenchmark(name, get_corpus));
+  }
+  if (!absl::GetFlag(FLAGS_corpus_path).empty()) {
+    benchmarks.push_back(FeatureSetBenchmark("real", LoadCorpus));
+    benchmarks.push_back(MutateManyBenchmark("real", LoadCorpus));
+    benchmarks.push_back(PackUnpackBenchmark("real", LoadCorpus));
+  }
+  for (size_t size : {1000, 100000, 1000000}) {
+    benchmarks.push_back(RandomIndexBenchmark(size));
+  }
+  for (size_t blob_size : {64, 4096, 1 << 20}) {
+    benchmarks.push_back(BlobSequenceBenchmark(
+        std::max(size_t{1}, (1 << 22) / blob_size), blob_size));
+  }
+  benchmarks.push_back(BatchResultReadBenchmark(1000, 100));
+  benchmarks.push_back(BatchResultReadBenchmark(100, 10000));
+  for (size_t permille : {1, 100}) {
+    benchmarks.push_back(ForEachNonZeroByteBenchmark(permille));
+    benchmarks.push_back(ForEachNonZeroBitBenchmark(permille));
+  }
+  return benchmarks;
+}
+
+// Returns `results` in the JSON format of Google Benchmark.
+std::string ResultsToJson(const std::vector<BenchmarkResult> &results) {
+  char host_name[256] = {};
+  gethostname(host_name, sizeof(host_name) - 1);
+  std::string json = absl::StrFormat(
+      "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"host_name\": "
+      "\"%s\",\n    \"num_cpus\": %d,\n    \"library_build_type\": \"%s\"\n  "
+      "},\n  \"benchmarks\": [",
+      absl::FormatTime(absl::RFC3339_sec, absl::Now(), absl::LocalTimeZone()),
+      host_name, std::thread::hardware_concurrency(),
+#ifdef NDEBUG
+      "release"
+#else
+      "debug"
+#endif
+  );
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto &result = results[i];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\n      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n"
+        "      \"run_type\": \"iteration\",\n      \"iterations\": %d,\n"
+        "      \"real_time\": %.3f,\n      \"cpu_time\": %.3f,\n"
+        "      \"time_unit\": \"ns\",\n      \"items_per_second\": %.3f,\n"
+        "      \"bytes_per_second\": %.3f\n    }",
+        i ? "," : "", result.name, result.name, result.iterations,
+        result.real_time_ns, result.cpu_time_ns, result.items_per_second,
+        result.bytes_per_second);
+  }
+  absl::StrAppend(&json, "\n  ]\n}\n");
+  return json;
+}
+
+int RunBenchmarks() {
+  const std::string filter = absl::GetFlag(FLAGS_benchmark_filter);
+  const absl::Duration min_time =
+      absl::Seconds(absl::GetFlag(FLAGS_benchmark_min_time));
+  std::vector<BenchmarkResult> results;
+  std::cerr << absl::StrFormat("%-60s %14s %14s %12s %14s\n", "Benchmark",
+                               "Time(ns)", "CPU(ns)", "Iterations",
+                               "Items/s");
+  for (const auto &benchmark : AllBenchmarks()) {
+    if (!absl::StrContains(benchmark.name, filter)) continue;
+    const auto &result =
+        results.emplace_back(RunBenchmark(benchmark, min_time));
+    std::cerr << absl::StrFormat("%-60s %14.1f %14.1f %12d %14.4g\n",
+                                 result.name, result.real_time_ns,
+                                 result.cpu_time_ns, result.iterations,
+                                 result.items_per_second);
+  }
+  const std::string json = ResultsToJson(results);
+  const std::string out_path = absl::GetFlag(FLAGS_benchmark_out);
+  if (out_path.empty()) {
+    std::cout << json;
+  } else {
+    RemoteFile *file = RemoteFileOpen(out_path, "w");
+    CHECK(file != nullptr) << "Failed to open " << out_path;
+    RemoteFileAppend(file, ByteArray(json.begin(), json.end()));
+    RemoteFileClose(file);
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace
+}  // namespace centipede
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+  return centipede::RunBenchmarks();
+}
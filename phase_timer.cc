@@ -0,0 +1,222 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./phase_timer.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./execution_result.h"
+#include "./logging.h"
+#include "./metrics.h"
+
+namespace centipede {
+
+namespace {
+
+// Short names for the log line and full names for the report.
+constexpr const char *kShortPhaseNames[] = {"mut", "exe", "tri",
+                                            "prn", "syn", "tel"};
+constexpr const char *kPhaseNames[] = {"mutate", "execute", "triage",
+                                       "prune",  "sync",    "telemetry"};
+static_assert(std::size(kShortPhaseNames) ==
+              static_cast<size_t>(Phase::kNumPhases));
+static_assert(std::size(kPhaseNames) == static_cast<size_t>(Phase::kNumPhases));
+constexpr Counter kPhaseCounters[] = {
+    Counter::kMutateUsec, Counter::kExecuteUsec, Counter::kTriageUsec,
+    Counter::kPruneUsec,  Counter::kSyncUsec,    Counter::kTelemetryUsec};
+static_assert(std::size(kPhaseCounters) ==
+              static_cast<size_t>(Phase::kNumPhases));
+
+// Returns `part` as a percentage of `whole`, rounded down.
+int Percent(absl::Duration part, absl::Duration whole) {
+  if (whole <= absl::ZeroDuration()) return 0;
+  return static_cast<int>(100 * absl::FDivDuration(part, whole));
+}
+
+}  // namespace
+
+const char *PhaseName(Phase phase) {
+  CHECK(phase != Phase::kNumPhases);
+  return kPhaseNames[static_cast<size_t>(phase)];
+}
+
+PhaseTimer::PhaseTimer(ThreadMetrics *metrics)
+    : metrics_(metrics),
+      start_(absl::Now()),
+      interval_start_(start_),
+      start_cpu_time_(ThreadCpuTime()),
+      interval_start_cpu_time_(start_cpu_time_),
+      current_start_(start_) {}
+
+PhaseTimer::~PhaseTimer() { AccountCurrentPhase(); }
+
+absl::Duration PhaseTimer::ThreadCpuTime() {
+  struct rusage rusage = {};
+  if (getrusage(RUSAGE_THREAD, &rusage) != 0) return absl::ZeroDuration();
+  return absl::DurationFromTimeval(rusage.ru_utime) +
+         absl::DurationFromTimeval(rusage.ru_stime);
+}
+
+void PhaseTimer::AccountCurrentPhase() {
+  const absl::Time now = absl::Now();
+  const absl::Duration slice = now - current_start_;
+  current_start_ = now;
+  absl::Duration *total = &total_other_;
+  Counter counter = Counter::kOtherUsec;
+  if (!phase_stack_.empty()) {
+    const auto phase = static_cast<size_t>(phase_stack_.back());
+    interval_.phases[phase] += slice;
+    total = &total_.phases[phase];
+    counter = kPhaseCounters[phase];
+  }
+  const int64_t prev_total_usec = absl::ToInt64Microseconds(*total);
+  *total += slice;
+  // Adds the whole microseconds of the total, so that the rounding errors of
+  // the slices do not add up.
+  if (metrics_ != nullptr) {
+    metrics_->Increment(counter,
+                        absl::ToInt64Microseconds(*total) - prev_total_usec);
+  }
+}
+
+void PhaseTimer::Enter(Phase phase) {
+  CHECK(phase != Phase::kNumPhases);
+  AccountCurrentPhase();
+  phase_stack_.push_back(phase);
+}
+
+void PhaseTimer::Leave() {
+  CHECK(!phase_stack_.empty());
+  AccountCurrentPhase();
+  phase_stack_.pop_back();
+}
+
+void PhaseTimer::AddRunnerStats(const ExecutionResult::Stats &stats) {
+  for (Times *times : {&total_, &interval_}) {
+    times->prep_time_usec += stats.prep_time_usec;
+    times->exec_time_usec += stats.exec_time_usec;
+    times->post_time_usec += stats.post_time_usec;
+    times->instructions += stats.instructions;
+    times->task_clock_nsec += stats.task_clock_nsec;
+    times->page_faults += stats.page_faults;
+  }
+  if (metrics_ != nullptr) {
+    metrics_->Increment(Counter::kRunnerPrepUsec, stats.prep_time_usec);
+    metrics_->Increment(Counter::kRunnerExecUsec, stats.exec_time_usec);
+    metrics_->Increment(Counter::kRunnerPostUsec, stats.post_time_usec);
+  }
+}
+
+void PhaseTimer::AddRunnerRUsage(const BatchResult::RunnerRUsage &rusage) {
+  if (!rusage.known) return;
+  for (Times *times : {&total_, &interval_}) {
+    times->runner_rusage_known = true;
+    times->runner_cpu_time_usec += rusage.user_time_usec + rusage.sys_time_usec;
+    times->runner_max_rss_kb =
+        std::max(times->runner_max_rss_kb, rusage.max_rss_kb);
+  }
+}
+
+std::string PhaseTimer::IntervalString() {
+  // Account the current phase up to now, so that long phases are visible.
+  AccountCurrentPhase();
+  const absl::Time now = absl::Now();
+  const absl::Duration wall_time = now - interval_start_;
+  const absl::Duration execute_time =
+      interval_.phases[static_cast<size_t>(Phase::kExecute)];
+  const absl::Duration target_time = absl::Microseconds(
+      interval_.prep_time_usec + interval_.exec_time_usec +
+      interval_.post_time_usec);
+  std::string result = "phase%:";
+  for (size_t i = 0; i < static_cast<size_t>(Phase::kNumPhases); ++i) {
+    absl::StrAppend(&result, " ", kShortPhaseNames[i], " ",
+                    Percent(interval_.phases[i], wall_time));
+    if (i == static_cast<size_t>(Phase::kExecute)) {
+      // With several executors, the target time may exceed the wall time.
+      absl::StrAppend(
+          &result, " (tgt ", Percent(target_time, wall_time), " ipc ",
+          Percent(std::max(execute_time - target_time, absl::ZeroDuration()),
+                  wall_time),
+          ")");
+    }
+  }
+  const absl::Duration cpu_time = ThreadCpuTime();
+  absl::StrAppend(&result, " cpu%: eng ",
+                  Percent(cpu_time - interval_start_cpu_time_, wall_time));
+  if (interval_.runner_rusage_known) {
+    absl::StrAppend(
+        &result, " tgt ",
+        Percent(absl::Microseconds(interval_.runner_cpu_time_usec), wall_time),
+        " rss ", interval_.runner_max_rss_kb >> 10);
+  }
+  interval_.Clear();
+  interval_start_ = now;
+  interval_start_cpu_time_ = cpu_time;
+  return result;
+}
+
+std::string PhaseTimer::ReportString() const {
+  const absl::Duration wall_time = absl::Now() - start_;
+  std::string result = absl::StrFormat(
+      "=== Engine time by phase ===\nwall: %.3fs\n",
+      absl::ToDoubleSeconds(wall_time));
+  absl::Duration accounted_time;
+  for (size_t i = 0; i < static_cast<size_t>(Phase::kNumPhases); ++i) {
+    accounted_time += total_.phases[i];
+    absl::StrAppendFormat(&result, "%s: %.3fs (%d%%)\n", kPhaseNames[i],
+                          absl::ToDoubleSeconds(total_.phases[i]),
+                          Percent(total_.phases[i], wall_time));
+  }
+  absl::StrAppendFormat(
+      &result, "other: %.3fs (%d%%)\n",
+      absl::ToDoubleSeconds(wall_time - accounted_time),
+      Percent(wall_time - accounted_time, wall_time));
+  absl::StrAppendFormat(
+      &result,
+      "runner prep: %.3fs exec: %.3fs post: %.3fs (sums over all inputs)\n",
+      total_.prep_time_usec / 1e6, total_.exec_time_usec / 1e6,
+      total_.post_time_usec / 1e6);
+  if (total_.instructions || total_.task_clock_nsec || total_.page_faults) {
+    absl::StrAppendFormat(&result,
+                          "runner instructions: %d task-clock: %.3fs "
+                          "page-faults: %d (sums over all inputs)\n",
+                          total_.instructions, total_.task_clock_nsec / 1e9,
+                          total_.page_faults);
+  }
+  const absl::Duration engine_cpu_time = EngineCpuTime();
+  absl::StrAppendFormat(&result, "engine thread cpu: %.3fs\n",
+                        absl::ToDoubleSeconds(engine_cpu_time));
+  if (total_.runner_rusage_known) {
+    const absl::Duration runner_cpu_time = RunnerCpuTime();
+    absl::StrAppendFormat(
+        &result,
+        "runner cpu: %.3fs (%d%% of engine+runner cpu) peak rss: %dMb\n",
+        absl::ToDoubleSeconds(runner_cpu_time),
+        Percent(runner_cpu_time, engine_cpu_time + runner_cpu_time),
+        total_.runner_max_rss_kb >> 10);
+  }
+  return result;
+}
+
+}  // namespace centipede
@@ -0,0 +1,149 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Accounting of the engine's wall time by phase of the fuzzing loop, combined
+// with the runner-side time stats (ExecutionResult::Stats) and the CPU time
+// and peak RSS of the runner processes (BatchResult::RunnerRUsage).
+
+#ifndef THIRD_PARTY_CENTIPEDE_PHASE_TIMER_H_
+#define THIRD_PARTY_CENTIPEDE_PHASE_TIMER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "./execution_result.h"
+#include "./metrics.h"
+#include "./tracing.h"
+
+namespace centipede {
+
+// The phases of the fuzzing loop.
+enum class Phase : size_t {
+  kMutate,     // Creating the mutants.
+  kExecute,    // Executing the inputs, including IPC and crash reporting.
+  kTriage,     // Processing the features, adding to corpus, writing files.
+  kPrune,      // Pruning the corpus.
+  kSync,       // Loading shards, exchanging the corpus.
+  kTelemetry,  // Generating the telemetry files.
+  kNumPhases,
+};
+
+// Returns the name of `phase`, e.g. "mutate".
+const char *PhaseName(Phase phase);
+
+// Accumulates the time spent in every phase, both in total and per interval
+// (between the calls to IntervalString()), and adds the totals to the
+// counters of a ThreadMetrics, if any.
+// Phases may nest (e.g. kExecute inside kSync when a loaded shard is rerun);
+// the time is attributed to the innermost phase.
+// This class is thread-compatible.
+class PhaseTimer {
+ public:
+  // Attributes the time of its lifetime to `phase`, and records it as a
+  // span of the timeline if tracing is enabled.
+  class Scope {
+   public:
+    Scope(PhaseTimer &timer, Phase phase)
+        : timer_(timer), trace_span_(PhaseName(phase)) {
+      timer_.Enter(phase);
+    }
+    ~Scope() { timer_.Leave(); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    PhaseTimer &timer_;
+    TraceSpan trace_span_;
+  };
+
+  // `metrics`, if not null, must outlive the timer.
+  explicit PhaseTimer(ThreadMetrics *metrics = nullptr);
+  // Accounts the time since the last phase to Counter::kOtherUsec.
+  ~PhaseTimer();
+
+  // Adds the runner-side times and performance counters of one executed input.
+  void AddRunnerStats(const ExecutionResult::Stats &stats);
+  // Adds the resource usage of the runner processes of one batch.
+  void AddRunnerRUsage(const BatchResult::RunnerRUsage &rusage);
+
+  // Returns a compact description of the current interval, for the log line:
+  // the percentage of the wall time spent in every phase, with the execution
+  // split into the time spent by the target (as reported by the runner) and
+  // the rest (IPC, process management); followed by the CPU time of the
+  // engine thread and of the runners, as a percentage of the wall time, and
+  // the peak RSS of the runners in the interval. Starts a new interval.
+  std::string IntervalString();
+
+  // Returns a multi-line report of the cumulative times since construction.
+  std::string ReportString() const;
+
+  // Returns the CPU time of the engine thread since construction. Must be
+  // called by the thread that created the timer.
+  absl::Duration EngineCpuTime() const {
+    return ThreadCpuTime() - start_cpu_time_;
+  }
+  // Returns the CPU time of the runners since construction, zero if unknown.
+  absl::Duration RunnerCpuTime() const {
+    return absl::Microseconds(total_.runner_cpu_time_usec);
+  }
+
+ private:
+  struct Times {
+    std::array<absl::Duration, static_cast<size_t>(Phase::kNumPhases)> phases;
+    uint64_t prep_time_usec = 0;
+    uint64_t exec_time_usec = 0;
+    uint64_t post_time_usec = 0;
+    uint64_t instructions = 0;
+    uint64_t task_clock_nsec = 0;
+    uint64_t page_faults = 0;
+    uint64_t runner_cpu_time_usec = 0;
+    uint64_t runner_max_rss_kb = 0;
+    bool runner_rusage_known = false;
+
+    void Clear() { *this = Times(); }
+  };
+
+  void Enter(Phase phase);
+  void Leave();
+  // Attributes the time since `current_start_` to the current phase, or to
+  // the time outside of the phases.
+  void AccountCurrentPhase();
+  // Returns the CPU time of the calling thread.
+  static absl::Duration ThreadCpuTime();
+
+  ThreadMetrics *const metrics_;
+  Times total_;
+  Times interval_;
+  // The total time outside of the phases, as of the last AccountCurrentPhase().
+  absl::Duration total_other_;
+  const absl::Time start_;
+  absl::Time interval_start_;
+  // The CPU time of the engine thread (the one that created the timer) at
+  // `start_` and `interval_start_`.
+  const absl::Duration start_cpu_time_;
+  absl::Duration interval_start_cpu_time_;
+  // The stack of the phases being timed and the start of the current slice
+  // of the innermost one.
+  std::vector<Phase> phase_stack_;
+  absl::Time current_start_;
+};
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_PHASE_TIMER_H_
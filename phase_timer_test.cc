@@ -0,0 +1,105 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./phase_timer.h"
+
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+#include "absl/strings/match.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./execution_result.h"
+#include "./metrics.h"
+
+namespace centipede {
+namespace {
+
+TEST(PhaseTimer, AttributesTimeToInnermostPhase) {
+  PhaseTimer timer;
+  {
+    PhaseTimer::Scope sync(timer, Phase::kSync);
+    absl::SleepFor(absl::Milliseconds(100));
+    {
+      PhaseTimer::Scope execute(timer, Phase::kExecute);
+      absl::SleepFor(absl::Milliseconds(300));
+    }
+  }
+  ExecutionResult::Stats stats;
+  stats.exec_time_usec = 200000;
+  stats.instructions = 1000;
+  stats.page_faults = 3;
+  timer.AddRunnerStats(stats);
+  timer.AddRunnerRUsage({.known = true,
+                         .user_time_usec = 150000,
+                         .sys_time_usec = 50000,
+                         .max_rss_kb = 2048});
+  timer.AddRunnerRUsage({.known = false});
+
+  const std::string interval = timer.IntervalString();
+  // The exact percentages depend on the machine load.
+  EXPECT_TRUE(absl::StartsWith(interval, "phase%: mut 0 exe ")) << interval;
+  EXPECT_TRUE(absl::StrContains(interval, "(tgt 4")) << interval;
+  EXPECT_TRUE(absl::StrContains(interval, " prn 0 syn ")) << interval;
+  EXPECT_FALSE(absl::StrContains(interval, " syn 0 ")) << interval;
+  EXPECT_TRUE(absl::StrContains(interval, " cpu%: eng ")) << interval;
+  EXPECT_TRUE(absl::EndsWith(interval, " rss 2")) << interval;
+
+  // The interval starts anew, the totals remain.
+  const std::string next_interval = timer.IntervalString();
+  EXPECT_TRUE(absl::StartsWith(next_interval,
+                               "phase%: mut 0 exe 0 (tgt 0 ipc 0) tri 0"));
+  EXPECT_FALSE(absl::StrContains(next_interval, " rss ")) << next_interval;
+  const std::string report = timer.ReportString();
+  EXPECT_TRUE(absl::StrContains(report, "execute: 0.3")) << report;
+  EXPECT_TRUE(absl::StrContains(report, "sync: 0.1")) << report;
+  EXPECT_TRUE(absl::StrContains(report, "runner prep: 0.000s exec: 0.200s"))
+      << report;
+  EXPECT_TRUE(absl::StrContains(
+      report, "runner instructions: 1000 task-clock: 0.000s page-faults: 3"))
+      << report;
+  EXPECT_TRUE(absl::StrContains(report, "engine thread cpu: ")) << report;
+  EXPECT_TRUE(absl::StrContains(report, "runner cpu: 0.200s (")) << report;
+  EXPECT_TRUE(absl::StrContains(report, "peak rss: 2Mb")) << report;
+}
+
+TEST(PhaseTimer, AddsTotalsToMetrics) {
+  ThreadMetrics metrics;
+  {
+    PhaseTimer timer(&metrics);
+    absl::SleepFor(absl::Milliseconds(100));
+    {
+      PhaseTimer::Scope mutate(timer, Phase::kMutate);
+      absl::SleepFor(absl::Milliseconds(200));
+    }
+    ExecutionResult::Stats stats;
+    stats.prep_time_usec = 10;
+    stats.exec_time_usec = 20;
+    stats.post_time_usec = 30;
+    timer.AddRunnerStats(stats);
+    timer.AddRunnerStats(stats);
+    EXPECT_GE(metrics.Get(Counter::kMutateUsec), 200000);
+    EXPECT_LT(metrics.Get(Counter::kMutateUsec), 300000);
+    EXPECT_EQ(metrics.Get(Counter::kExecuteUsec), 0);
+    EXPECT_EQ(metrics.Get(Counter::kRunnerPrepUsec), 20);
+    EXPECT_EQ(metrics.Get(Counter::kRunnerExecUsec), 40);
+    EXPECT_EQ(metrics.Get(Counter::kRunnerPostUsec), 60);
+    absl::SleepFor(absl::Milliseconds(100));
+  }
+  // The time after the last phase is accounted by the destructor.
+  EXPECT_GE(metrics.Get(Counter::kOtherUsec), 200000);
+}
+
+}  // namespace
+}  // namespace centipede
@@ -0,0 +1,244 @@
+#!/bin/bash
+
+# Copyright 2022 The Centipede Authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Time-to-solve scoreboard of the puzzles.
+#
+# Runs every puzzle with many seeds and records the executions and the wall
+# time until the expected crash (see "Time to crash" in Centipede's log). A run
+# solves the puzzle only if its log also meets the expectations of the "RUN:"
+# lines of the puzzle (SolutionIs, ExpectInLog, etc, see run_puzzle.sh): any
+# other crash, OOM or timeout leaves the puzzle unsolved.
+# For every puzzle, prints the median executions and seconds to solve with
+# their 95% confidence intervals. An unsolved run counts as solved after an
+# infinite time, so the median is "inf" if at most half of the runs solved the
+# puzzle.
+#
+#   bazel run -c opt //puzzles:scoreboard -- [scoreboard.tsv [baseline.tsv]]
+#
+# The scoreboard is written to the first argument (default: stdout), in the
+# format it reads the baseline in. With a baseline, also prints how every
+# puzzle changed: "faster" or "slower" if the confidence intervals of the
+# median executions don't overlap, "same" otherwise.
+#
+# Environment variables:
+#   PUZZLES="byte_cmp_4 memcmp_4 ..."  # Default: all puzzles with a Run.
+#   NUM_SEEDS=20                       # Seeds 1..NUM_SEEDS.
+#   NUM_RUNS=2000000                   # The execution budget of a run.
+#   MAX_SECONDS=300                    # The wall time budget of a run.
+#   RAW_RESULTS=path                   # Also writes the result of every run.
+# The puzzles are run with the flags of their first "RUN: Run" line.
+
+set -eu
+
+source "$(dirname "$0")/../test_util.sh"
+
+# Under `bazel run`, the data deps are in the runfiles of this script.
+readonly RUNFILES_ROOT="${TEST_SRCDIR:-${RUNFILES_DIR:-$0.runfiles}}"
+readonly CENTIPEDE_RUNFILES="${RUNFILES_ROOT}/${TEST_WORKSPACE:-centipede}"
+readonly PUZZLES_DIR="${CENTIPEDE_RUNFILES}/puzzles"
+
+centipede::maybe_set_var_to_executable_path \
+  CENTIPEDE_BINARY "${CENTIPEDE_RUNFILES}/centipede"
+
+readonly NUM_SEEDS="${NUM_SEEDS:-20}"
+readonly NUM_RUNS="${NUM_RUNS:-2000000}"
+readonly MAX_SECONDS="${MAX_SECONDS:-300}"
+
+readonly TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+# Prints the flags of the first "RUN: Run" line of puzzle $1, fails if there
+# is none.
+puzzle_flags() {
+  local -r source_path="${PUZZLES_DIR}/$1.cc"
+  grep -q 'RUN: *Run\b' "${source_path}" || return 1
+  grep -m1 'RUN: *Run\b' "${source_path}" \
+    | sed 's/^.*RUN: *Run\b//; s/&&.*$//'
+}
+
+# Prints all puzzles that have a "RUN: Run" line.
+all_puzzles() {
+  local source_path
+  for source_path in "${PUZZLES_DIR}"/*.cc; do
+    local puzzle
+    puzzle="$(basename "${source_path}" .cc)"
+    if puzzle_flags "${puzzle}" > /dev/null; then echo "${puzzle}"; fi
+  done
+}
+
+# Returns success if the log $2 meets the expectations of the "RUN:" lines of
+# puzzle $1. The checks mirror the functions of run_puzzle.sh, except that they
+# fail quietly; the flags of "Run" are already applied by run_one.
+meets_expectations() {
+  local -r puzzle="$1"
+  local -r log_path="$2"
+  (
+    Run() { :; }
+    in_log() { grep -q -- "$1" "${log_path}" || exit 1; }
+    SolutionIs() { in_log "Input bytes: $1"; }
+    ExpectInLog() { in_log "$1"; }
+    ExpectTimeout() { in_log "Failure description: timeout-exceeded"; }
+    ExpectOOM() { in_log "Failure description: out-of-memory"; }
+    # shellcheck disable=SC1090
+    source <(grep 'RUN:' "${PUZZLES_DIR}/${puzzle}.cc" | sed 's/^.*RUN://')
+  )
+}
+
+# Runs puzzle $1 with seed $2 and prints one line:
+#   <puzzle> <seed> <execs> <seconds>
+# where execs and seconds are "inf" if the puzzle wasn't solved, including if
+# the run crashed other than expected.
+run_one() {
+  local -r puzzle="$1"
+  local -r seed="$2"
+  local -r wd="${TMP_DIR}/wd"
+  local -r log_path="${TMP_DIR}/log"
+  local flags
+  flags="$(puzzle_flags "${puzzle}")"
+  rm -rf "${wd}"
+  mkdir -p "${wd}"
+  # Centipede exits with failure when it finds the crash.
+  # shellcheck disable=SC2086  # flags must be split.
+  timeout "${MAX_SECONDS}" "${CENTIPEDE_BINARY}" \
+    --workdir="${wd}" --binary="${PUZZLES_DIR}/${puzzle}" \
+    --symbolizer_path=/dev/null --seed="${seed}" --num_runs="${NUM_RUNS}" \
+    --timeout=10 --exit_on_crash ${flags} \
+    > "${log_path}" 2>&1 || true
+  local time_to_crash
+  time_to_crash="$(grep -m1 -o \
+    'Time to crash: execs: [0-9]* seconds: [0-9.]*' "${log_path}" || true)"
+  if [[ -n "${time_to_crash}" ]] \
+    && meets_expectations "${puzzle}" "${log_path}"; then
+    echo "${puzzle} ${seed} $(echo "${time_to_crash}" | awk '{print $5, $7}')"
+  else
+    echo "${puzzle} ${seed} inf inf"
+  fi
+}
+
+# Reads the lines of run_one and prints the scoreboard: one line per puzzle,
+# with the median executions and seconds and their 95% confidence intervals.
+# The confidence interval of the median of n values are the values of ranks
+# n/2 -/+ 1.96 * sqrt(n) / 2 (+1 for the upper rank), the normal approximation
+# of the binomial distribution of the number of values below the median.
+summarize() {
+  awk '
+    function sort(a, n,   i, j, t) {
+      for (i = 2; i <= n; ++i) {
+        t = a[i];
+        for (j = i - 1; j >= 1 && a[j] > t; --j) a[j + 1] = a[j];
+        a[j + 1] = t;
+      }
+    }
+    function value(x) { return x == inf ? "inf" : x; }
+    # Sets the median of a[1..n] and its confidence interval in m[].
+    function median_ci(a, n, m,   lo, hi) {
+      sort(a, n);
+      lo = int(n / 2 - 0.98 * sqrt(n) + 0.5);
+      hi = int(n / 2 + 1 + 0.98 * sqrt(n) + 0.5);
+      if (lo < 1) lo = 1;
+      if (hi > n) hi = n;
+      if (n % 2) {
+        m["median"] = a[(n + 1) / 2];
+      } else if (a[n / 2 + 1] == inf) {
+        m["median"] = inf;
+      } else {
+        m["median"] = (a[n / 2] + a[n / 2 + 1]) / 2;
+      }
+      m["lo"] = a[lo];
+      m["hi"] = a[hi];
+    }
+    BEGIN {
+      inf = 1e300;
+      printf("%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n", "puzzle", "runs",
+             "solved", "execs", "execs_lo", "execs_hi", "seconds",
+             "seconds_lo", "seconds_hi");
+    }
+    {
+      if (!($1 in num_runs)) puzzles[++num_puzzles] = $1;
+      n = ++num_runs[$1];
+      execs[$1, n] = $3 == "inf" ? inf : $3 + 0;
+      seconds[$1, n] = $4 == "inf" ? inf : $4 + 0;
+      if ($3 != "inf") ++num_solved[$1];
+    }
+    END {
+      for (p = 1; p <= num_puzzles; ++p) {
+        puzzle = puzzles[p];
+        n = num_runs[puzzle];
+        for (i = 1; i <= n; ++i) {
+          e[i] = execs[puzzle, i];
+          s[i] = seconds[puzzle, i];
+        }
+        median_ci(e, n, me);
+        median_ci(s, n, ms);
+        printf("%s\t%d\t%d\t%s\t%s\t%s\t%s\t%s\t%s\n", puzzle, n,
+               num_solved[puzzle], value(me["median"]), value(me["lo"]),
+               value(me["hi"]), value(ms["median"]), value(ms["lo"]),
+               value(ms["hi"]));
+      }
+    }'
+}
+
+# Compares the scoreboard $1 with the baseline $2 and prints one line per
+# puzzle in both.
+compare() {
+  awk -F'\t' '
+    function num(x) { return x == "inf" ? 1e300 : x + 0; }
+    FNR == 1 { next; }  # The header.
+    FNR == NR { base[$1] = $0; next; }
+    $1 in base {
+      split(base[$1], b, "\t");
+      if (num($6) < num(b[5])) {
+        verdict = "faster";
+      } else if (num($5) > num(b[6])) {
+        verdict = "slower";
+      } else {
+        verdict = "same";
+      }
+      ratio = "-";
+      if (num(b[4]) > 0 && num(b[4]) < 1e300 && num($4) < 1e300) {
+        ratio = sprintf("%.2fx", num($4) / num(b[4]));
+      }
+      printf("%-24s execs %s -> %s (%s) solved %d/%d -> %d/%d: %s\n", $1,
+             b[4], $4, ratio, b[3], b[2], $3, $2, verdict);
+    }' "$2" "$1"
+}
+
+main() {
+  local -r out="${1:-/dev/stdout}"
+  local -r baseline="${2:-}"
+  local -r raw="${RAW_RESULTS:-${TMP_DIR}/raw}"
+  local puzzles
+  puzzles="${PUZZLES:-$(all_puzzles)}"
+  : > "${raw}"
+  for puzzle in ${puzzles}; do
+    puzzle_flags "${puzzle}" > /dev/null \
+      || die "${puzzle} has no 'RUN: Run' line"
+    for seed in $(seq 1 "${NUM_SEEDS}"); do
+      local result
+      result="$(run_one "${puzzle}" "${seed}")"
+      echo "${result}" >&2
+      echo "${result}" >> "${raw}"
+    done
+  done
+  summarize < "${raw}" > "${TMP_DIR}/scoreboard"
+  cat "${TMP_DIR}/scoreboard" > "${out}"
+  if [[ -n "${baseline}" ]]; then
+    echo "======== Compared with ${baseline}"
+    compare "${TMP_DIR}/scoreboard" "${baseline}"
+  fi
+}
+
+main "$@"
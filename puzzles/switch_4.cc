@@ -0,0 +1,61 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Centipede puzzle: a switch on a 4-byte magic value with many cases.
+// RUN: Run && SolutionIs Fuzz
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+static volatile int sink;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  uint32_t value;
+  if (size != sizeof(value)) return 0;
+  memcpy(&value, data, sizeof(value));
+  // The case values are little-endian 4-character strings.
+  switch (value) {
+    case 0x46464952:  // "RIFF"
+      sink = 1;
+      break;
+    case 0x474e5089:  // "\x89PNG"
+      sink = 2;
+      break;
+    case 0x464c457f:  // "\x7f" "ELF"
+      sink = 3;
+      break;
+    case 0x04034b50:  // "PK\x03\x04"
+      sink = 4;
+      break;
+    case 0x38464947:  // "GIF8"
+      sink = 5;
+      break;
+    case 0x46445025:  // "%PDF"
+      sink = 6;
+      break;
+    case 0x6d783f3c:  // "<?xm"
+      sink = 7;
+      break;
+    case 0x7a7a7546:  // "Fuzz"
+      abort();
+    case 0xe0ffd8ff:  // JPEG
+      sink = 8;
+      break;
+    case 0x002a4949:  // "II*\0"
+      sink = 9;
+      break;
+  }
+  return 0;
+}
@@ -23,16 +23,22 @@
 #include "./runner.h"
 
 #include <elf.h>
+#include <errno.h>
 #include <limits.h>
-#include <link.h>     // dl_iterate_phdr
+#include <link.h>  // dl_iterate_phdr
+#include <linux/perf_event.h>
+#include <poll.h>
 #include <pthread.h>  // NOLINT: use pthread to avoid extra dependencies.
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/auxv.h>
+#include <sys/ioctl.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -44,7 +50,9 @@
 #include "./execution_request.h"
 #include "./execution_result.h"
 #include "./feature.h"
+#include "./runner_cmp_trace.h"
 #include "./runner_interface.h"
+#include "./runner_snapshot.h"
 #include "./shared_memory_blob_sequence.h"
 
 namespace centipede {
@@ -92,12 +100,89 @@ static size_t GetPeakRSSMb() {
   return usage.ru_maxrss >> 10;
 }
 
-// Returns the current time in microseconds.
-static uint64_t TimeInUsec() {
-  struct timeval tv = {};
-  constexpr size_t kUsecInSec = 1000000;
-  gettimeofday(&tv, nullptr);
-  return tv.tv_sec * kUsecInSec + tv.tv_usec;
+// Returns the time of the monotonic clock in nanoseconds.
+// Unlike gettimeofday(), it is not affected by adjustments of the wall clock,
+// and its resolution is fine enough to time fast inputs.
+static uint64_t MonotonicTimeInNsec() {
+  struct timespec ts = {};
+  constexpr uint64_t kNsecInSec = 1000000000;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * kNsecInSec + ts.tv_nsec;
+}
+
+// Implemented in runner_fork_server.cc. Declared here for the same reason as
+// ForkServerCallMeVeryEarly() below.
+bool IsForkServerChild();
+size_t ForkServerChildIndex();
+bool ForkServerChildReportAndWait(int exit_code, const struct rusage &rusage);
+
+// The events counted by the performance counters, see OpenPerfCounters().
+static constexpr struct {
+  uint32_t type;
+  uint64_t config;
+  const char *name;
+} kPerfEvents[GlobalRunnerState::kNumPerfCounters] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "task-clock"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page-faults"},
+};
+
+void GlobalRunnerState::OpenPerfCounters() {
+  if (perf_counters_opened) return;
+  perf_counters_opened = true;
+  if (!HasFlag(":perf_counters:")) return;
+  for (size_t i = 0; i < kNumPerfCounters; ++i) {
+    struct perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = kPerfEvents[i].type;
+    attr.config = kPerfEvents[i].config;
+    // The group is enabled around every input, see RunOneInput().
+    attr.disabled = perf_group_fd < 0;
+    // Count only the user space: this is allowed with the default
+    // perf_event_paranoid, and it is where the target spends its time.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // Counts the calling (main) thread on any CPU.
+    const int fd = syscall(SYS_perf_event_open, &attr, /*pid=*/0, /*cpu=*/-1,
+                           perf_group_fd, /*flags=*/0);
+    if (fd < 0) {
+      // E.g. no hardware counters in a VM, or perf events are disallowed.
+      // Every child of the fork server fails the same way: report it once.
+      if (ForkServerChildIndex() == 0) {
+        fprintf(stderr, "perf_event_open(%s) failed: %s; not counting it\n",
+                kPerfEvents[i].name, strerror(errno));
+      }
+      continue;
+    }
+    if (perf_group_fd < 0) perf_group_fd = fd;
+    perf_counter_index[i] = num_perf_counters++;
+  }
+}
+
+// Resets and starts the performance counters, if any. Opens them first, if
+// this is the first input of the process.
+static void StartPerfCounters() {
+  state.OpenPerfCounters();
+  if (state.perf_group_fd < 0) return;
+  ioctl(state.perf_group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(state.perf_group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+// Stops the performance counters, if any, and stores them in `stats`.
+static void StopPerfCounters(ExecutionResult::Stats &stats) {
+  if (state.perf_group_fd < 0) return;
+  ioctl(state.perf_group_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  // The PERF_FORMAT_GROUP layout: the number of counters, then the values.
+  uint64_t values[1 + GlobalRunnerState::kNumPerfCounters] = {};
+  if (read(state.perf_group_fd, values, sizeof(values)) <= 0) return;
+  auto value = [&](GlobalRunnerState::PerfCounter counter) -> uint64_t {
+    const int index = state.perf_counter_index[counter];
+    return index < 0 ? 0 : values[1 + index];
+  };
+  stats.instructions = value(GlobalRunnerState::kInstructions);
+  stats.task_clock_nsec = value(GlobalRunnerState::kTaskClock);
+  stats.page_faults = value(GlobalRunnerState::kPageFaults);
 }
 
 static void CheckOOM() {
@@ -113,45 +198,91 @@ static void CheckOOM() {
   }
 }
 
+void MallocLimitExceeded(size_t size) {
+  fprintf(stderr,
+          "========= OOM, malloc(%zd) exceeds the malloc limit of %zdMb; "
+          "exiting\n",
+          size, state.run_time_flags.malloc_limit_mb);
+  WriteFailureDescription("out-of-memory");
+  _exit(EXIT_FAILURE);
+}
+
+// Exits if the current input has been running for longer than the timeout.
 static void CheckTimeout() {
-  time_t start_time = state.timer;
-  time_t curr_time = time(nullptr);
-  if (state.run_time_flags.timeout_in_seconds != 0) {
-    if (curr_time - start_time >
-        static_cast<time_t>(state.run_time_flags.timeout_in_seconds)) {
-      fprintf(stderr, "========= Timeout of %zd seconds exceeded; exiting\n",
-              state.run_time_flags.timeout_in_seconds);
-      WriteFailureDescription("timeout-exceeded");
-      _exit(EXIT_FAILURE);
-    }
-  }
+  const uint64_t start_time_nsec = state.input_start_time_nsec;
+  if (start_time_nsec == 0) return;  // No input is being executed.
+  const uint64_t timeout_nsec = state.run_time_flags.timeout_ms * 1000000;
+  // The timer may have been armed for an input that finished since.
+  if (MonotonicTimeInNsec() - start_time_nsec < timeout_nsec) return;
+  fprintf(stderr, "========= Timeout of %.3f seconds exceeded; exiting\n",
+          state.run_time_flags.timeout_ms / 1000.);
+  WriteFailureDescription("timeout-exceeded");
+  _exit(EXIT_FAILURE);
+}
+
+// Sets `timer_fd` to expire once after `value_ms`, and then every
+// `interval_ms` if that is not zero.
+static void ArmTimer(int timer_fd, uint64_t value_ms, uint64_t interval_ms) {
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = value_ms / 1000;
+  spec.it_value.tv_nsec = (value_ms % 1000) * 1000000;
+  spec.it_interval.tv_sec = interval_ms / 1000;
+  spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000;
+  timerfd_settime(timer_fd, 0, &spec, nullptr);
 }
 
-// Timer thread. Periodically checks if it's time to abort due to a timeout/OOM.
+// Timer thread. Sleeps until the timeout timer or the RSS timer expires, then
+// checks if it's time to abort due to a timeout/OOM.
 [[noreturn]] static void *TimerThread(void *unused) {
+  struct pollfd fds[2] = {
+      {.fd = state.timeout_timer_fd, .events = POLLIN},
+      {.fd = state.rss_timer_fd, .events = POLLIN},  // Ignored if -1.
+  };
   while (true) {
-    sleep(1);
-    if (state.timer == 0) continue;  // No calls to ResetTimer() yet.
-
-    CheckTimeout();
-    CheckOOM();
+    if (poll(fds, 2, -1) <= 0) continue;  // EINTR.
+    uint64_t num_expirations = 0;
+    if (fds[0].revents & POLLIN) {
+      if (read(fds[0].fd, &num_expirations, sizeof(num_expirations)) > 0)
+        CheckTimeout();
+    }
+    if (fds[1].revents & POLLIN) {
+      if (read(fds[1].fd, &num_expirations, sizeof(num_expirations)) > 0)
+        CheckOOM();
+    }
   }
 }
 
 void GlobalRunnerState::StartTimerThread() {
-  if (state.run_time_flags.timeout_in_seconds == 0 &&
+  if (state.run_time_flags.timeout_ms == 0 &&
       state.run_time_flags.rss_limit_mb == 0) {
     return;
   }
-  fprintf(stderr, "timeout_in_seconds: %zd rss_limit_mb: %zd\n",
+  fprintf(stderr,
+          "timeout_in_seconds: %zd timeout_ms: %zd rss_limit_mb: %zd\n",
           state.run_time_flags.timeout_in_seconds,
-          state.run_time_flags.rss_limit_mb);
+          state.run_time_flags.timeout_ms, state.run_time_flags.rss_limit_mb);
+  if (state.run_time_flags.timeout_ms != 0)
+    timeout_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (state.run_time_flags.rss_limit_mb != 0) {
+    rss_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (rss_timer_fd >= 0) ArmTimer(rss_timer_fd, 1000, 1000);
+  }
   pthread_t timer_thread;
   pthread_create(&timer_thread, nullptr, TimerThread, nullptr);
+  pthread_attr_t attr;
+  if (pthread_getattr_np(timer_thread, &attr) == 0) {
+    size_t stack_size = 0;
+    pthread_attr_getstack(&attr, &timer_thread_stack, &stack_size);
+    pthread_attr_destroy(&attr);
+  }
   pthread_detach(timer_thread);
 }
 
-void GlobalRunnerState::ResetTimer() { timer = time(nullptr); }
+void GlobalRunnerState::ResetTimer() {
+  if (timeout_timer_fd < 0) return;
+  input_start_time_nsec = MonotonicTimeInNsec();
+  ArmTimer(timeout_timer_fd, run_time_flags.timeout_ms, 0);
+}
 
 // Byte array mutation fallback for a custom mutator, as defined here:
 // https://github.com/google/fuzzing/blob/master/docs/structure-aware-fuzzing.md
@@ -187,6 +318,10 @@ static const size_t kMaxFeatures = 1 << 20;
 // FeatureArray used to accumulate features from all sources.
 static centipede::FeatureArray<kMaxFeatures> g_features;
 
+// The CMP argument pairs of all threads for one input, packed into one blob.
+// Enough for the full traces of ~30 threads, even if all pairs are 2x16 bytes.
+static centipede::CmpArgsPacker<1 << 18> g_cmp_args;
+
 static void PrintErrorAndExitIf(bool condition, const char *error) {
   if (!condition) return;
   fprintf(stderr, "error: %s\n", error);
@@ -217,6 +352,14 @@ PrepareCoverage() {
       tls.path_ring_buffer.clear();
     });
   }
+  if (state.run_time_flags.use_auto_dictionary) {
+    state.ForEachTls([](centipede::ThreadLocalRunnerState &tls) {
+      tls.cmp_trace2.Reset();
+      tls.cmp_trace4.Reset();
+      tls.cmp_trace8.Reset();
+      tls.cmp_traceN.Reset();
+    });
+  }
 }
 
 // Post-processes all coverage data, puts it all into `g_features`.
@@ -281,19 +424,29 @@ PostProcessCoverage(int target_return_value) {
 static void RunOneInput(const uint8_t *data, size_t size,
                         FuzzerTestOneInputCallback test_one_input_cb) {
   state.stats = {};
-  size_t last_time_usec = 0;
-  auto UsecSinceLast = [&last_time_usec]() {
-    uint64_t t = centipede::TimeInUsec();
-    uint64_t ret_val = t - last_time_usec;
-    last_time_usec = t;
+  uint64_t last_time_nsec = 0;
+  auto NsecSinceLast = [&last_time_nsec]() {
+    uint64_t t = centipede::MonotonicTimeInNsec();
+    uint64_t ret_val = t - last_time_nsec;
+    last_time_nsec = t;
     return ret_val;
   };
-  UsecSinceLast();
+  auto UsecSinceLast = [&NsecSinceLast]() { return NsecSinceLast() / 1000; };
+  NsecSinceLast();
   PrepareCoverage();
   state.stats.prep_time_usec = UsecSinceLast();
   state.ResetTimer();
+  state.ResetHeapPeak();
+  const int64_t heap_bytes_before = state.heap_bytes;
+  centipede::StartPerfCounters();
   int target_return_value = test_one_input_cb(data, size);
-  state.stats.exec_time_usec = UsecSinceLast();
+  state.stats.exec_time_nsec = NsecSinceLast();
+  state.StopTimer();
+  centipede::StopPerfCounters(state.stats);
+  state.stats.exec_time_usec = state.stats.exec_time_nsec / 1000;
+  state.stats.peak_heap_bytes =
+      std::max<int64_t>(0, state.heap_peak_bytes - heap_bytes_before);
+  state.stats.num_mallocs = state.num_mallocs;
   centipede::CheckOOM();
   PostProcessCoverage(target_return_value);
   state.stats.post_time_usec = UsecSinceLast();
@@ -331,20 +484,14 @@ ReadOneInputExecuteItAndDumpCoverage(
   fclose(features_file);
 }
 
-// Calls centipede::BatchResult::WriteCmpArgs for every CMP arg pair
-// found in `cmp_trace`.
-// Returns true if all writes succeeded.
+// Packs every CMP arg pair found in `cmp_trace` into `g_cmp_args`.
 // "noinline" so that we see it in a profile, if it becomes hot.
 template <typename CmpTrace>
-__attribute__((noinline)) bool WriteCmpArgs(
-    CmpTrace &cmp_trace, centipede::SharedMemoryBlobSequence &blobseq) {
-  bool write_failed = false;
+__attribute__((noinline)) void PackCmpArgs(CmpTrace &cmp_trace) {
   cmp_trace.ForEachNonZero(
-      [&](uint8_t size, const uint8_t *v0, const uint8_t *v1) {
-        if (!centipede::BatchResult::WriteCmpArgs(v0, v1, size, blobseq))
-          write_failed = true;
+      [](uint8_t size, const uint8_t *v0, const uint8_t *v1) {
+        g_cmp_args.Append(size, v0, v1);
       });
-  return !write_failed;
 }
 
 // Starts sending the outputs (coverage, etc) to `outputs_blobseq`.
@@ -366,15 +513,17 @@ static bool FinishSendingOutputsToEngine(
 
   // Copy the CMP traces to shared memory.
   if (state.run_time_flags.use_auto_dictionary) {
-    bool write_failed = false;
-    state.ForEachTls([&write_failed, &outputs_blobseq](
-                         centipede::ThreadLocalRunnerState &tls) {
-      if (!WriteCmpArgs(tls.cmp_trace2, outputs_blobseq)) write_failed = true;
-      if (!WriteCmpArgs(tls.cmp_trace4, outputs_blobseq)) write_failed = true;
-      if (!WriteCmpArgs(tls.cmp_trace8, outputs_blobseq)) write_failed = true;
-      if (!WriteCmpArgs(tls.cmp_traceN, outputs_blobseq)) write_failed = true;
+    g_cmp_args.Clear();
+    state.ForEachTls([](centipede::ThreadLocalRunnerState &tls) {
+      PackCmpArgs(tls.cmp_trace2);
+      PackCmpArgs(tls.cmp_trace4);
+      PackCmpArgs(tls.cmp_trace8);
+      PackCmpArgs(tls.cmp_traceN);
     });
-    if (write_failed) return false;
+    if (!centipede::BatchResult::WritePackedCmpArgs(
+            g_cmp_args.data(), g_cmp_args.size(), outputs_blobseq)) {
+      return false;
+    }
   }
 
   // Write the stats.
@@ -591,6 +740,86 @@ static int MutateInputsFromShmem(
   return EXIT_SUCCESS;
 }
 
+// Handles the request of the engine: reads it from the shmem `state.arg1`,
+// writes the results to the shmem `state.arg2`.
+// Returns EXIT_SUCCESS on success and EXIT_FAILURE otherwise.
+static int ExecuteRequestFromShmem(
+    FuzzerTestOneInputCallback test_one_input_cb,
+    FuzzerCustomMutatorCallback custom_mutator_cb,
+    FuzzerCustomCrossOverCallback custom_crossover_cb) {
+  SharedMemoryBlobSequence inputs_blobseq(state.arg1);
+  SharedMemoryBlobSequence outputs_blobseq(state.arg2);
+  // Read the first blob. It indicates what further actions to take.
+  auto request_type_blob = inputs_blobseq.Read();
+  if (execution_request::IsMutationRequest(request_type_blob)) {
+    // Mutation request.
+    inputs_blobseq.Reset();
+    state.byte_array_mutator = new ByteArrayMutator(GetRandomSeed());
+    return MutateInputsFromShmem(inputs_blobseq, outputs_blobseq,
+                                 custom_mutator_cb, custom_crossover_cb);
+  }
+  if (execution_request::IsExecutionRequest(request_type_blob)) {
+    // Execution request.
+    inputs_blobseq.Reset();
+    return ExecuteInputsFromShmem(inputs_blobseq, outputs_blobseq,
+                                  test_one_input_cb);
+  }
+  return EXIT_FAILURE;
+}
+
+// The memory of the process before the first request, see
+// ExecuteRequestsFromShmemWithSnapshotReset().
+static DirtyPageSnapshot snapshot;
+
+// With :snapshot_reset: (experimental), a child of the fork server handles the
+// requests of the engine one after another, instead of exiting after one.
+// Between the requests, the memory is reset to a snapshot taken before the
+// first one, by copying back only the pages written since (see
+// DirtyPageSnapshot). That saves fork() and the teardown of the address space.
+// Returns the result of the last request once it fails or the memory can't be
+// reset, e.g. because the target created a mapping or a thread: the process
+// then exits, and the fork server forks a fresh one for the next request.
+// NOTE: the fork server reports the CPU time of the whole process when it
+// exits, so the last request is attributed that of all requests.
+static int ExecuteRequestsFromShmemWithSnapshotReset(
+    FuzzerTestOneInputCallback test_one_input_cb,
+    FuzzerCustomMutatorCallback custom_mutator_cb,
+    FuzzerCustomCrossOverCallback custom_crossover_cb) {
+  // The timer thread runs concurrently with the resets.
+  if (state.timer_thread_stack != nullptr)
+    snapshot.ExcludeMappingOf(state.timer_thread_stack);
+  // Open the performance counters before the snapshot, so that the resets
+  // don't make every request open them again.
+  state.OpenPerfCounters();
+  // Otherwise, buffered output would be printed again after every reset.
+  fflush(stdout);
+  fflush(stderr);
+  if (!IsForkServerChild() || !snapshot.Take()) {
+    fprintf(stderr, "snapshot_reset: no snapshot, falling back to fork\n");
+    return ExecuteRequestFromShmem(test_one_input_cb, custom_mutator_cb,
+                                   custom_crossover_cb);
+  }
+  // Local variables are on the stack, which is not reset.
+  struct rusage prev_rusage = {};
+  getrusage(RUSAGE_SELF, &prev_rusage);
+  while (true) {
+    const int result = ExecuteRequestFromShmem(
+        test_one_input_cb, custom_mutator_cb, custom_crossover_cb);
+    if (result != EXIT_SUCCESS) return result;
+    fflush(stdout);
+    fflush(stderr);
+    if (!snapshot.Restore()) return result;
+    // Report the CPU time of this request only.
+    struct rusage rusage = {};
+    getrusage(RUSAGE_SELF, &rusage);
+    struct rusage request_rusage = rusage;
+    timersub(&rusage.ru_utime, &prev_rusage.ru_utime, &request_rusage.ru_utime);
+    timersub(&rusage.ru_stime, &prev_rusage.ru_stime, &request_rusage.ru_stime);
+    prev_rusage = rusage;
+    if (!ForkServerChildReportAndWait(result, request_rusage)) _exit(result);
+  }
+}
+
 // Returns the current process VmSize, in bytes.
 static size_t GetVmSizeInBytes() {
   FILE *f = fopen("/proc/self/statm", "r");  // man proc
@@ -725,25 +954,12 @@ extern "C" int CentipedeRunnerMain(
   // Inputs / outputs from shmem.
   if (state.HasFlag(":shmem:")) {
     if (!state.arg1 || !state.arg2) return EXIT_FAILURE;
-    centipede::SharedMemoryBlobSequence inputs_blobseq(state.arg1);
-    centipede::SharedMemoryBlobSequence outputs_blobseq(state.arg2);
-    // Read the first blob. It indicates what further actions to take.
-    auto request_type_blob = inputs_blobseq.Read();
-    if (centipede::execution_request::IsMutationRequest(request_type_blob)) {
-      // Mutation request.
-      inputs_blobseq.Reset();
-      state.byte_array_mutator =
-          new centipede::ByteArrayMutator(centipede::GetRandomSeed());
-      return MutateInputsFromShmem(inputs_blobseq, outputs_blobseq,
-                                   custom_mutator_cb, custom_crossover_cb);
+    if (state.HasFlag(":snapshot_reset:")) {
+      return centipede::ExecuteRequestsFromShmemWithSnapshotReset(
+          test_one_input_cb, custom_mutator_cb, custom_crossover_cb);
     }
-    if (centipede::execution_request::IsExecutionRequest(request_type_blob)) {
-      // Execution request.
-      inputs_blobseq.Reset();
-      return ExecuteInputsFromShmem(inputs_blobseq, outputs_blobseq,
-                                    test_one_input_cb);
-    }
-    return EXIT_FAILURE;
+    return centipede::ExecuteRequestFromShmem(
+        test_one_input_cb, custom_mutator_cb, custom_crossover_cb);
   }
 
   // By default, run every input file one-by-one.
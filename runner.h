@@ -52,7 +52,11 @@ struct RunTimeFlags {
   uint64_t use_counter_features : 1;
   uint64_t use_auto_dictionary : 1;
   uint64_t timeout_in_seconds;
+  // The per-input timeout in milliseconds: :timeout_ms= if given, otherwise
+  // timeout_in_seconds.
+  uint64_t timeout_ms;
   uint64_t rss_limit_mb;
+  uint64_t malloc_limit_mb;
   uint64_t crossover_level;
 };
 
@@ -119,7 +123,10 @@ struct GlobalRunnerState {
       .use_counter_features = HasFlag(":use_counter_features:"),
       .use_auto_dictionary = HasFlag(":use_auto_dictionary:"),
       .timeout_in_seconds = HasFlag(":timeout_in_seconds=", 0),
+      .timeout_ms = HasFlag(":timeout_ms=",
+                            HasFlag(":timeout_in_seconds=", 0) * 1000),
       .rss_limit_mb = HasFlag(":rss_limit_mb=", 0),
+      .malloc_limit_mb = HasFlag(":malloc_limit_mb=", 0),
       .crossover_level = HasFlag(":crossover_level=", 50)};
 
   // Returns true iff `flag` is present.
@@ -217,22 +224,84 @@ struct GlobalRunnerState {
   // Execution stats for the currently executed input.
   ExecutionResult::Stats stats;
 
+  // Per-input performance counters, enabled by the :perf_counters: flag.
+  enum PerfCounter { kInstructions, kTaskClock, kPageFaults, kNumPerfCounters };
+  // Opens the performance counters that are available, as one group led by
+  // `perf_group_fd`. Does nothing after the first call: the counters are
+  // opened on the first input of the process, not at startup, so that the
+  // processes that execute no inputs don't pay for them.
+  void OpenPerfCounters();
+  bool perf_counters_opened = false;
+  // The group leader, or -1 if no counters are available or enabled.
+  int perf_group_fd = -1;
+  // The number of opened counters.
+  int num_perf_counters = 0;
+  // The index of every PerfCounter in the group, or -1 if it is not opened.
+  int perf_counter_index[kNumPerfCounters] = {-1, -1, -1};
+
+  // Heap accounting, updated by the opt-in malloc interceptors
+  // (runner_heap_interceptors.cc) from any thread, possibly before this object
+  // is constructed; hence no initializers (zero-initialized as a global).
+  // The live heap, in bytes. May become negative, if memory allocated other
+  // than via the interceptors is freed.
+  std::atomic<int64_t> heap_bytes;
+  // The max of `heap_bytes` since the last ResetHeapPeak().
+  std::atomic<int64_t> heap_peak_bytes;
+  // The number of allocations since the last ResetHeapPeak().
+  std::atomic<uint64_t> num_mallocs;
+  // Resets the peak and the allocation count. Call before executing an input.
+  void ResetHeapPeak() {
+    heap_peak_bytes = heap_bytes.load();
+    num_mallocs = 0;
+  }
+  // Updates the heap accounting after allocating `size` bytes.
+  void OnMalloc(size_t size) {
+    num_mallocs.fetch_add(1, std::memory_order_relaxed);
+    const int64_t new_heap_bytes =
+        heap_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    int64_t peak = heap_peak_bytes.load(std::memory_order_relaxed);
+    while (new_heap_bytes > peak &&
+           !heap_peak_bytes.compare_exchange_weak(peak, new_heap_bytes,
+                                                  std::memory_order_relaxed)) {
+    }
+  }
+  // Updates the heap accounting after freeing `size` bytes.
+  void OnFree(size_t size) {
+    heap_bytes.fetch_sub(size, std::memory_order_relaxed);
+  }
+
   // CentipedeRunnerMain() sets this to true.
   bool centipede_runner_main_executed = false;
 
   // Timeout-related machinery.
 
-  // If the timeout_in_seconds flag is passed, initializes the timer thread.
+  // If the timeout or rss_limit_mb flags are passed, initializes the timer
+  // thread. The thread sleeps until one of the timers below expires.
   void StartTimerThread();
   // Resets the timer. Call this before executing every input.
   void ResetTimer();
-  // Initially, zero. ResetTimer() sets it to the current time.
-  std::atomic<time_t> timer;
+  // Stops the timer. Call this after executing every input.
+  void StopTimer() { input_start_time_nsec = 0; }
+  // The start of the current input on the monotonic clock, zero if no input
+  // is being executed.
+  std::atomic<uint64_t> input_start_time_nsec;
+  // A timerfd armed by ResetTimer() to expire after run_time_flags.timeout_ms.
+  // It is not disarmed by StopTimer(): an expiry when no input is executed is
+  // ignored.
+  int timeout_timer_fd = -1;
+  // A periodic timerfd for the rss_limit_mb checks during long inputs.
+  int rss_timer_fd = -1;
+  // An address on the stack of the timer thread, if it runs.
+  void *timer_thread_stack = nullptr;
 };
 
 extern GlobalRunnerState state;
 extern thread_local ThreadLocalRunnerState tls;
 
+// Reports that the target tried to allocate `size` bytes at once, more than
+// --malloc_limit_mb, and exits. Called by the malloc interceptors.
+[[noreturn]] void MallocLimitExceeded(size_t size);
+
 }  // namespace centipede
 
 #endif  // THIRD_PARTY_CENTIPEDE_RUNNER_H_
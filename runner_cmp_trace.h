@@ -32,6 +32,9 @@ namespace centipede {
 // This is used to capture arguments of memcmp() and similar.
 //
 // Every new captured pair may overwrite a pair stored previously.
+// Reset() discards all pairs in O(1): every pair is tagged with the generation
+// in which it was captured, and only the pairs of the current generation are
+// iterated.
 //
 // Outside of tests, objects of this class will be created in TLS, thus no CTOR.
 template <uint8_t kFixedSize, size_t kNumItems>
@@ -47,6 +50,9 @@ class CmpTrace {
   // Clears `this`.
   void Clear() { memset(this, 0, sizeof(*this)); }
 
+  // Discards all captured pairs, w/o touching them. Called before every input.
+  void Reset() { ++generation_; }
+
   // Captures one CMP argument pair, as two byte arrays, `size` bytes each.
   void Capture(uint8_t size, const uint8_t *value0, const uint8_t *value1) {
     if (size > kNumBytesPerValue) size = kNumBytesPerValue;
@@ -55,6 +61,7 @@ class CmpTrace {
     // pairs which are typically, but not always, the most recent.
     rand_seed_ = rand_seed_ * 1103515245 + 12345;
     Item &item = items_[rand_seed_ % kNumItems];
+    item.generation = generation_;
     item.size.set(size);
     memcpy(item.value0, value0, size);
     memcpy(item.value1, value1, size);
@@ -70,10 +77,11 @@ class CmpTrace {
             reinterpret_cast<const uint8_t *>(&value1));
   }
 
-  // Iterates non-zero CMP pairs.
+  // Iterates non-zero CMP pairs captured since the last Reset().
   template <typename Callback>
   void ForEachNonZero(Callback callback) {
     for (const auto &item : items_) {
+      if (item.generation != generation_) continue;
       if (IsZero(item.value0, item.size.get()) &&
           IsZero(item.value1, item.size.get()))
         continue;
@@ -123,6 +131,7 @@ class CmpTrace {
 
   // One CMP argument pair.
   struct Item {
+    uint32_t generation;
     SizeField<kFixedSize> size;
     uint8_t value0[kNumBytesPerValue];
     uint8_t value1[kNumBytesPerValue];
@@ -133,6 +142,77 @@ class CmpTrace {
 
   // Pseudo-random seed.
   size_t rand_seed_;
+
+  // Incremented by Reset().
+  uint32_t generation_;
+};
+
+// Packs CMP argument pairs into one buffer, in the format of
+// ExecutionResult::cmp_args(): every pair is one byte of size followed by the
+// two arguments. Identical pairs are packed once, so that the pairs captured
+// many times by CmpTrace (e.g. in a loop) are sent to the engine once.
+// Up to `kCapacity` bytes are packed, the pairs that don't fit are dropped.
+//
+// Outside of tests, objects of this class will be created as globals,
+// thus no CTOR. Clear() must be called before the first use.
+template <size_t kCapacity>
+class CmpArgsPacker {
+ public:
+  // Discards all packed pairs, in O(1).
+  void Clear() {
+    size_ = 0;
+    ++generation_;
+  }
+
+  // Packs one CMP argument pair, two byte arrays of `size` bytes each,
+  // unless an identical pair is already packed.
+  // Returns false if the pair didn't fit.
+  bool Append(uint8_t size, const uint8_t *value0, const uint8_t *value1) {
+    if (size_ + 1 + 2 * size > kCapacity) return false;
+    // Dedup by hash: a collision may only drop a pair, which is harmless.
+    uint64_t hash = size;
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ value0[i]) * 0x100000001b3ULL;
+      hash = (hash ^ value1[i]) * 0x100000001b3ULL;
+    }
+    // Linear probing, give up on dedup after kMaxProbes.
+    for (size_t probe = 0; probe < kMaxProbes; ++probe) {
+      HashSlot &slot = hash_set_[(hash + probe) % kNumHashSlots];
+      if (slot.generation == generation_ && slot.hash == hash) return true;
+      if (slot.generation != generation_) {
+        slot.generation = generation_;
+        slot.hash = hash;
+        break;
+      }
+    }
+    data_[size_++] = size;
+    memcpy(data_ + size_, value0, size);
+    size_ += size;
+    memcpy(data_ + size_, value1, size);
+    size_ += size;
+    return true;
+  }
+
+  // The packed pairs.
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  static constexpr size_t kNumHashSlots = 1024;
+  static constexpr size_t kMaxProbes = 8;
+
+  // A packed pair, valid iff `generation` is the current one.
+  struct HashSlot {
+    uint64_t hash;
+    uint32_t generation;
+  };
+  HashSlot hash_set_[kNumHashSlots];
+
+  uint8_t data_[kCapacity];
+  size_t size_;
+
+  // Incremented by Clear().
+  uint32_t generation_;
 };
 
 }  // namespace centipede
@@ -114,5 +114,46 @@ TEST(CmpTrace, T1) {
                   TwoArraysToByteVector(long_array, long_array, 16)));
 }
 
+TEST(CmpTrace, Reset) {
+  std::vector<std::vector<uint8_t>> observed_pairs;
+  auto callback = [&observed_pairs](uint8_t size, const uint8_t *v0,
+                                    const uint8_t *v1) {
+    observed_pairs.push_back(TwoArraysToByteVector(v0, v1, size));
+  };
+
+  CmpTrace<4, 8> trace4;
+  trace4.Clear();
+  trace4.Capture<uint32_t>(1000, 2000);
+  trace4.Reset();
+  trace4.ForEachNonZero(callback);
+  EXPECT_TRUE(observed_pairs.empty());
+
+  // The pairs captured after Reset() are iterated.
+  trace4.Capture<uint32_t>(3000, 4000);
+  trace4.ForEachNonZero(callback);
+  EXPECT_THAT(observed_pairs, testing::ElementsAre(IntPairToByteVector<uint32_t>(
+                                  3000, 4000)));
+}
+
+TEST(CmpArgsPacker, PacksAndDedups) {
+  static CmpArgsPacker<12> packer;  // Globals are zero-initialized.
+  packer.Clear();
+  constexpr uint8_t value0[3] = {1, 2, 3};
+  constexpr uint8_t value1[3] = {4, 5, 6};
+  EXPECT_TRUE(packer.Append(2, value0, value1));
+  EXPECT_TRUE(packer.Append(2, value0, value1));  // Duplicate.
+  EXPECT_TRUE(packer.Append(3, value0, value1));
+  EXPECT_FALSE(packer.Append(1, value1, value0));  // Doesn't fit.
+  EXPECT_THAT(std::vector<uint8_t>(packer.data(), packer.data() + packer.size()),
+              testing::ElementsAre(2, 1, 2, 4, 5,  //
+                                   3, 1, 2, 3, 4, 5, 6));
+
+  // The pairs packed before Clear() are not duplicates.
+  packer.Clear();
+  EXPECT_TRUE(packer.Append(2, value0, value1));
+  EXPECT_THAT(std::vector<uint8_t>(packer.data(), packer.data() + packer.size()),
+              testing::ElementsAre(2, 1, 2, 4, 5));
+}
+
 }  // namespace
 }  // namespace centipede
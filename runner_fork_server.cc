@@ -28,8 +28,18 @@
 // * Runner blocks until it reads a byte from pipe0, then forks and waits.
 //   This is where the child process executes and does the work.
 //   This works because every execution of the target has the same arguments.
-// * Runner receives the child exit status and writes it to pipe1.
+// * Runner receives the child exit status and resource usage (wait4) and
+//   writes them to pipe1 in one write(): the int status followed by the
+//   struct rusage. The write is smaller than PIPE_BUF, hence atomic.
 // * Centipede blocks until it reads the status from pipe1.
+//   Older versions of Centipede read only the status.
+// Persistent children (experimental, see :snapshot_reset: in runner.cc):
+// * A child may serve more requests itself instead of exiting: it writes the
+//   status and resource usage of its request to pipe1 like the runner would,
+//   then reads the next byte from pipe0 and executes the next request. The
+//   runner is blocked in wait4 meanwhile, so only one of them reads pipe0.
+// * When the child exits, the runner reports its status as usual, and forks a
+//   new child on the next request.
 // Exit:
 // * Centipede closes the pipes (and then deletes them).
 // * Runner (the fork server) fails on the next read from pipe0 and exits.
@@ -53,12 +63,17 @@
 
 #include <fcntl.h>
 #include <linux/limits.h>  // ARG_MAX
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <cstdlib>
 #include <cstring>
 
+// Defined in runner_interceptors.cc, if the runner is linked in.
+extern "C" __attribute__((weak)) void CentipedeInitInterceptors();
+
 namespace centipede {
 
 // Writes a C string to stderr when debugging, no-op otherwise.
@@ -105,6 +120,55 @@ const char *GetOneEnv(const char *key) {
   return nullptr;
 }
 
+// The pipes and the kind of stdout/stderr, inherited by the children.
+int pipe0 = -1;
+int pipe1 = -1;
+bool output_is_file[3] = {};
+// True in a child of the fork server.
+bool in_fork_server_child = false;
+// In the fork server, the number of children forked so far. In a child, the
+// number of children forked before it.
+size_t num_forked_children = 0;
+
+// Resets stdout/stderr for a new execution. Only files are reset: when the
+// engine captures the output in a pipe there is nothing to reset.
+void ResetOutput() {
+  for (int fd = 1; fd <= 2; fd++) {
+    if (!output_is_file[fd]) continue;
+    lseek(fd, 0, SEEK_SET);
+    (void)ftruncate(fd, 0);
+  }
+}
+
+// Writes the wait `status` and `rusage` of an execution to pipe1.
+// The write is smaller than PIPE_BUF, hence atomic.
+bool WriteStatusAndRUsage(int status, const struct rusage &rusage) {
+  char result[sizeof(status) + sizeof(rusage)];
+  memcpy(result, &status, sizeof(status));
+  memcpy(result + sizeof(status), &rusage, sizeof(rusage));
+  return write(pipe1, result, sizeof(result)) == sizeof(result);
+}
+
+bool IsForkServerChild() { return in_fork_server_child; }
+
+// Returns the number of children the fork server forked before this one,
+// 0 if this is not a child of the fork server.
+// We don't declare this in a header, see runner.cc.
+size_t ForkServerChildIndex() { return num_forked_children; }
+
+// In a child of the fork server, reports the `exit_code` and `rusage` of the
+// current request to the engine, then blocks until the next request. Returns
+// false if this is not a child of the fork server or the engine is gone.
+// We don't declare this in a header, see runner.cc.
+bool ForkServerChildReportAndWait(int exit_code, const struct rusage &rusage) {
+  if (!in_fork_server_child) return false;
+  if (!WriteStatusAndRUsage(W_EXITCODE(exit_code, 0), rusage)) return false;
+  char ch = 0;
+  if (read(pipe0, &ch, 1) != 1) return false;
+  ResetOutput();
+  return true;
+}
+
 // Starts the fork server if the pipes are given.
 // This function is called from .preinit_array when linked statically,
 // or from the DSO constructor when injected via LD_PRELOAD.
@@ -114,17 +178,25 @@ __attribute__((constructor)) void ForkServerCallMeVeryEarly() {
   if (called_already) return;
   called_already = true;
   // Startup.
+  // Resolve the interceptors now, if they are linked in, so that every child
+  // doesn't resolve them again.
+  if (&CentipedeInitInterceptors != nullptr) CentipedeInitInterceptors();
   GetAllEnv();
   const char *pipe0_name = GetOneEnv("CENTIPEDE_FORK_SERVER_FIFO0=");
   const char *pipe1_name = GetOneEnv("CENTIPEDE_FORK_SERVER_FIFO1=");
   if (!pipe0_name || !pipe1_name) return;
   Log("###Centipede fork server requested\n");
-  int pipe0 = open(pipe0_name, O_RDONLY);
+  pipe0 = open(pipe0_name, O_RDONLY);
   if (pipe0 < 0) Exit("###open pipe0 failed\n");
-  int pipe1 = open(pipe1_name, O_WRONLY);
+  pipe1 = open(pipe1_name, O_WRONLY);
   if (pipe1 < 0) Exit("###open pipe1 failed\n");
   Log("###Centipede fork server ready\n");
 
+  for (int fd = 1; fd <= 2; fd++) {
+    struct stat st = {};
+    output_is_file[fd] = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+  }
+
   // Loop.
   while (true) {
     Log("###Centipede fork server blocking on pipe0\n");
@@ -137,17 +209,15 @@ __attribute__((constructor)) void ForkServerCallMeVeryEarly() {
       Exit("###fork failed\n");
     } else if (pid == 0) {
       // Child process. Reset stdout/stderr and let it run normally.
-      for (int fd = 1; fd <= 2; fd++) {
-        lseek(fd, 0, SEEK_SET);
-        // NOTE: Allow ftruncate() to fail by ignoring its return; that okay to
-        // happen when the stdout/stderr are not redirected to a file.
-        (void)ftruncate(fd, 0);
-      }
+      in_fork_server_child = true;
+      ResetOutput();
       return;
     } else {
       // Parent process.
+      ++num_forked_children;
       int status = -1;
-      if (waitpid(pid, &status, 0) < 0) Exit("###waitpid failed\n");
+      struct rusage rusage = {};
+      if (wait4(pid, &status, 0, &rusage) < 0) Exit("###wait4 failed\n");
       if (WIFEXITED(status)) {
         if (WEXITSTATUS(status) == EXIT_SUCCESS)
           Log("###Centipede fork returned EXIT_SUCCESS\n");
@@ -158,8 +228,8 @@ __attribute__((constructor)) void ForkServerCallMeVeryEarly() {
       } else {
         Log("###Centipede fork crashed\n");
       }
-      Log("###Centipede fork writing status to pipe1\n");
-      if (write(pipe1, &status, sizeof(status)) == -1)
+      Log("###Centipede fork writing status and rusage to pipe1\n");
+      if (!WriteStatusAndRUsage(status, rusage))
         Exit("###write to pipe1 failed\n");
     }
   }
@@ -0,0 +1,118 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Heap interceptors for Centipede: per-input heap accounting
+// (ExecutionResult::Stats) and --malloc_limit_mb.
+//
+// Unlike runner_interceptors.cc, these are not a part of the runner library:
+// they replace the glibc allocator functions, which would conflict with (or
+// silently bypass) another allocator such as tcmalloc or jemalloc. A fuzz
+// target opts in by linking :centipede_runner_heap_interceptors in addition
+// to the runner: linking them enables the heap accounting, --malloc_limit_mb
+// additionally bounds the size of a single allocation.
+//
+// Disabled under ASAN/TSAN/MSAN, which have their own allocators.
+#if !defined(ADDRESS_SANITIZER) && !defined(THREAD_SANITIZER) && \
+    !defined(MEMORY_SANITIZER)
+#include <malloc.h>  // for malloc_usable_size()
+
+#include <cerrno>
+#include <cstdint>
+
+#include "./runner.h"
+
+using centipede::state;
+
+// The glibc implementations of the allocation functions. Unlike dlsym(), these
+// are available at any time, even before the runner is initialized, and don't
+// allocate memory themselves.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t nmemb, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+namespace {
+
+// Fails if allocating `size` bytes at once exceeds --malloc_limit_mb. The
+// limit is 0 (none) until the runner flags are parsed: `state` is
+// zero-initialized before that.
+void CheckMallocLimit(size_t size) {
+  const uint64_t limit_mb = state.run_time_flags.malloc_limit_mb;
+  if (limit_mb != 0 && size > (limit_mb << 20))
+    centipede::MallocLimitExceeded(size);
+}
+
+// Accounts the allocation of `ptr`, if it is not null, and returns it.
+void *AccountMalloc(void *ptr) {
+  if (ptr != nullptr) state.OnMalloc(malloc_usable_size(ptr));
+  return ptr;
+}
+
+// Accounts the deallocation of `ptr`, if it is not null.
+void AccountFree(void *ptr) {
+  if (ptr != nullptr) state.OnFree(malloc_usable_size(ptr));
+}
+
+}  // namespace
+
+// The sizes are the usable sizes of the chunks, so that allocation and
+// deallocation of the same chunk account the same size.
+extern "C" void *malloc(size_t size) {
+  CheckMallocLimit(size);
+  return AccountMalloc(__libc_malloc(size));
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size) {
+  size_t total_size = 0;
+  if (!__builtin_mul_overflow(nmemb, size, &total_size))
+    CheckMallocLimit(total_size);
+  return AccountMalloc(__libc_calloc(nmemb, size));
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+  CheckMallocLimit(size);
+  // The old chunk is gone after a successful realloc, and remains after a
+  // failed one.
+  const size_t old_size = ptr != nullptr ? malloc_usable_size(ptr) : 0;
+  void *new_ptr = __libc_realloc(ptr, size);
+  if (new_ptr == nullptr && size != 0) return nullptr;
+  if (old_size != 0) state.OnFree(old_size);
+  return AccountMalloc(new_ptr);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size) {
+  CheckMallocLimit(size);
+  return AccountMalloc(__libc_memalign(alignment, size));
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  void *ptr = memalign(alignment, size);
+  if (ptr == nullptr) return ENOMEM;
+  *memptr = ptr;
+  return 0;
+}
+
+extern "C" void free(void *ptr) {
+  AccountFree(ptr);
+  __libc_free(ptr);
+}
+
+#endif  // not ASAN/TSAN/MSAN
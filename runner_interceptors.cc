@@ -66,13 +66,43 @@ void *MyThreadStart(void *arg) {
 
 }  // namespace
 
-// Initialize memcmp_orig at the module startup. This may still be too late,
-// since memcmp may be used before this module is initialized.
-// So, the interceptor may not assume that memcmp_orig != nullptr.
-static auto memcmp_orig =
-    FuncAddr<int (*)(const void *s1, const void *s2, size_t n)>("memcmp");
+// The real comparison functions, resolved by CentipedeInitInterceptors() once,
+// so that the interceptors don't call dlsym(). The interceptors may still be
+// called before that, e.g. by dlsym() itself or by other early initializers,
+// so they must not assume that the pointers are non-null and use the simple
+// fallbacks below instead.
+static int (*memcmp_orig)(const void *s1, const void *s2, size_t n);
+static int (*strcmp_orig)(const char *s1, const char *s2);
+static int (*strncmp_orig)(const char *s1, const char *s2, size_t n);
+static int (*strcasecmp_orig)(const char *s1, const char *s2);
+static int (*strncasecmp_orig)(const char *s1, const char *s2, size_t n);
+static void *(*memmem_orig)(const void *haystack, size_t haystack_len,
+                            const void *needle, size_t needle_len);
+static char *(*strstr_orig)(const char *haystack, const char *needle);
 
-// Fallback for the case memcmp_orig is null.
+// Resolves the real comparison functions.
+// Called by ForkServerCallMeVeryEarly() before it starts the fork server, so
+// that the children inherit the pointers: the fork server also runs from
+// .preinit_array, and its loop never returns in the parent, so the entries
+// after it never run there. Otherwise, called from .preinit_array when linked
+// statically, or from the DSO constructor when injected via LD_PRELOAD.
+extern "C" __attribute__((constructor)) void CentipedeInitInterceptors() {
+  static bool called_already = false;
+  if (called_already) return;
+  called_already = true;
+  memcmp_orig = FuncAddr<decltype(memcmp_orig)>("memcmp");
+  strcmp_orig = FuncAddr<decltype(strcmp_orig)>("strcmp");
+  strncmp_orig = FuncAddr<decltype(strncmp_orig)>("strncmp");
+  strcasecmp_orig = FuncAddr<decltype(strcasecmp_orig)>("strcasecmp");
+  strncasecmp_orig = FuncAddr<decltype(strncasecmp_orig)>("strncasecmp");
+  memmem_orig = FuncAddr<decltype(memmem_orig)>("memmem");
+  strstr_orig = FuncAddr<decltype(strstr_orig)>("strstr");
+}
+
+__attribute__((section(".preinit_array"), used)) static auto
+    init_interceptors = CentipedeInitInterceptors;
+
+// Fallbacks for the case the real functions are null.
 // Will be executed several times at process startup, if at all.
 static int memcmp_fallback(const void *s1, const void *s2, size_t n) {
   const auto *p1 = static_cast<const uint8_t *>(s1);
@@ -84,26 +114,209 @@ static int memcmp_fallback(const void *s1, const void *s2, size_t n) {
   return 0;
 }
 
-// memcmp interceptor.
-// Calls the real memcmp() and possibly modifies state.cmp_feature_set.
-extern "C" int memcmp(const void *s1, const void *s2, size_t n) {
-  uint64_t a = 0, b = 0;
-  if (n <= sizeof(a) && state.run_time_flags.use_cmp_features) {
-    memcpy(&a, s1, n);
-    memcpy(&b, s2, n);
-    auto caller_pc = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
-    uintptr_t pc_offset = caller_pc - state.main_object_start_address;
-    uintptr_t hash =
-        centipede::Hash64Bits(pc_offset) ^ tls.path_ring_buffer.hash();
-    state.cmp_feature_set.set(
-        centipede::ConvertContextAndArgPairToNumber(a, b, hash));
+static uint8_t ToLower(uint8_t c) {
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// strncmp (or strncasecmp if `ignore_case`), n == SIZE_MAX for strcmp.
+static int strncmp_fallback(const char *s1, const char *s2, size_t n,
+                            bool ignore_case) {
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t c1 = s1[i];
+    uint8_t c2 = s2[i];
+    if (ignore_case) {
+      c1 = ToLower(c1);
+      c2 = ToLower(c2);
+    }
+    if (c1 != c2) return c1 - c2;
+    if (c1 == 0) break;
+  }
+  return 0;
+}
+
+static void *memmem_fallback(const void *haystack, size_t haystack_len,
+                             const void *needle, size_t needle_len) {
+  const auto *h = static_cast<const uint8_t *>(haystack);
+  for (size_t i = 0; i + needle_len <= haystack_len; ++i) {
+    if (memcmp_fallback(h + i, needle, needle_len) == 0)
+      return const_cast<uint8_t *>(h + i);
+  }
+  return nullptr;
+}
+
+// Adds the CMP feature of `a` and `b`, compared by the function called from
+// `caller_pc`, in the context of the call site and the current path.
+static void AddCmpFeature(uintptr_t caller_pc, uint64_t a, uint64_t b) {
+  uintptr_t pc_offset = caller_pc - state.main_object_start_address;
+  uintptr_t hash =
+      centipede::Hash64Bits(pc_offset) ^ tls.path_ring_buffer.hash();
+  state.cmp_feature_set.set(
+      centipede::ConvertContextAndArgPairToNumber(a, b, hash));
+}
+
+// Compared byte arrays longer than this are represented in CMP features by
+// the length of their common prefix, up to this length.
+static constexpr size_t kMaxCmpPrefix = 64;
+
+// The maximal size of the operands captured in tls.cmp_traceN.
+static constexpr size_t kMaxCapturedSize =
+    decltype(tls.cmp_traceN)::kMaxNumBytesPerValue;
+
+// Records a comparison of `s1` and `s2`, `n` bytes each, made by the function
+// called from `caller_pc`, whose result is `equal`:
+//  * A CMP feature: of the values of `s1` and `s2` if n <= 8, of the length of
+//    their common prefix otherwise, so that every matching byte is a new
+//    feature.
+//  * If they differ, their first bytes in tls.cmp_traceN for the auto
+//    dictionary.
+static void TraceMemCmp(uintptr_t caller_pc, const uint8_t *s1,
+                        const uint8_t *s2, size_t n, bool equal) {
+  if (state.run_time_flags.use_cmp_features) {
+    uint64_t a = 0, b = 0;
+    if (n <= sizeof(a)) {
+      memcpy(&a, s1, n);
+      memcpy(&b, s2, n);
+    } else {
+      const size_t max_prefix = n < kMaxCmpPrefix ? n : kMaxCmpPrefix;
+      while (!equal && a < max_prefix && s1[a] == s2[a]) ++a;
+      if (equal) a = n;
+      b = n;
+    }
+    AddCmpFeature(caller_pc, a, b);
   }
+  if (!equal && state.run_time_flags.use_auto_dictionary)
+    tls.cmp_traceN.Capture(n < kMaxCapturedSize ? n : kMaxCapturedSize, s1, s2);
+}
+
+// Records a comparison of the C strings `s1` and `s2`, up to `n` characters,
+// see TraceMemCmp(). The shorter string is compared as if padded with zeros:
+// neither string is read past its terminating zero.
+static void TraceStrCmp(uintptr_t caller_pc, const char *s1, const char *s2,
+                        size_t n, bool equal) {
+  if (!state.run_time_flags.use_cmp_features &&
+      !state.run_time_flags.use_auto_dictionary) {
+    return;
+  }
+  const size_t max_len = n < kMaxCmpPrefix ? n : kMaxCmpPrefix;
+  const size_t len1 = strnlen(s1, max_len);
+  const size_t len2 = strnlen(s2, max_len);
+  const size_t len = len1 > len2 ? len1 : len2;
+  if (state.run_time_flags.use_cmp_features) {
+    uint64_t a = 0, b = 0;
+    if (len <= sizeof(a)) {
+      memcpy(&a, s1, len1);
+      memcpy(&b, s2, len2);
+    } else {
+      // Stops at the terminating zero of the shorter string, at the latest.
+      while (!equal && a < len && s1[a] == s2[a]) ++a;
+      if (equal) a = len;
+      b = len;
+    }
+    AddCmpFeature(caller_pc, a, b);
+  }
+  if (!equal && state.run_time_flags.use_auto_dictionary) {
+    uint8_t buf1[kMaxCapturedSize] = {};
+    uint8_t buf2[kMaxCapturedSize] = {};
+    memcpy(buf1, s1, len1 < kMaxCapturedSize ? len1 : kMaxCapturedSize);
+    memcpy(buf2, s2, len2 < kMaxCapturedSize ? len2 : kMaxCapturedSize);
+    tls.cmp_traceN.Capture(len < kMaxCapturedSize ? len : kMaxCapturedSize,
+                           buf1, buf2);
+  }
+}
+
+// Records a search of `needle` in `haystack` that returned `found`, made by
+// the function called from `caller_pc`: a CMP feature of whether it was found
+// and, if it was not, `needle` in tls.cmp_traceN (against the beginning of
+// `haystack`), so that the auto dictionary learns the needle.
+static void TraceMemSearch(uintptr_t caller_pc, const uint8_t *haystack,
+                           size_t haystack_len, const uint8_t *needle,
+                           size_t needle_len, bool found) {
+  if (state.run_time_flags.use_cmp_features)
+    AddCmpFeature(caller_pc, found ? needle_len : 0, needle_len);
+  if (!found && state.run_time_flags.use_auto_dictionary) {
+    uint8_t buf[kMaxCapturedSize] = {};
+    const size_t size =
+        needle_len < kMaxCapturedSize ? needle_len : kMaxCapturedSize;
+    memcpy(buf, haystack, haystack_len < size ? haystack_len : size);
+    tls.cmp_traceN.Capture(size, buf, needle);
+  }
+}
+
+// Comparison interceptors.
+// Call the real functions and record the comparison operands, see
+// TraceMemCmp().
+extern "C" int memcmp(const void *s1, const void *s2, size_t n) {
   int result =
       memcmp_orig ? memcmp_orig(s1, s2, n) : memcmp_fallback(s1, s2, n);
-  if (result != 0 && state.run_time_flags.use_auto_dictionary) {
-    tls.cmp_traceN.Capture(n, reinterpret_cast<const uint8_t *>(s1),
-                           reinterpret_cast<const uint8_t *>(s2));
+  TraceMemCmp(reinterpret_cast<uintptr_t>(__builtin_return_address(0)),
+              static_cast<const uint8_t *>(s1),
+              static_cast<const uint8_t *>(s2), n, result == 0);
+  return result;
+}
+
+extern "C" int strcmp(const char *s1, const char *s2) {
+  int result = strcmp_orig ? strcmp_orig(s1, s2)
+                           : strncmp_fallback(s1, s2, SIZE_MAX, false);
+  TraceStrCmp(reinterpret_cast<uintptr_t>(__builtin_return_address(0)), s1,
+              s2, SIZE_MAX, result == 0);
+  return result;
+}
+
+extern "C" int strncmp(const char *s1, const char *s2, size_t n) {
+  int result = strncmp_orig ? strncmp_orig(s1, s2, n)
+                            : strncmp_fallback(s1, s2, n, false);
+  TraceStrCmp(reinterpret_cast<uintptr_t>(__builtin_return_address(0)), s1,
+              s2, n, result == 0);
+  return result;
+}
+
+extern "C" int strcasecmp(const char *s1, const char *s2) {
+  int result = strcasecmp_orig ? strcasecmp_orig(s1, s2)
+                               : strncmp_fallback(s1, s2, SIZE_MAX, true);
+  TraceStrCmp(reinterpret_cast<uintptr_t>(__builtin_return_address(0)), s1,
+              s2, SIZE_MAX, result == 0);
+  return result;
+}
+
+extern "C" int strncasecmp(const char *s1, const char *s2, size_t n) {
+  int result = strncasecmp_orig ? strncasecmp_orig(s1, s2, n)
+                                : strncmp_fallback(s1, s2, n, true);
+  TraceStrCmp(reinterpret_cast<uintptr_t>(__builtin_return_address(0)), s1,
+              s2, n, result == 0);
+  return result;
+}
+
+extern "C" void *memmem(const void *haystack, size_t haystack_len,
+                        const void *needle, size_t needle_len) {
+  void *result =
+      memmem_orig ? memmem_orig(haystack, haystack_len, needle, needle_len)
+                  : memmem_fallback(haystack, haystack_len, needle, needle_len);
+  TraceMemSearch(reinterpret_cast<uintptr_t>(__builtin_return_address(0)),
+                 static_cast<const uint8_t *>(haystack), haystack_len,
+                 static_cast<const uint8_t *>(needle), needle_len,
+                 result != nullptr);
+  return result;
+}
+
+// In C++, strstr() is overloaded on the constness of the haystack, so the
+// interceptor is defined under a different name with the assembler name
+// "strstr".
+extern "C" char *StrstrInterceptor(const char *haystack, const char *needle)
+    __asm__("strstr");
+extern "C" char *StrstrInterceptor(const char *haystack, const char *needle) {
+  char *result;
+  if (strstr_orig) {
+    result = strstr_orig(haystack, needle);
+  } else {
+    result = static_cast<char *>(
+        memmem_fallback(haystack, strlen(haystack), needle, strlen(needle)));
   }
+  const size_t needle_len = strlen(needle);
+  TraceMemSearch(reinterpret_cast<uintptr_t>(__builtin_return_address(0)),
+                 reinterpret_cast<const uint8_t *>(haystack),
+                 strnlen(haystack, needle_len),
+                 reinterpret_cast<const uint8_t *>(needle), needle_len,
+                 result != nullptr);
   return result;
 }
 
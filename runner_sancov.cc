@@ -131,9 +131,47 @@ void __sanitizer_cov_trace_cmp8(uint64_t Arg1, uint64_t Arg2) {
   if (Arg1 != Arg2 && state.run_time_flags.use_auto_dictionary)
     tls.cmp_trace8.Capture(Arg1, Arg2);
 }
-// TODO(kcc): [impl] handle switch.
+// Switch: `Cases[0]` is the number of case values, `Cases[1]` is the size of
+// `Val` in bits, and `Cases[2:]` are the case values, sorted as unsigned.
+// Traces `Val` against the closest case value, found by binary search, as a
+// CMP of that size: the distance to the closest case guides the fuzzer to the
+// cases not yet taken, and the case value goes to the auto dictionary.
 NO_SANITIZE
-void __sanitizer_cov_trace_switch(uint64_t Val, uint64_t *Cases) {}
+void __sanitizer_cov_trace_switch(uint64_t Val, uint64_t *Cases) {
+  const uint64_t num_cases = Cases[0];
+  if (num_cases == 0) return;
+  if (!state.run_time_flags.use_cmp_features &&
+      !state.run_time_flags.use_auto_dictionary) {
+    return;
+  }
+  const uint64_t *case_values = Cases + 2;
+  // The first case value >= Val, or num_cases if there is none.
+  uint64_t lo = 0, hi = num_cases;
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (case_values[mid] < Val) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  uint64_t closest = lo < num_cases ? case_values[lo] : case_values[lo - 1];
+  if (lo > 0 && lo < num_cases && Val - case_values[lo - 1] < closest - Val)
+    closest = case_values[lo - 1];
+  TraceCmp(Val, closest);
+  if (Val == closest || !state.run_time_flags.use_auto_dictionary) return;
+  switch (Cases[1]) {
+    case 16:
+      tls.cmp_trace2.Capture<uint16_t>(Val, closest);
+      break;
+    case 32:
+      tls.cmp_trace4.Capture<uint32_t>(Val, closest);
+      break;
+    case 64:
+      tls.cmp_trace8.Capture<uint64_t>(Val, closest);
+      break;
+  }
+}
 
 // https://clang.llvm.org/docs/SanitizerCoverage.html#pc-table
 // This function is called at the DSO init time.
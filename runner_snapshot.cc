@@ -0,0 +1,297 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// NOTE: memcmp, strcmp, strstr, etc. are intercepted by the runner (see
+// runner_interceptors.cc) and would report comparisons; the code below parses
+// the /proc files by hand instead.
+
+namespace centipede {
+
+namespace {
+
+// Bit 55 of a /proc/self/pagemap entry: the page was written since the last
+// write of "4" to /proc/self/clear_refs.
+constexpr uint64_t kSoftDirtyBit = 1ULL << 55;
+
+// Written by Take() to check that the kernel tracks soft-dirty pages.
+volatile uint64_t soft_dirty_sentinel;
+
+// Clears the soft-dirty bits of all pages of the process.
+bool ClearSoftDirtyBits() {
+  const int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  const bool written = write(fd, "4", 1) == 1;
+  close(fd);
+  return written;
+}
+
+// Returns true if the page containing `address` is soft-dirty.
+bool IsSoftDirty(const volatile void *address, size_t page_size) {
+  const int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  uint64_t entry = 0;
+  const off_t offset =
+      reinterpret_cast<uintptr_t>(address) / page_size * sizeof(entry);
+  const ssize_t size = pread(fd, &entry, sizeof(entry), offset);
+  close(fd);
+  return size == sizeof(entry) && (entry & kSoftDirtyBit) != 0;
+}
+
+// Parses a hexadecimal number at `*p`, advances `*p` past it.
+uintptr_t ParseHex(const char **p) {
+  uintptr_t result = 0;
+  for (;; ++*p) {
+    const char c = **p;
+    if (c >= '0' && c <= '9') {
+      result = result * 16 + (c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      result = result * 16 + (c - 'a' + 10);
+    } else {
+      return result;
+    }
+  }
+}
+
+// Returns the number of threads of the process, from /proc/self/status, or 0
+// on error.
+size_t NumThreads() {
+  const int fd = open("/proc/self/status", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return 0;
+  char buf[8192];
+  const ssize_t size = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (size <= 0) return 0;
+  buf[size] = 0;
+  constexpr char kKey[] = "\nThreads:";
+  for (const char *p = buf; *p != 0; ++p) {
+    size_t i = 0;
+    while (kKey[i] != 0 && p[i] == kKey[i]) ++i;
+    if (kKey[i] != 0) continue;
+    p += i;
+    while (*p == ' ' || *p == '\t') ++p;
+    size_t num_threads = 0;
+    for (; *p >= '0' && *p <= '9'; ++p) {
+      num_threads = num_threads * 10 + (*p - '0');
+    }
+    return num_threads;
+  }
+  return 0;
+}
+
+// Calls `callback(begin, end, perms, name)` for every line of
+// /proc/self/maps. Returns false if the file can't be read.
+template <typename Callback>
+bool ForEachMapping(Callback callback) {
+  const int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  char buf[4096];
+  // Longer lines are truncated, which only affects the names of the mappings.
+  char line[512];
+  size_t line_size = 0;
+  ssize_t size = 0;
+  while ((size = read(fd, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < size; ++i) {
+      if (buf[i] != '\n') {
+        if (line_size < sizeof(line) - 1) line[line_size++] = buf[i];
+        continue;
+      }
+      line[line_size] = 0;
+      line_size = 0;
+      // <begin>-<end> <perms> <offset> <dev> <inode> <name>
+      const char *p = line;
+      const uintptr_t begin = ParseHex(&p);
+      if (*p++ != '-') continue;
+      const uintptr_t end = ParseHex(&p);
+      if (*p++ != ' ') continue;
+      const char *perms = p;
+      for (int field = 0; field < 4 && *p != 0; ++field) {
+        while (*p != 0 && *p != ' ') ++p;
+        while (*p == ' ') ++p;
+      }
+      callback(begin, end, perms, p);
+    }
+  }
+  close(fd);
+  return size == 0;
+}
+
+}  // namespace
+
+void DirtyPageSnapshot::ExcludeMappingOf(const void *address) {
+  if (num_excluded_addresses_ == kMaxNumExcludedAddresses) return;
+  excluded_addresses_[num_excluded_addresses_++] =
+      reinterpret_cast<uintptr_t>(address);
+}
+
+template <typename Callback>
+bool DirtyPageSnapshot::ForEachSnapshotMapping(Callback callback) const {
+  const uintptr_t copy_begin = reinterpret_cast<uintptr_t>(copy_);
+  const uintptr_t copy_end = copy_begin + copy_size_;
+  return ForEachMapping([&](uintptr_t begin, uintptr_t end, const char *perms,
+                            const char *name) {
+    // Private, readable and writable.
+    if (perms[0] != 'r' || perms[1] != 'w' || perms[3] != 'p') return;
+    // The stack of the main thread.
+    if (name[0] == '[' && name[1] == 's' && name[2] == 't') return;
+    if (begin >= copy_begin && end <= copy_end) return;
+    // The excluded mappings are still reported: a new mapping may be merged
+    // with one of them, which then changes its bounds.
+    bool excluded = false;
+    for (size_t i = 0; i < num_excluded_addresses_; ++i) {
+      const uintptr_t address = excluded_addresses_[i];
+      if (address >= begin && address < end) excluded = true;
+    }
+    callback(begin, end, excluded);
+  });
+}
+
+bool DirtyPageSnapshot::Take() {
+  if (taken_) return false;
+  page_size_ = sysconf(_SC_PAGESIZE);
+  num_threads_ = NumThreads();
+  if (num_threads_ == 0) return false;
+
+  num_regions_ = 0;
+  size_t total_size = 0;
+  bool too_many_regions = false;
+  if (!ForEachSnapshotMapping([&](uintptr_t begin, uintptr_t end,
+                                  bool excluded) {
+        if (num_regions_ == kMaxNumRegions) {
+          too_many_regions = true;
+          return;
+        }
+        regions_[num_regions_++] = {begin, end, excluded, nullptr};
+        if (!excluded) total_size += end - begin;
+      })) {
+    return false;
+  }
+  if (too_many_regions || total_size > kMaxSnapshotSize) return false;
+
+  // The copies are between two inaccessible pages, so that their mapping is
+  // never merged with another one.
+  copy_size_ = total_size + 2 * page_size_;
+  void *copy = mmap(nullptr, copy_size_, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (copy == MAP_FAILED) return false;
+  copy_ = static_cast<uint8_t *>(copy);
+  if (mprotect(copy_ + page_size_, total_size, PROT_READ | PROT_WRITE) != 0) {
+    munmap(copy_, copy_size_);
+    copy_ = nullptr;
+    copy_size_ = 0;
+    return false;
+  }
+  uint8_t *region_copy = copy_ + page_size_;
+  for (size_t i = 0; i < num_regions_; ++i) {
+    if (regions_[i].excluded) continue;
+    regions_[i].copy = region_copy;
+    region_copy += regions_[i].end - regions_[i].begin;
+  }
+
+  // From here on, the fields of this object don't change until the next
+  // Restore(), which thus doesn't change them either.
+  taken_ = true;
+  for (size_t i = 0; i < num_regions_; ++i) {
+    const Region &region = regions_[i];
+    if (region.excluded) continue;
+    memcpy(region.copy, reinterpret_cast<const void *>(region.begin),
+           region.end - region.begin);
+  }
+
+  // Check that the kernel tracks the writes: without CONFIG_MEM_SOFT_DIRTY,
+  // clear_refs may accept "4", but the pages never become soft-dirty.
+  bool soft_dirty_tracked = ClearSoftDirtyBits();
+  if (soft_dirty_tracked) {
+    ++soft_dirty_sentinel;
+    soft_dirty_tracked = IsSoftDirty(&soft_dirty_sentinel, page_size_);
+  }
+  if (!soft_dirty_tracked) {
+    taken_ = false;
+    munmap(copy_, copy_size_);
+    copy_ = nullptr;
+    copy_size_ = 0;
+    return false;
+  }
+  return true;
+}
+
+bool DirtyPageSnapshot::Restore() {
+  if (!taken_) return false;
+  if (NumThreads() != num_threads_) return false;
+
+  // The writable mappings must be exactly the same.
+  size_t num_regions = 0;
+  bool same_regions = true;
+  if (!ForEachSnapshotMapping([&](uintptr_t begin, uintptr_t end,
+                                  bool excluded) {
+        if (num_regions >= num_regions_ ||
+            regions_[num_regions].begin != begin ||
+            regions_[num_regions].end != end ||
+            regions_[num_regions].excluded != excluded) {
+          same_regions = false;
+        }
+        ++num_regions;
+      })) {
+    return false;
+  }
+  if (!same_regions || num_regions != num_regions_) return false;
+
+  const int pagemap_fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+  if (pagemap_fd < 0) return false;
+  size_t num_restored_pages = 0;
+  uint64_t entries[512];
+  for (size_t i = 0; i < num_regions_; ++i) {
+    const Region &region = regions_[i];
+    if (region.excluded) continue;
+    for (uintptr_t chunk = region.begin; chunk < region.end;) {
+      const size_t num_pages =
+          std::min(sizeof(entries) / sizeof(entries[0]),
+                   (region.end - chunk) / page_size_);
+      const ssize_t size = num_pages * sizeof(entries[0]);
+      // Some pages may have been restored already, so there is no way back.
+      // Reading the pagemap of the own process doesn't fail in practice.
+      if (pread(pagemap_fd, entries, size,
+                chunk / page_size_ * sizeof(entries[0])) != size) {
+        abort();
+      }
+      for (size_t j = 0; j < num_pages; ++j) {
+        if ((entries[j] & kSoftDirtyBit) == 0) continue;
+        const uintptr_t page = chunk + j * page_size_;
+        memcpy(reinterpret_cast<void *>(page),
+               region.copy + (page - region.begin), page_size_);
+        ++num_restored_pages;
+      }
+      chunk += num_pages * page_size_;
+    }
+  }
+  close(pagemap_fd);
+  // If this fails, the pages stay soft-dirty and are restored again next time,
+  // which is slower but still correct.
+  ClearSoftDirtyBits();
+  num_restored_pages_ = num_restored_pages;
+  return true;
+}
+
+}  // namespace centipede
@@ -0,0 +1,99 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CENTIPEDE_RUNNER_SNAPSHOT_H_
+#define THIRD_PARTY_CENTIPEDE_RUNNER_SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace centipede {
+
+// A snapshot of the writable memory of the process that can be restored
+// cheaply, so that one process can execute many inputs starting from the same
+// state instead of forking a fresh process for every batch.
+//
+// Take() copies all private writable mappings and clears the soft-dirty bits
+// of the process (/proc/self/clear_refs). Restore() finds the pages written
+// since then via the soft-dirty bits in /proc/self/pagemap and copies back only
+// those. Restore() refuses without touching any memory if the writable
+// mappings or the number of threads have changed since Take(), e.g. when a new
+// mapping appeared or the heap grew: the caller should then start over in a
+// fresh process.
+//
+// Only the memory is restored: file descriptors, the kernel state, etc. are
+// not. The stack of the main thread is not restored either, so Take() and
+// Restore() should be called from the same frame. Other threads that run
+// concurrently must not write to the snapshot: their stacks need to be
+// excluded with ExcludeMappingOf().
+//
+// Doesn't use malloc or stdio, which are part of the snapshot.
+// Linux only, requires CONFIG_MEM_SOFT_DIRTY; Take() fails without it.
+class DirtyPageSnapshot {
+ public:
+  // The snapshot is not taken if the writable memory is larger than this,
+  // e.g. with the huge shadow mappings of sanitizers.
+  static constexpr size_t kMaxSnapshotSize = 1ULL << 30;
+  static constexpr size_t kMaxNumRegions = 1024;
+  static constexpr size_t kMaxNumExcludedAddresses = 8;
+
+  // Excludes the mapping that contains `address` from the snapshot, e.g. the
+  // stack of a thread. Its contents are not restored, but its bounds must not
+  // change either. Must be called before Take().
+  void ExcludeMappingOf(const void *address);
+
+  // Takes the snapshot. Returns false if the snapshot can't be taken, e.g. if
+  // the kernel doesn't support soft-dirty bits. Can be called only once.
+  bool Take();
+
+  // Restores the pages written since Take() or the last Restore().
+  // Returns false, without changing any memory, if the snapshot was not taken
+  // or the memory layout has changed since Take().
+  bool Restore();
+
+  // The number of pages copied back by the last successful Restore().
+  size_t num_restored_pages() const { return num_restored_pages_; }
+
+ private:
+  // A private writable mapping [begin, end) and its copy in `copy_`, unless
+  // it is excluded.
+  struct Region {
+    uintptr_t begin;
+    uintptr_t end;
+    bool excluded;
+    uint8_t *copy;
+  };
+
+  // Calls `callback(begin, end, excluded)` for every private writable mapping
+  // of the process, except for the main thread stack and `copy_`. Returns
+  // false if /proc/self/maps can't be read.
+  template <typename Callback>
+  bool ForEachSnapshotMapping(Callback callback) const;
+
+  uintptr_t excluded_addresses_[kMaxNumExcludedAddresses] = {};
+  size_t num_excluded_addresses_ = 0;
+  Region regions_[kMaxNumRegions] = {};
+  size_t num_regions_ = 0;
+  // The mapping with the copies of all regions.
+  uint8_t *copy_ = nullptr;
+  size_t copy_size_ = 0;
+  size_t num_threads_ = 0;
+  size_t page_size_ = 0;
+  bool taken_ = false;
+  size_t num_restored_pages_ = 0;
+};
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_RUNNER_SNAPSHOT_H_
@@ -0,0 +1,69 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner_snapshot.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace centipede {
+namespace {
+
+// Spans several pages.
+uint8_t global_array[1 << 16];
+
+// Nothing between Take() and Restore() may allocate or use gtest: the snapshot
+// includes the heap and the state of gtest.
+TEST(DirtyPageSnapshot, Restore) {
+  static DirtyPageSnapshot snapshot;
+  EXPECT_FALSE(snapshot.Restore());  // Not taken yet.
+  global_array[0] = 1;
+  global_array[40000] = 2;
+  if (!snapshot.Take()) GTEST_SKIP() << "No soft-dirty bits in this kernel";
+
+  global_array[0] = 3;
+  global_array[40000] = 4;
+  global_array[60000] = 5;
+  const bool restored = snapshot.Restore();
+  const size_t num_restored_pages = snapshot.num_restored_pages();
+  EXPECT_TRUE(restored);
+  EXPECT_EQ(global_array[0], 1);
+  EXPECT_EQ(global_array[40000], 2);
+  EXPECT_EQ(global_array[60000], 0);
+  EXPECT_GE(num_restored_pages, 3);
+
+  // A new writable mapping prevents the reset.
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  void *mapping = mmap(nullptr, page_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(mapping, MAP_FAILED);
+  global_array[0] = 6;
+  const bool restored_with_mapping = snapshot.Restore();
+  EXPECT_FALSE(restored_with_mapping);
+  EXPECT_EQ(global_array[0], 6);
+
+  // Without it, the reset works again.
+  ASSERT_EQ(munmap(mapping, page_size), 0);
+  const bool restored_without_mapping = snapshot.Restore();
+  EXPECT_TRUE(restored_without_mapping);
+  EXPECT_EQ(global_array[0], 1);
+}
+
+}  // namespace
+}  // namespace centipede
@@ -0,0 +1,186 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./shard_lease.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./logging.h"
+
+namespace centipede {
+
+namespace {
+
+// How an empty owner is stored in a record file.
+constexpr std::string_view kNoOwner = "-";
+
+// Holds an exclusive flock() on `path` while alive.
+class ScopedFileLock {
+ public:
+  explicit ScopedFileLock(const std::string &path) {
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    CHECK_GE(fd_, 0) << "Failed to open " << path << ": " << strerror(errno);
+    while (flock(fd_, LOCK_EX) != 0) {
+      CHECK_EQ(errno, EINTR) << "Failed to lock " << path << ": "
+                             << strerror(errno);
+    }
+  }
+  ~ScopedFileLock() { close(fd_); }  // Also unlocks.
+
+  ScopedFileLock(const ScopedFileLock &) = delete;
+  ScopedFileLock &operator=(const ScopedFileLock &) = delete;
+
+ private:
+  int fd_ = -1;
+};
+
+}  // namespace
+
+ShardLeaser::ShardLeaser(std::string_view lease_dir, size_t total_shards,
+                         std::string_view owner, absl::Duration lease_duration)
+    : lease_dir_(lease_dir),
+      total_shards_(total_shards),
+      owner_(owner),
+      lease_duration_(lease_duration) {
+  CHECK(!owner_.empty() && owner_ != kNoOwner &&
+        owner_.find_first_of(" \t\n") == std::string::npos)
+      << "Invalid owner: " << owner_;
+  std::error_code error;
+  std::filesystem::create_directories(lease_dir_, error);
+  CHECK(!error) << "Failed to create " << lease_dir_ << ": "
+                << error.message();
+}
+
+std::string ShardLeaser::RecordPath(size_t shard) const {
+  return std::filesystem::path(lease_dir_)
+      .append(absl::StrFormat("shard.%06d", shard));
+}
+
+ShardLeaseRecord ShardLeaser::ReadRecord(size_t shard) const {
+  ShardLeaseRecord record;
+  std::ifstream file(RecordPath(shard));
+  // A missing or corrupted record means the shard was never leased.
+  if (!(file >> record.owner >> record.expiration_unix_sec >>
+        record.leased_sec >> record.num_stalls)) {
+    return {};
+  }
+  if (record.owner == kNoOwner) record.owner.clear();
+  return record;
+}
+
+void ShardLeaser::WriteRecord(size_t shard,
+                              const ShardLeaseRecord &record) const {
+  // Write to a temporary file and rename it, so that a crash in the middle
+  // of writing does not corrupt the record.
+  const std::string path = RecordPath(shard);
+  const std::string tmp_path = absl::StrCat(path, ".tmp");
+  {
+    std::ofstream file(tmp_path);
+    file << (record.owner.empty() ? kNoOwner : record.owner) << " "
+         << record.expiration_unix_sec << " " << record.leased_sec << " "
+         << record.num_stalls << "\n";
+    CHECK(file.good()) << "Failed to write " << tmp_path;
+  }
+  std::error_code error;
+  std::filesystem::rename(tmp_path, path, error);
+  CHECK(!error) << "Failed to rename " << tmp_path << ": " << error.message();
+}
+
+void ShardLeaser::AccountLeasedTime(ShardLeaseRecord &record) {
+  const absl::Time now = absl::Now();
+  if (last_renewal_ == absl::InfinitePast()) {
+    last_renewal_ = now;
+    return;
+  }
+  // Advance by whole seconds only, so that frequent renewals don't lose the
+  // sub-second remainder of every period.
+  const int64_t elapsed_sec = absl::ToInt64Seconds(now - last_renewal_);
+  record.leased_sec += elapsed_sec;
+  last_renewal_ += absl::Seconds(elapsed_sec);
+}
+
+std::optional<size_t> ShardLeaser::Acquire() {
+  ScopedFileLock lock(std::filesystem::path(lease_dir_).append("lock"));
+  const int64_t now = absl::ToUnixSeconds(absl::Now());
+  std::optional<size_t> best_shard;
+  ShardLeaseRecord best_record;
+  for (size_t shard = 0; shard < total_shards_; ++shard) {
+    auto record = ReadRecord(shard);
+    if (!record.owner.empty() && record.expiration_unix_sec > now) continue;
+    if (!best_shard.has_value() ||
+        std::tie(record.leased_sec, record.num_stalls) <
+            std::tie(best_record.leased_sec, best_record.num_stalls)) {
+      best_shard = shard;
+      best_record = record;
+    }
+  }
+  if (!best_shard.has_value()) return std::nullopt;
+  best_record.owner = owner_;
+  best_record.expiration_unix_sec =
+      now + absl::ToInt64Seconds(lease_duration_);
+  last_renewal_ = absl::InfinitePast();
+  AccountLeasedTime(best_record);
+  WriteRecord(*best_shard, best_record);
+  return best_shard;
+}
+
+bool ShardLeaser::Renew(size_t shard) {
+  CHECK_LT(shard, total_shards_);
+  ScopedFileLock lock(std::filesystem::path(lease_dir_).append("lock"));
+  auto record = ReadRecord(shard);
+  if (record.owner != owner_) return false;
+  AccountLeasedTime(record);
+  record.expiration_unix_sec =
+      absl::ToUnixSeconds(absl::Now() + lease_duration_);
+  WriteRecord(shard, record);
+  return true;
+}
+
+void ShardLeaser::Release(size_t shard, bool stalled) {
+  CHECK_LT(shard, total_shards_);
+  ScopedFileLock lock(std::filesystem::path(lease_dir_).append("lock"));
+  auto record = ReadRecord(shard);
+  if (record.owner != owner_) return;
+  AccountLeasedTime(record);
+  last_renewal_ = absl::InfinitePast();
+  record.owner.clear();
+  record.expiration_unix_sec = 0;
+  if (stalled) ++record.num_stalls;
+  WriteRecord(shard, record);
+}
+
+ShardLeaseRecord ShardLeaser::GetRecord(size_t shard) const {
+  CHECK_LT(shard, total_shards_);
+  ScopedFileLock lock(std::filesystem::path(lease_dir_).append("lock"));
+  return ReadRecord(shard);
+}
+
+}  // namespace centipede
@@ -0,0 +1,114 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Dynamic assignment of shards to fuzzing threads, see --shard_lease_seconds.
+//
+// Instead of fuzzing the fixed shard (--first_shard_index + thread index),
+// every thread leases a shard, fuzzes it while renewing the lease, and
+// releases it when the lease is lost or the coverage growth stalls; then it
+// leases another shard. The threads of any number of processes may share the
+// same lease directory: they will never fuzz the same shard concurrently, and
+// the least fuzzed shards are leased first.
+//
+// The lease directory contains the file "lock", which is locked with flock()
+// for the duration of every lease operation, and one file per shard with the
+// shard's lease record (see ShardLeaseRecord). A lease that is not renewed
+// until its expiration (e.g. because its owner has crashed or hung) may be
+// taken by another thread. flock() requires the lease directory to be on a
+// local file system shared by all participating processes.
+
+#ifndef THIRD_PARTY_CENTIPEDE_SHARD_LEASE_H_
+#define THIRD_PARTY_CENTIPEDE_SHARD_LEASE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "absl/time/time.h"
+
+namespace centipede {
+
+// The lease state of one shard, as stored in the lease directory.
+struct ShardLeaseRecord {
+  std::string owner;  // Empty if the shard is not leased.
+  int64_t expiration_unix_sec = 0;
+  // Total time the shard has been leased, for balancing.
+  int64_t leased_sec = 0;
+  // The number of times the shard was released because it had stalled.
+  int64_t num_stalls = 0;
+
+  bool operator==(const ShardLeaseRecord &other) const {
+    return owner == other.owner &&
+           expiration_unix_sec == other.expiration_unix_sec &&
+           leased_sec == other.leased_sec && num_stalls == other.num_stalls;
+  }
+};
+
+// Leases shards from a lease directory on behalf of one owner.
+// This class is thread-compatible. Different threads (and processes) use
+// different objects with distinct owner names.
+class ShardLeaser {
+ public:
+  // `lease_dir` is created if it does not exist. `owner` must be unique among
+  // all threads using `lease_dir`. Leases are valid for `lease_duration`
+  // after every Acquire() or Renew().
+  ShardLeaser(std::string_view lease_dir, size_t total_shards,
+              std::string_view owner, absl::Duration lease_duration);
+
+  // Leases the available shard that has been leased for the least total time
+  // so far; shards that stalled more often go last among equals. A shard is
+  // available if it is not leased or its lease has expired.
+  // Returns nullopt if no shard is available.
+  std::optional<size_t> Acquire();
+
+  // Extends the lease of `shard`, which must have been acquired by this
+  // object. Returns false if the lease has been lost (e.g. it expired and was
+  // taken by another owner), in which case the shard should not be fuzzed
+  // anymore.
+  bool Renew(size_t shard);
+
+  // Releases the lease of `shard`, if still held. `stalled` should be true if
+  // the shard is being released because its coverage growth has stalled.
+  void Release(size_t shard, bool stalled);
+
+  // Returns the current record of `shard`. For tests and logging.
+  ShardLeaseRecord GetRecord(size_t shard) const;
+
+  const std::string &owner() const { return owner_; }
+
+ private:
+  // Returns the path of the lease record of `shard`.
+  std::string RecordPath(size_t shard) const;
+  // Read or write the record of `shard`. Must be called under the lock.
+  ShardLeaseRecord ReadRecord(size_t shard) const;
+  void WriteRecord(size_t shard, const ShardLeaseRecord &record) const;
+  // Adds the time elapsed since the last acquisition or renewal of this
+  // object's lease to `record.leased_sec`, in whole seconds. The sub-second
+  // remainder is carried over to the next call.
+  void AccountLeasedTime(ShardLeaseRecord &record);
+
+  const std::string lease_dir_;
+  const size_t total_shards_;
+  const std::string owner_;
+  const absl::Duration lease_duration_;
+  // The time up to which the lease of this object is accounted in
+  // `leased_sec`: the last Acquire() or Renew(), minus the carried remainder.
+  absl::Time last_renewal_ = absl::InfinitePast();
+};
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_SHARD_LEASE_H_
@@ -0,0 +1,104 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./shard_lease.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./test_util.h"
+
+namespace centipede {
+namespace {
+
+std::string LeaseDir(std::string_view name) {
+  auto dir = std::filesystem::path(GetTestTempDir()).append(name);
+  std::filesystem::remove_all(dir);
+  return dir;
+}
+
+TEST(ShardLeaser, AcquireRenewRelease) {
+  const auto dir = LeaseDir("acquire");
+  ShardLeaser a(dir, /*total_shards=*/2, "a", absl::Hours(1));
+  ShardLeaser b(dir, /*total_shards=*/2, "b", absl::Hours(1));
+  ShardLeaser c(dir, /*total_shards=*/2, "c", absl::Hours(1));
+
+  // Every shard is leased by one owner at a time.
+  const auto shard_a = a.Acquire();
+  const auto shard_b = b.Acquire();
+  ASSERT_TRUE(shard_a.has_value());
+  ASSERT_TRUE(shard_b.has_value());
+  EXPECT_NE(*shard_a, *shard_b);
+  EXPECT_EQ(c.Acquire(), std::nullopt);
+  EXPECT_EQ(a.GetRecord(*shard_a).owner, "a");
+
+  EXPECT_TRUE(a.Renew(*shard_a));
+  EXPECT_FALSE(c.Renew(*shard_a));
+
+  // A released shard may be leased by another owner, which then holds it.
+  a.Release(*shard_a, /*stalled=*/true);
+  EXPECT_EQ(a.GetRecord(*shard_a).owner, "");
+  EXPECT_EQ(a.GetRecord(*shard_a).num_stalls, 1);
+  EXPECT_EQ(c.Acquire(), shard_a);
+  EXPECT_FALSE(a.Renew(*shard_a));
+  EXPECT_TRUE(c.Renew(*shard_a));
+  // Releasing a lost lease has no effect.
+  a.Release(*shard_a, /*stalled=*/false);
+  EXPECT_EQ(a.GetRecord(*shard_a).owner, "c");
+}
+
+TEST(ShardLeaser, ExpiredLeasesAreTaken) {
+  const auto dir = LeaseDir("expired");
+  ShardLeaser a(dir, /*total_shards=*/1, "a", absl::ZeroDuration());
+  ShardLeaser b(dir, /*total_shards=*/1, "b", absl::Hours(1));
+  EXPECT_EQ(a.Acquire(), 0);
+  // `a` never renews its lease, so it expires immediately.
+  EXPECT_EQ(b.Acquire(), 0);
+  EXPECT_FALSE(a.Renew(0));
+  EXPECT_EQ(a.Acquire(), std::nullopt);
+}
+
+TEST(ShardLeaser, PrefersLessStalledShards) {
+  const auto dir = LeaseDir("stalled");
+  ShardLeaser a(dir, /*total_shards=*/3, "a", absl::Hours(1));
+  // All shards have zero leased time, the ones that stalled go last.
+  for (size_t shard : {0, 1, 2}) {
+    EXPECT_EQ(a.Acquire(), shard);
+    a.Release(shard, /*stalled=*/shard != 2);
+  }
+  EXPECT_EQ(a.Acquire(), 2);
+  a.Release(2, /*stalled=*/true);
+  a.Release(2, /*stalled=*/true);  // No effect, already released.
+  EXPECT_EQ(a.Acquire(), 0);
+}
+
+TEST(ShardLeaser, FrequentRenewalsAccountLeasedTime) {
+  const auto dir = LeaseDir("frequent");
+  ShardLeaser a(dir, /*total_shards=*/1, "a", absl::Hours(1));
+  EXPECT_EQ(a.Acquire(), 0);
+  // Every renewal period is shorter than a second, but their sum is not.
+  for (int i = 0; i < 4; ++i) {
+    absl::SleepFor(absl::Milliseconds(300));
+    EXPECT_TRUE(a.Renew(0));
+  }
+  EXPECT_GE(a.GetRecord(0).leased_sec, 1);
+}
+
+}  // namespace
+}  // namespace centipede
@@ -21,6 +21,7 @@
 
 #include "absl/types/span.h"
 #include "./environment.h"
+#include "./metrics.h"
 
 namespace centipede {
 
@@ -33,6 +34,9 @@ namespace centipede {
 struct Stats {
   std::atomic<uint64_t> num_covered_pcs;
   std::atomic<uint64_t> corpus_size;
+  // Unlike the above, `metrics` are cheap to update and may be updated as
+  // often as needed. See --metrics_export_interval.
+  ThreadMetrics metrics;
 };
 
 // Takes a span of Stats objects `stats_vec` and the corresponding span of
@@ -0,0 +1,174 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./target_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./logging.h"
+
+namespace centipede {
+
+namespace {
+
+// The fraction of the slots shared equally by all targets regardless of
+// their growth.
+constexpr double kExplorationShare = 0.1;
+
+}  // namespace
+
+TargetScheduler::TargetScheduler(size_t num_targets, size_t num_slots,
+                                 absl::Duration half_life)
+    : num_slots_(num_slots), half_life_(half_life), targets_(num_targets) {
+  CHECK_GT(num_targets, 0);
+  CHECK_GT(num_slots, 0);
+  CHECK_GT(half_life, absl::ZeroDuration());
+}
+
+double TargetScheduler::GrowthRate(const Target &target) const {
+  // Both values decay at the same rate, so the ratio is current.
+  return target.decayed_features / target.decayed_cpu_seconds;
+}
+
+std::vector<double> TargetScheduler::WeightsLocked() const {
+  // The targets that have not run yet are assumed to grow as fast as the
+  // fastest one, so that they get measured soon.
+  double max_rate = 0;
+  for (const auto &target : targets_) {
+    if (target.decayed_cpu_seconds > 0)
+      max_rate = std::max(max_rate, GrowthRate(target));
+  }
+  std::vector<double> rates(targets_.size());
+  double sum_of_rates = 0;
+  for (size_t i = 0; i < targets_.size(); ++i) {
+    rates[i] = targets_[i].decayed_cpu_seconds > 0 ? GrowthRate(targets_[i])
+                                               : max_rate;
+    sum_of_rates += rates[i];
+  }
+  const double num_targets = targets_.size();
+  std::vector<double> weights(targets_.size());
+  for (size_t i = 0; i < targets_.size(); ++i) {
+    const double growth_share =
+        sum_of_rates > 0 ? rates[i] / sum_of_rates : 1 / num_targets;
+    weights[i] = kExplorationShare / num_targets +
+                 (1 - kExplorationShare) * growth_share;
+  }
+  return weights;
+}
+
+std::vector<double> TargetScheduler::Weights() const {
+  absl::ReaderMutexLock lock(&mu_);
+  return WeightsLocked();
+}
+
+size_t TargetScheduler::NextTarget() const {
+  size_t next = targets_.size();
+  for (size_t i = 0; i < targets_.size(); ++i) {
+    if (targets_[i].num_waiting == 0) continue;
+    if (next == targets_.size() ||
+        targets_[i].virtual_time < targets_[next].virtual_time) {
+      next = i;
+    }
+  }
+  return next;
+}
+
+void TargetScheduler::AcquireSlot(size_t target) {
+  absl::MutexLock lock(&mu_);
+  CHECK_LT(target, targets_.size());
+  auto &this_target = targets_[target];
+  if (this_target.num_waiting == 0 && this_target.num_running == 0 &&
+      absl::Now() - this_target.last_release >= half_life_) {
+    // A target that did not compete for slots for a while (or at all) must
+    // not get them all now: catch up with the virtual time of the waiting
+    // targets. Short pauses, e.g. between the batches of a thread, keep the
+    // credit of the target.
+    double min_virtual_time = this_target.virtual_time;
+    bool others_waiting = false;
+    for (const auto &other : targets_) {
+      if (other.num_waiting == 0) continue;
+      min_virtual_time = others_waiting
+                             ? std::min(min_virtual_time, other.virtual_time)
+                             : other.virtual_time;
+      others_waiting = true;
+    }
+    if (others_waiting) {
+      this_target.virtual_time =
+          std::max(this_target.virtual_time, min_virtual_time);
+    }
+  }
+  ++this_target.num_waiting;
+  while (num_busy_slots_ >= num_slots_ || NextTarget() != target) {
+    slot_released_.Wait(&mu_);
+  }
+  --this_target.num_waiting;
+  ++this_target.num_running;
+  ++num_busy_slots_;
+  // More slots may be free, let the next target check.
+  slot_released_.SignalAll();
+}
+
+void TargetScheduler::ReleaseSlot(size_t target, absl::Duration slot_time,
+                                  absl::Duration cpu_time,
+                                  size_t num_new_features) {
+  absl::MutexLock lock(&mu_);
+  CHECK_LT(target, targets_.size());
+  auto &this_target = targets_[target];
+  CHECK_GT(this_target.num_running, 0);
+  const absl::Time now = absl::Now();
+  if (this_target.last_update != absl::InfinitePast()) {
+    const double decay =
+        std::exp2(-absl::FDivDuration(now - this_target.last_update,
+                                      half_life_));
+    this_target.decayed_features *= decay;
+    this_target.decayed_cpu_seconds *= decay;
+  }
+  this_target.last_update = now;
+  this_target.last_release = now;
+  this_target.decayed_features += num_new_features;
+  this_target.decayed_cpu_seconds += absl::ToDoubleSeconds(cpu_time);
+  this_target.total_slot_time += slot_time;
+  this_target.virtual_time +=
+      absl::ToDoubleSeconds(slot_time) / WeightsLocked()[target];
+  --this_target.num_running;
+  --num_busy_slots_;
+  slot_released_.SignalAll();
+}
+
+std::string TargetScheduler::StatsString() const {
+  absl::ReaderMutexLock lock(&mu_);
+  const auto weights = WeightsLocked();
+  std::string result = "Target scheduler:";
+  for (size_t i = 0; i < targets_.size(); ++i) {
+    const auto &target = targets_[i];
+    absl::StrAppend(
+        &result, " T", i, ": ",
+        absl::StrFormat("weight %.3f", weights[i]), " rate ",
+        absl::StrFormat(
+            "%.2f", target.decayed_cpu_seconds > 0 ? GrowthRate(target) : 0),
+        "/cpu-s time ", absl::ToInt64Seconds(target.total_slot_time), "s;");
+  }
+  return result;
+}
+
+}  // namespace centipede
@@ -0,0 +1,105 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Time-sliced scheduling of several fuzz targets in one process, see
+// --targets.
+//
+// Every target is fuzzed by its own threads, but at most `num_slots` batches
+// (of all targets combined) execute at any time. Before executing a batch,
+// a thread acquires a slot for its target; afterwards it releases the slot
+// and reports how long the batch took, how much CPU time it used and how
+// many new features it found.
+//
+// Free slots go to the waiting targets in proportion to their weights
+// (stride scheduling: the waiting target with the smallest virtual time goes
+// first, and the virtual time of a target advances by the slot time divided
+// by its weight). The weight of a target is its recent coverage growth per
+// CPU-second, i.e. new features per second of CPU time of the engine and the
+// runner with older batches decaying exponentially, relative to the other
+// targets. CPU time rather than wall time, so that a target is not credited
+// or blamed for the time its batches wait for the CPUs used by the others.
+// Every target keeps a minimal weight, so that saturated targets still get
+// some time and may recover.
+
+#ifndef THIRD_PARTY_CENTIPEDE_TARGET_SCHEDULER_H_
+#define THIRD_PARTY_CENTIPEDE_TARGET_SCHEDULER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace centipede {
+
+// This class is thread-safe.
+class TargetScheduler {
+ public:
+  // Schedules `num_targets` targets on `num_slots` slots. The contribution of
+  // a batch to the growth rate of its target halves every `half_life`.
+  TargetScheduler(size_t num_targets, size_t num_slots,
+                  absl::Duration half_life);
+
+  // Blocks until `target` is granted a slot.
+  void AcquireSlot(size_t target);
+  // Releases the slot held by `target`, reporting that it was held for
+  // `slot_time`, used `cpu_time` of CPU time and found `num_new_features` new
+  // features.
+  void ReleaseSlot(size_t target, absl::Duration slot_time,
+                   absl::Duration cpu_time, size_t num_new_features);
+
+  // Returns the current weights of the targets, which sum up to 1.
+  std::vector<double> Weights() const;
+
+  // Returns a string with the per-target shares and growth rates, for logging.
+  std::string StatsString() const;
+
+ private:
+  struct Target {
+    // The number of threads of this target waiting for a slot / holding one.
+    size_t num_waiting = 0;
+    size_t num_running = 0;
+    // The time of the last ReleaseSlot().
+    absl::Time last_release = absl::InfinitePast();
+    // Exponentially decayed new features and CPU seconds, as of
+    // `last_update`.
+    double decayed_features = 0;
+    double decayed_cpu_seconds = 0;
+    absl::Time last_update = absl::InfinitePast();
+    // The stride scheduling virtual time.
+    double virtual_time = 0;
+    // Total slot time, for logging.
+    absl::Duration total_slot_time;
+  };
+
+  // Returns the growth rate of `target`, in new features per CPU-second.
+  double GrowthRate(const Target &target) const;
+  std::vector<double> WeightsLocked() const ABSL_SHARED_LOCKS_REQUIRED(mu_);
+  // Returns the index of the waiting target that should get the next slot.
+  size_t NextTarget() const ABSL_SHARED_LOCKS_REQUIRED(mu_);
+
+  const size_t num_slots_;
+  const absl::Duration half_life_;
+
+  mutable absl::Mutex mu_;
+  absl::CondVar slot_released_;
+  std::vector<Target> targets_ ABSL_GUARDED_BY(mu_);
+  size_t num_busy_slots_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace centipede
+
+#endif  // THIRD_PARTY_CENTIPEDE_TARGET_SCHEDULER_H_
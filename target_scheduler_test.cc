@@ -0,0 +1,105 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./target_scheduler.h"
+
+#include <atomic>
+#include <cstddef>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace centipede {
+namespace {
+
+TEST(TargetScheduler, WeightsFollowGrowth) {
+  TargetScheduler scheduler(/*num_targets=*/3, /*num_slots=*/2,
+                            absl::Hours(1));
+  // Nothing is known, all targets are equal.
+  for (double weight : scheduler.Weights()) EXPECT_DOUBLE_EQ(weight, 1. / 3);
+
+  scheduler.AcquireSlot(0);
+  scheduler.AcquireSlot(1);
+  scheduler.ReleaseSlot(0, absl::Seconds(1), absl::Seconds(1),
+                        /*num_new_features=*/30);
+  scheduler.ReleaseSlot(1, absl::Seconds(1), absl::Seconds(1),
+                        /*num_new_features=*/10);
+  // Target 2 has not run yet, it is assumed to be as good as target 0.
+  auto weights = scheduler.Weights();
+  EXPECT_NEAR(weights[0], 0.1 / 3 + 0.9 * 3 / 7, 1e-6);
+  EXPECT_NEAR(weights[1], 0.1 / 3 + 0.9 * 1 / 7, 1e-6);
+  EXPECT_NEAR(weights[2], weights[0], 1e-6);
+
+  scheduler.AcquireSlot(2);
+  scheduler.ReleaseSlot(2, absl::Seconds(1), absl::Seconds(1),
+                        /*num_new_features=*/0);
+  // Saturated targets keep a minimal weight.
+  weights = scheduler.Weights();
+  EXPECT_NEAR(weights[2], 0.1 / 3, 1e-6);
+  EXPECT_NEAR(weights[0] + weights[1] + weights[2], 1, 1e-6);
+}
+
+TEST(TargetScheduler, GrowthIsPerCpuSecond) {
+  TargetScheduler scheduler(/*num_targets=*/2, /*num_slots=*/2,
+                            absl::Hours(1));
+  scheduler.AcquireSlot(0);
+  scheduler.AcquireSlot(1);
+  // Both batches held their slots equally long, but batch 1 mostly waited
+  // for the CPU.
+  scheduler.ReleaseSlot(0, absl::Seconds(2), absl::Seconds(2),
+                        /*num_new_features=*/20);
+  scheduler.ReleaseSlot(1, absl::Seconds(2), absl::Milliseconds(500),
+                        /*num_new_features=*/10);
+  // The growth rates are 10 and 20 new features per CPU-second.
+  const auto weights = scheduler.Weights();
+  EXPECT_NEAR(weights[0], 0.1 / 2 + 0.9 * 1 / 3, 1e-6);
+  EXPECT_NEAR(weights[1], 0.1 / 2 + 0.9 * 2 / 3, 1e-6);
+}
+
+TEST(TargetScheduler, SlotsFollowWeights) {
+  constexpr size_t kNumTargets = 2;
+  constexpr size_t kThreadsPerTarget = 3;
+  constexpr size_t kNumGrants = 400;
+  TargetScheduler scheduler(kNumTargets, /*num_slots=*/1, absl::Hours(1));
+  std::atomic<size_t> num_grants = 0;
+  std::vector<std::atomic<size_t>> grants(kNumTargets);
+  std::vector<std::thread> threads;
+  for (size_t target = 0; target < kNumTargets; ++target) {
+    for (size_t i = 0; i < kThreadsPerTarget; ++i) {
+      threads.emplace_back([&, target]() {
+        while (num_grants < kNumGrants) {
+          scheduler.AcquireSlot(target);
+          ++num_grants;
+          ++grants[target];
+          // Hold the slot for a while, so that all threads get to compete.
+          absl::SleepFor(absl::Milliseconds(1));
+          // Target 0 grows, target 1 is saturated.
+          scheduler.ReleaseSlot(target, absl::Seconds(1), absl::Seconds(1),
+                                /*num_new_features=*/target == 0 ? 10 : 0);
+        }
+      });
+    }
+  }
+  for (auto &thread : threads) thread.join();
+  // The expected ratio is 0.95 / 0.05 = 19.
+  EXPECT_GT(grants[0], 8 * grants[1]) << grants[0] << " " << grants[1];
+  // The saturated target is not starved.
+  EXPECT_GT(grants[1], 0);
+}
+
+}  // namespace
+}  // namespace centipede
@@ -658,4 +658,121 @@ TEST(Centipede, ShardReader) {
   EXPECT_EQ(res[4].features, FeatureVec());
 }
 
+namespace {
+// A mock for LenControl test.
+class LenControlMock : public CentipedeCallbacks {
+ public:
+  explicit LenControlMock(const Environment &env, size_t size_alignment = 1)
+      : CentipedeCallbacks(env) {
+    CHECK(byte_array_mutator_.set_size_alignment(size_alignment));
+  }
+
+  // Doesn't execute anything. Never produces any features, so that the corpus
+  // consists only of the dummy input and no batch gains new coverage.
+  bool Execute(std::string_view binary, const std::vector<ByteArray> &inputs,
+               BatchResult &batch_result) override {
+    batch_result.results().clear();
+    batch_result.results().resize(inputs.size());
+    return true;
+  }
+
+  // Mutates with the internal ByteArrayMutator, records the max mutant size.
+  void Mutate(const std::vector<ByteArray> &inputs, size_t num_mutants,
+              std::vector<ByteArray> &mutants) override {
+    byte_array_mutator_.MutateMany(inputs, num_mutants, env_.crossover_level,
+                                   mutants);
+    for (const auto &mutant : mutants) {
+      max_mutant_size_ = std::max(max_mutant_size_, mutant.size());
+    }
+  }
+
+  size_t max_mutant_size_ = 0;
+};
+}  // namespace
+
+// Tests --len_control.
+TEST(Centipede, LenControl) {
+  ScopedTempDir wd("workdir");
+  Environment env;
+  env.workdir = wd.path;
+  env.num_runs = 10000;
+  env.batch_size = 100;
+  env.max_len = 64;
+  env.log_level = 0;
+  env.require_pc_table = false;  // No PC table here.
+
+  // The cap is never raised: the mutants remain small.
+  env.len_control = env.num_runs;
+  {
+    LenControlMock mock(env);
+    MockFactory factory(mock);
+    CentipedeMain(env, factory);
+    EXPECT_LE(mock.max_mutant_size_, 4);
+  }
+
+  // The cap is raised after every batch, since no batch gains new features.
+  // The mutants grow beyond the initial cap, but never beyond --max_len.
+  env.len_control = 1;
+  {
+    LenControlMock mock(env);
+    MockFactory factory(mock);
+    CentipedeMain(env, factory);
+    EXPECT_GT(mock.max_mutant_size_, 4);
+    EXPECT_LE(mock.max_mutant_size_, env.max_len);
+  }
+
+  // With a size alignment, the initial cap is raised to one alignment unit.
+  env.len_control = env.num_runs;
+  {
+    LenControlMock mock(env, /*size_alignment=*/8);
+    MockFactory factory(mock);
+    CentipedeMain(env, factory);
+    EXPECT_LE(mock.max_mutant_size_, 8);
+  }
+
+  // An unaligned --max_len is rounded down: growing an aligned input never
+  // exceeds it.
+  env.max_len = 60;
+  {
+    LenControlMock mock(env, /*size_alignment=*/8);
+    EXPECT_TRUE(mock.SetMaxLen(env.max_len));
+    std::vector<ByteArray> mutants;
+    mock.Mutate({ByteArray(56, 'x')}, 1000, mutants);
+    EXPECT_LE(mock.max_mutant_size_, env.max_len);
+  }
+}
+
+// A mock that executes the target in the normal way.
+class ExecuteCallbacks : public CentipedeCallbacks {
+ public:
+  explicit ExecuteCallbacks(const Environment &env)
+      : CentipedeCallbacks(env) {}
+
+  bool Execute(std::string_view binary, const std::vector<ByteArray> &inputs,
+               BatchResult &batch_result) override {
+    return ExecuteCentipedeSancovBinaryWithShmem(binary, inputs,
+                                                 batch_result) == EXIT_SUCCESS;
+  }
+
+  // Will not be called.
+  void Mutate(const std::vector<ByteArray> &inputs, size_t num_mutants,
+              std::vector<ByteArray> &mutants) override {
+    CHECK(false);
+  }
+};
+
+// Tests that a batch may take longer than the timeout of one input: only the
+// individual inputs are limited by --timeout_ms.
+TEST(Centipede, LongBatchOfFastInputs) {
+  Environment env;
+  env.binary = GetDataDependencyFilepath("testing/test_fuzz_target");
+  env.timeout_ms = 100;
+  ExecuteCallbacks callbacks(env);
+  // Every input takes 20ms, the batch takes 6 seconds.
+  const std::vector<ByteArray> inputs(300, {'n', 'a', 'p'});
+  BatchResult batch_result;
+  EXPECT_TRUE(callbacks.Execute(env.binary, inputs, batch_result));
+  EXPECT_EQ(batch_result.num_outputs_read(), inputs.size());
+}
+
 }  // namespace centipede
@@ -97,4 +97,10 @@ CENTIPEDE_RUNNER_FLAGS=":timeout_in_seconds=567:" "${target}" \
 CENTIPEDE_RUNNER_FLAGS=":timeout_in_seconds=2:" "${target}" "${slo}" \
   2>&1 | grep "======= Timeout.*; exiting"
 
+# A sub-second timeout fires long before the 10-second sleep ends.
+start_time="$(date +%s)"
+CENTIPEDE_RUNNER_FLAGS=":timeout_ms=200:" "${target}" "${slo}" \
+  2>&1 | grep "======= Timeout of 0.200 seconds exceeded; exiting"
+(( $(date +%s) - start_time < 5 )) || die "timeout_ms=200 fired too late"
+
 echo "PASS"
@@ -0,0 +1,64 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <strings.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// A string-heavy fuzz target for benchmarking the comparison interceptors,
+// see throughput_benchmark.sh.
+// Matches the input against a table of keywords with every intercepted
+// function, so that most of the execution time is spent in the interceptors.
+
+namespace {
+
+// Called through volatile pointers so that the compiler doesn't inline or
+// fold the calls: every call goes to the interceptor.
+int (*volatile memcmp_ptr)(const void *, const void *, size_t) = memcmp;
+int (*volatile strcmp_ptr)(const char *, const char *) = strcmp;
+int (*volatile strncmp_ptr)(const char *, const char *, size_t) = strncmp;
+int (*volatile strcasecmp_ptr)(const char *, const char *) = strcasecmp;
+int (*volatile strncasecmp_ptr)(const char *, const char *,
+                                size_t) = strncasecmp;
+void *(*volatile memmem_ptr)(const void *, size_t, const void *,
+                             size_t) = memmem;
+const char *(*volatile strstr_ptr)(const char *, const char *) = strstr;
+
+constexpr const char *kKeywords[] = {
+    "SELECT", "INSERT", "UPDATE", "DELETE", "CREATE", "ALTER", "DROP",
+    "WHERE",  "ORDER",  "GROUP",  "HAVING", "LIMIT",  "OFFSET",
+    "a-rather-long-keyword-that-does-not-fit-into-8-bytes",
+};
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  const std::string input(reinterpret_cast<const char *>(data), size);
+  const char *str = input.c_str();
+  int num_matches = 0;
+  for (const char *keyword : kKeywords) {
+    const size_t len = strlen(keyword);
+    num_matches += size >= len && memcmp_ptr(data, keyword, len) == 0;
+    num_matches += strcmp_ptr(str, keyword) == 0;
+    num_matches += strncmp_ptr(str, keyword, len) == 0;
+    num_matches += strcasecmp_ptr(str, keyword) == 0;
+    num_matches += strncasecmp_ptr(str, keyword, len) == 0;
+    num_matches += memmem_ptr(data, size, keyword, len) != nullptr;
+    num_matches += strstr_ptr(str, keyword) != nullptr;
+  }
+  return num_matches < 0;  // Always 0.
+}
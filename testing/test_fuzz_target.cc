@@ -96,6 +96,11 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
     sleep(10);
   }
 
+  // Sleep for 20 milliseconds if the input is 'nap'.
+  if (size == 3 && data[0] == 'n' && data[1] == 'a' && data[2] == 'p') {
+    usleep(20000);
+  }
+
   // Call SingleEdgeFunc() if input is "func1".
   if (size == 5 && data[0] == 'f' && data[1] == 'u' && data[2] == 'n' &&
       data[3] == 'c' && data[4] == '1') {
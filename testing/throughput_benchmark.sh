@@ -0,0 +1,206 @@
+#!/bin/bash
+
+# Copyright 2022 The Centipede Authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# End-to-end throughput benchmark of the engine on the test fuzz targets.
+#
+# Runs Centipede for a fixed number of executions per thread on every target,
+# for every combination of the flags below, and writes the results as JSON:
+# exec/s, the CPU time of the engine and of the runners, the peak RSS of
+# both, and the engine time by phase (summed over the threads).
+# empty_fuzz_target measures the pure engine and IPC overhead, and
+# string_cmp_fuzz_target the overhead of the comparison interceptors (compare
+# the runs with and without --use_cmp_features and --use_auto_dictionary).
+#
+#   bazel run -c opt //testing:throughput_benchmark -- [results.json]
+#
+# The matrix can be changed with environment variables (space-separated
+# lists; FEATURE_FLAGS is ';'-separated):
+#   TARGETS="empty_fuzz_target test_fuzz_target ..."
+#   NUM_RUNS=100000   # per thread
+#   NUM_THREADS="1 4"
+#   BATCH_SIZES="100 1000"
+#   FORK_SERVER="1 0"
+#   FEATURE_FLAGS=";--use_cmp_features=0 --use_dataflow_features=0;..."
+# CENTIPEDE_BINARY and <TARGET>_BINARY (e.g. EMPTY_FUZZ_TARGET_BINARY) can
+# point to other builds.
+
+set -eu
+
+source "$(dirname "$0")/../test_util.sh"
+
+# Under `bazel run`, the data deps are in the runfiles of this script.
+readonly RUNFILES_ROOT="${TEST_SRCDIR:-${RUNFILES_DIR:-$0.runfiles}}"
+readonly CENTIPEDE_RUNFILES="${RUNFILES_ROOT}/${TEST_WORKSPACE:-centipede}"
+
+centipede::maybe_set_var_to_executable_path \
+  CENTIPEDE_BINARY "${CENTIPEDE_RUNFILES}/centipede"
+
+readonly DEFAULT_TARGETS="empty_fuzz_target string_cmp_fuzz_target \
+test_fuzz_target threaded_fuzz_target"
+readonly TARGETS="${TARGETS:-${DEFAULT_TARGETS}}"
+readonly NUM_RUNS="${NUM_RUNS:-100000}"
+readonly NUM_THREADS="${NUM_THREADS:-1 4}"
+readonly BATCH_SIZES="${BATCH_SIZES:-100 1000}"
+readonly FORK_SERVER="${FORK_SERVER:-1 0}"
+readonly DEFAULT_FEATURE_FLAGS=";\
+--use_cmp_features=0 --use_dataflow_features=0 --use_auto_dictionary=0;\
+--use_counter_features=1 --path_level=10"
+readonly FEATURE_FLAGS="${FEATURE_FLAGS-${DEFAULT_FEATURE_FLAGS}}"
+
+for target in ${TARGETS}; do
+  var_name="$(echo "${target}" | tr '[:lower:]' '[:upper:]')_BINARY"
+  centipede::maybe_set_var_to_executable_path \
+    "${var_name}" "${CENTIPEDE_RUNFILES}/testing/${target}"
+done
+
+readonly TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+# Runs Centipede once with the given configuration and prints the results as
+# one JSON object.
+run_one() {
+  local -r target="$1"
+  local -r num_threads="$2"
+  local -r batch_size="$3"
+  local -r fork_server="$4"
+  local -r feature_flags="$5"
+  local -n binary="$(echo "${target}" | tr '[:lower:]' '[:upper:]')_BINARY"
+  local -r wd="${TMP_DIR}/wd"
+  local -r log_path="${TMP_DIR}/log"
+  rm -rf "${wd}"
+  mkdir -p "${wd}"
+
+  # A huge --coverage_journal_interval writes only the first and the last
+  # line of every thread's journal, and a huge --metrics_export_interval only
+  # the final metrics: the totals of the fuzzing loop.
+  # shellcheck disable=SC2086  # feature_flags must be split.
+  "${CENTIPEDE_BINARY}" \
+    --binary="${binary}" --workdir="${wd}" --symbolizer_path=/dev/null \
+    --seed=1 --num_runs="${NUM_RUNS}" --j="${num_threads}" \
+    --batch_size="${batch_size}" --fork_server="${fork_server}" \
+    --coverage_journal_interval=1000000000 \
+    --metrics_export_interval=1000000000 ${feature_flags} \
+    > "${log_path}" 2>&1 || die "Centipede failed, see the log:
+$(tail -20 "${log_path}")"
+  centipede::assert_fuzzing_success "${log_path}"
+
+  # The totals of all threads: executions and CPU times from the last lines
+  # of the coverage journals, and the fuzzing time of the slowest thread.
+  local journals
+  journals="$(tail -q -n1 "${wd}"/coverage-journal-*)"
+  # The time by phase and the peak RSS of the runners, summed or maxed over
+  # the threads, from the final metrics.
+  local metrics
+  metrics="$(tail -q -n1 "${wd}"/metrics-*.jsonl)"
+  # The RSS of the engine from the log lines.
+  awk -F, -v journals="${journals}" -v metrics="${metrics}" \
+    -v target="${target}" -v num_threads="${num_threads}" \
+    -v batch_size="${batch_size}" -v fork_server="${fork_server}" \
+    -v feature_flags="${feature_flags}" -v num_runs="${NUM_RUNS}" '
+    # Returns the numeric value of the top-level "key" of the JSON `line`.
+    function json_value(line, key) {
+      if (!match(line, "\"" key "\":[0-9]+")) return 0;
+      return substr(line, RSTART + length(key) + 3, RLENGTH - length(key) - 3);
+    }
+    BEGIN {
+      n = split(journals, lines, "\n");
+      for (i = 1; i <= n; ++i) {
+        split(lines[i], f, ",");
+        if (f[2] > seconds) seconds = f[2];
+        execs += f[3];
+        engine_cpu += f[12];
+        runner_cpu += f[13];
+      }
+      split("mutate execute triage prune sync telemetry other", names, " ");
+      for (i = 1; i <= 7; ++i) {
+        phases[names[i]] = json_value(metrics, names[i] "_usec_total") / 1e6;
+      }
+      runner_prep = json_value(metrics, "runner_prep_usec_total") / 1e6;
+      runner_exec = json_value(metrics, "runner_exec_usec_total") / 1e6;
+      runner_post = json_value(metrics, "runner_post_usec_total") / 1e6;
+      runner_rss = json_value(metrics, "runner_peak_rss_mb");
+      FS = " ";
+    }
+    / mb: [0-9]+ / {
+      if (match($0, / mb: [0-9]+ /)) {
+        rss = substr($0, RSTART + 5, RLENGTH - 6) + 0;
+        if (rss > engine_rss) engine_rss = rss;
+      }
+    }
+    END {
+      printf("{\"target\": \"%s\", \"num_threads\": %d, \"batch_size\": %d, ",
+             target, num_threads, batch_size);
+      printf("\"fork_server\": %d, \"feature_flags\": \"%s\", ",
+             fork_server, feature_flags);
+      printf("\"num_runs\": %d, \"execs\": %d, \"seconds\": %.3f, ",
+             num_runs, execs, seconds);
+      printf("\"execs_per_second\": %.1f, ",
+             seconds > 0 ? execs / seconds : 0);
+      printf("\"engine_cpu_seconds\": %.3f, \"runner_cpu_seconds\": %.3f, ",
+             engine_cpu, runner_cpu);
+      total_cpu = engine_cpu + runner_cpu;
+      printf("\"engine_cpu_share\": %.3f, ",
+             total_cpu > 0 ? engine_cpu / total_cpu : 0);
+      printf("\"engine_peak_rss_mb\": %d, \"runner_peak_rss_mb\": %d, ",
+             engine_rss, runner_rss);
+      printf("\"phase_seconds\": {");
+      for (i = 1; i <= 7; ++i) {
+        printf("%s\"%s\": %.3f", i > 1 ? ", " : "", names[i],
+               phases[names[i]]);
+      }
+      printf("}, \"runner_seconds\": {\"prep\": %.3f, \"exec\": %.3f, ",
+             runner_prep, runner_exec);
+      printf("\"post\": %.3f}}", runner_post);
+    }' "${log_path}"
+}
+
+main() {
+  local -r out="${1:-/dev/stdout}"
+  local results=()
+  local feature_flags_list
+  IFS=';' read -r -a feature_flags_list <<< "${FEATURE_FLAGS};"
+  for target in ${TARGETS}; do
+    for num_threads in ${NUM_THREADS}; do
+      for batch_size in ${BATCH_SIZES}; do
+        for fork_server in ${FORK_SERVER}; do
+          for feature_flags in "${feature_flags_list[@]}"; do
+            echo "Running ${target} --j=${num_threads}" \
+              "--batch_size=${batch_size} --fork_server=${fork_server}" \
+              "${feature_flags}" >&2
+            results+=("$(run_one "${target}" "${num_threads}" \
+              "${batch_size}" "${fork_server}" "${feature_flags}")")
+            echo "  ${results[-1]}" >&2
+          done
+        done
+      done
+    done
+  done
+
+  {
+    printf '{\n  "context": {"date": "%s", "host_name": "%s", ' \
+      "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(hostname)"
+    printf '"num_cpus": %d, "kernel": "%s"},\n  "runs": [' \
+      "$(nproc)" "$(uname -r)"
+    local sep=""
+    for result in "${results[@]}"; do
+      printf '%s\n    %s' "${sep}" "${result}"
+      sep=","
+    done
+    printf '\n  ]\n}\n'
+  } > "${out}"
+}
+
+main "$@"
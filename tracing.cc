@@ -0,0 +1,179 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tracing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/const_init.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "./defs.h"
+#include "./logging.h"
+#include "./remote_file.h"
+
+namespace centipede {
+
+namespace {
+
+// Chrome trace processes used for the two tracks.
+constexpr int kEnginePid = 1;
+constexpr int kRunnerPid = 2;
+
+struct TraceEvent {
+  const char *name;
+  TraceTrack track;
+  int64_t start_usec;
+  int64_t duration_usec;
+};
+
+// The ring buffer of one thread. Only the owning thread writes, but the
+// buffer may be dumped from any thread, hence the (uncontended) mutex.
+class ThreadBuffer {
+ public:
+  ThreadBuffer(int tid, size_t capacity) : tid_(tid), events_(capacity) {}
+
+  void SetName(std::string_view name) {
+    absl::MutexLock lock(&mu_);
+    name_ = std::string(name);
+  }
+
+  void Add(const TraceEvent &event) {
+    absl::MutexLock lock(&mu_);
+    events_[num_added_ % events_.size()] = event;
+    ++num_added_;
+  }
+
+  // Appends the events, oldest first, and the thread name metadata to `out`.
+  void AppendJson(std::string &out, bool &first) const {
+    absl::MutexLock lock(&mu_);
+    auto append = [&](const std::string &json) {
+      absl::StrAppend(&out, first ? "\n" : ",\n", json);
+      first = false;
+    };
+    const std::string thread_name =
+        name_.empty() ? absl::StrCat("thread ", tid_) : name_;
+    for (int pid : {kEnginePid, kRunnerPid}) {
+      append(absl::StrCat(R"({"name":"thread_name","ph":"M","pid":)", pid,
+                          R"(,"tid":)", tid_, R"(,"args":{"name":")",
+                          thread_name, R"("}})"));
+    }
+    const size_t size = std::min(num_added_, events_.size());
+    for (size_t i = num_added_ - size; i < num_added_; ++i) {
+      const TraceEvent &event = events_[i % events_.size()];
+      append(absl::StrCat(
+          R"({"name":")", event.name, R"(","ph":"X","pid":)",
+          event.track == TraceTrack::kEngine ? kEnginePid : kRunnerPid,
+          R"(,"tid":)", tid_, R"(,"ts":)", event.start_usec, R"(,"dur":)",
+          event.duration_usec, "}"));
+    }
+  }
+
+ private:
+  const int tid_;
+  mutable absl::Mutex mu_;
+  std::string name_ ABSL_GUARDED_BY(mu_);
+  std::vector<TraceEvent> events_ ABSL_GUARDED_BY(mu_);
+  size_t num_added_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+std::atomic<bool> tracing_enabled = false;
+size_t events_per_thread = 0;
+
+// All buffers ever created. Buffers outlive their threads, so that the events
+// of finished threads are still dumped.
+ABSL_CONST_INIT absl::Mutex buffers_mu(absl::kConstInit);
+std::vector<std::unique_ptr<ThreadBuffer>> *buffers
+    ABSL_GUARDED_BY(buffers_mu) = nullptr;
+
+// Returns the buffer of the calling thread, creating it if needed.
+ThreadBuffer &GetThreadBuffer() {
+  thread_local ThreadBuffer *buffer = nullptr;
+  if (buffer == nullptr) {
+    absl::MutexLock lock(&buffers_mu);
+    if (buffers == nullptr) {
+      buffers = new std::vector<std::unique_ptr<ThreadBuffer>>;
+    }
+    buffers->push_back(std::make_unique<ThreadBuffer>(
+        static_cast<int>(buffers->size()), events_per_thread));
+    buffer = buffers->back().get();
+  }
+  return *buffer;
+}
+
+}  // namespace
+
+void EnableTracing(size_t capacity) {
+  CHECK_GT(capacity, 0);
+  events_per_thread = capacity;
+  tracing_enabled.store(true, std::memory_order_release);
+}
+
+bool TracingEnabled() {
+  return tracing_enabled.load(std::memory_order_relaxed);
+}
+
+void SetTraceThreadName(std::string_view name) {
+  if (!TracingEnabled()) return;
+  GetThreadBuffer().SetName(name);
+}
+
+void AddTraceEvent(const char *name, TraceTrack track, int64_t start_usec,
+                   int64_t duration_usec) {
+  if (!TracingEnabled()) return;
+  GetThreadBuffer().Add({name, track, start_usec, duration_usec});
+}
+
+int64_t TraceNowUsec() { return absl::GetCurrentTimeNanos() / 1000; }
+
+std::string TraceToJson() {
+  std::string out = R"({"displayTimeUnit":"ms","traceEvents":[)";
+  bool first = true;
+  for (const auto &[pid, process_name] :
+       {std::pair{kEnginePid, "centipede"}, {kRunnerPid, "runner"}}) {
+    absl::StrAppend(&out, first ? "\n" : ",\n",
+                    R"({"name":"process_name","ph":"M","pid":)", pid,
+                    R"(,"args":{"name":")", process_name, R"("}})");
+    first = false;
+  }
+  absl::MutexLock lock(&buffers_mu);
+  if (buffers != nullptr) {
+    for (const auto &buffer : *buffers) buffer->AppendJson(out, first);
+  }
+  absl::StrAppend(&out, "\n]}\n");
+  return out;
+}
+
+void WriteTrace(std::string_view path) {
+  const std::string json = TraceToJson();
+  if (RemoteFile *file = RemoteFileOpen(path, "w")) {
+    RemoteFileAppend(file, ByteArray(json.begin(), json.end()));
+    RemoteFileClose(file);
+    LOG(INFO) << "Wrote trace to " << path;
+  } else {
+    LOG(INFO) << "Failed to open " << path;
+  }
+}
+
+}  // namespace centipede
@@ -0,0 +1,72 @@
+// Copyright 2022 The Centipede Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tracing.h"
+
+#include <filesystem>
+#include <string>
+#include <thread>  // NOLINT
+
+#include "googletest/include/gtest/gtest.h"
+#include "absl/strings/match.h"
+#include "./test_util.h"
+#include "./util.h"
+
+namespace centipede {
+namespace {
+
+// Tracing is process-wide, so everything is tested in one test.
+TEST(Tracing, RecordAndDump) {
+  // Nothing is recorded before tracing is enabled.
+  EXPECT_FALSE(TracingEnabled());
+  { TraceSpan span("before"); }
+  EXPECT_FALSE(absl::StrContains(TraceToJson(), "before"));
+
+  EnableTracing(3);
+  EXPECT_TRUE(TracingEnabled());
+  SetTraceThreadName("main");
+  { TraceSpan span("span1"); }
+  AddTraceEvent("span2", TraceTrack::kEngine, 100, 10);
+  AddTraceEvent("span3", TraceTrack::kRunner, 105, 5);
+  AddTraceEvent("span4", TraceTrack::kEngine, 200, 10);
+  std::thread([] { AddTraceEvent("other", TraceTrack::kEngine, 300, 1); })
+      .join();
+
+  const std::string json = TraceToJson();
+  EXPECT_TRUE(absl::StartsWith(json, R"({"displayTimeUnit":"ms")"));
+  EXPECT_TRUE(absl::EndsWith(json, "]}\n"));
+  // The ring buffer keeps the last 3 events of every thread.
+  EXPECT_FALSE(absl::StrContains(json, "span1"));
+  EXPECT_TRUE(absl::StrContains(
+      json, R"({"name":"span2","ph":"X","pid":1,"tid":0,"ts":100,"dur":10})"));
+  EXPECT_TRUE(absl::StrContains(
+      json, R"({"name":"span3","ph":"X","pid":2,"tid":0,"ts":105,"dur":5})"));
+  EXPECT_TRUE(absl::StrContains(json, R"("name":"span4")"));
+  EXPECT_TRUE(absl::StrContains(
+      json, R"({"name":"other","ph":"X","pid":1,"tid":1,"ts":300,"dur":1})"));
+  EXPECT_TRUE(absl::StrContains(
+      json, R"("pid":1,"tid":0,"args":{"name":"main"})"));
+  EXPECT_TRUE(absl::StrContains(
+      json, R"("pid":1,"tid":1,"args":{"name":"thread 1"})"));
+
+  const auto path =
+      (std::filesystem::path(GetTestTempDir()) / "trace.json").string();
+  WriteTrace(path);
+  std::string contents;
+  ReadFromLocalFile(path, contents);
+  EXPECT_EQ(contents, json);
+}
+
+}  // namespace
+}  // namespace centipede